@@ -0,0 +1,168 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+// This example shows how objects shared between jobs can be replaced without locks, by 
+// retiring the old version with jobs::ebr::retire rather than deleting it straight away.
+
+// Comments on topics previously discussed in other examples have been removed 
+// or simplified, go back to older examples if you are unsure of anything.
+
+#include <jobs.h>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+
+namespace {
+
+const uint32_t settings_magic = 0x5E771265;
+const size_t settings_value_count = 16;
+const size_t round_count = 20;
+const size_t writers_per_round = 4;
+const size_t readers_per_round = 32;
+const size_t reads_per_reader = 1000;
+
+// Some read-mostly state shared by every job. Each version is immutable once published, so readers
+// can check they never see one that is half written, or one that has already been freed.
+struct settings
+{
+    uint32_t magic = settings_magic;
+    uint64_t version = 0;
+    uint64_t values[settings_value_count] = {};
+};
+
+std::atomic<settings*> g_current_settings{ nullptr };
+std::atomic<uint64_t> g_next_version{ 1 };
+std::atomic<size_t> g_retired_count{ 0 };
+std::atomic<size_t> g_reclaimed_count{ 0 };
+std::atomic<size_t> g_bad_reads{ 0 };
+
+settings* make_settings(uint64_t version)
+{
+    settings* result = new settings();
+    result->version = version;
+    for (size_t i = 0; i < settings_value_count; i++)
+    {
+        result->values[i] = version * (i + 1);
+    }
+    return result;
+}
+
+// Called by the scheduler once no job can still be reading the object. The magic is cleared first 
+// so a reader that was wrongly allowed to keep a pointer has a chance of noticing.
+void reclaim_settings(void* object)
+{
+    settings* old_settings = static_cast<settings*>(object);
+    old_settings->magic = 0;
+    delete old_settings;
+
+    g_reclaimed_count++;
+}
+
+void write_settings(jobs::scheduler& scheduler)
+{
+    settings* new_settings = make_settings(g_next_version++);
+    settings* old_settings = g_current_settings.exchange(new_settings);
+
+    // Other jobs may still be reading the old version, so it can't be deleted yet. Once every worker 
+    // has been between jobs it's handed to reclaim_settings.
+    jobs::result result = jobs::ebr::retire(scheduler, old_settings, reclaim_settings);
+    assert(result == jobs::result::success);
+
+    g_retired_count++;
+}
+
+void read_settings()
+{
+    for (size_t i = 0; i < reads_per_reader; i++)
+    {
+        // The pointer is only safe to use until this job next suspends, so it's not held across any waits or yields.
+        const settings* current = g_current_settings.load();
+
+        bool valid = (current->magic == settings_magic);
+        for (size_t j = 0; j < settings_value_count && valid; j++)
+        {
+            valid = (current->values[j] == current->version * (j + 1));
+        }
+
+        if (!valid)
+        {
+            g_bad_reads++;
+        }
+    }
+}
+
+}; // namespace
+
+void jobsMain()
+{
+    g_current_settings = make_settings(0);
+
+    {
+        jobs::scheduler scheduler;
+        scheduler.set_max_jobs(writers_per_round + readers_per_round);
+        scheduler.set_max_retired_objects(round_count * writers_per_round);
+        scheduler.add_thread_pool(jobs::scheduler::get_logical_core_count(), jobs::priority::all);
+        scheduler.add_fiber_pool(writers_per_round + readers_per_round, 16 * 1024);
+
+        jobs::result result = scheduler.init();
+        assert(result == jobs::result::success);
+
+        // Each round mixes writers replacing the settings with readers using them. Between rounds every 
+        // worker passes through a quiescent state, so older versions get reclaimed while the scheduler runs.
+        for (size_t round = 0; round < round_count; round++)
+        {
+            for (size_t i = 0; i < writers_per_round + readers_per_round; i++)
+            {
+                // Spread the writers out between the readers.
+                bool is_writer = (i % (readers_per_round / writers_per_round + 1)) == 0;
+
+                jobs::job_handle job;
+                result = scheduler.create_job(job);
+                assert(result == jobs::result::success);
+
+                job.set_tag(is_writer ? "Write Settings" : "Read Settings");
+                job.set_stack_size(16 * 1024);
+                if (is_writer)
+                {
+                    job.set_work([&scheduler]() { write_settings(scheduler); });
+                }
+                else
+                {
+                    job.set_work([]() { read_settings(); });
+                }
+
+                job.dispatch();
+            }
+
+            scheduler.wait_until_idle();
+        }
+
+        JOBS_PRINTF("Retired %zi versions, %zi reclaimed while the scheduler was running.\n", g_retired_count.load(), g_reclaimed_count.load());
+
+        // Anything still waiting is reclaimed when the scheduler is destroyed.
+    }
+
+    JOBS_PRINTF("Reclaimed %zi of %zi versions after shutdown, %zi bad reads.\n", g_reclaimed_count.load(), g_retired_count.load(), g_bad_reads.load());
+
+    delete g_current_settings.exchange(nullptr);
+}
@@ -108,6 +108,10 @@ public:
         m_tick_job.set_tag(name);
         m_tick_job.set_stack_size(1 * 1024);
         m_tick_job.set_priority(jobs::priority::low);
+
+        // Keep ticking this object on the same worker each frame, so its data stays in that workers cache.
+        m_tick_job.set_affinity_key(m_tickable_index);
+
         m_tick_job.set_work([=]() { tick_loop(); });
         m_tick_job.set_completion_counter(m_frame_info->frame_end_counter);
 
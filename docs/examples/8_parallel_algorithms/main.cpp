@@ -0,0 +1,268 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+// This example benchmarks the parallel algorithms against their serial
+// standard library equivalents at several sizes and kinds of input.
+
+// Comments on topics previously discussed in other examples have been removed 
+// or simplified, go back to older examples if you are unsure of anything.
+
+#include <jobs.h>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+namespace {
+
+// Number of times each benchmark is run, the fastest run is reported.
+const size_t benchmark_runs = 10;
+
+// Runs a function several times and returns the fastest run in microseconds. The
+// setup function is run untimed before each run.
+template <typename setup_function_type, typename function_type>
+double benchmark(const setup_function_type& setup, const function_type& function)
+{
+    double best_time = 0.0;
+
+    for (size_t i = 0; i < benchmark_runs; i++)
+    {
+        setup();
+
+        auto start = std::chrono::high_resolution_clock::now();
+        function();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double time = std::chrono::duration<double, std::micro>(end - start).count();
+        if (i == 0 || time < best_time)
+        {
+            best_time = time;
+        }
+    }
+
+    return best_time;
+}
+
+// Runs a function several times and returns the fastest run in microseconds.
+template <typename function_type>
+double benchmark(const function_type& function)
+{
+    return benchmark([]() {}, function);
+}
+
+// Set if any parallel result didn't match its serial equivalent.
+bool results_mismatched = false;
+
+// Compares a parallel result with the serial one. Unlike assert this also runs in release 
+// builds, which are the only ones where the timings mean anything.
+void check_result(bool matches, const char* name, size_t size)
+{
+    if (!matches)
+    {
+        JOBS_PRINTF("%s gave a different result to its serial equivalent, size=%zi\n", name, size);
+        results_mismatched = true;
+    }
+}
+
+// Kinds of input the sorting benchmarks are run on.
+enum class sort_input
+{
+    random,
+    sorted,
+    few_unique,
+
+    count
+};
+
+// Fills an array with keys to sort.
+void generate_sort_input(std::vector<uint32_t>& keys, sort_input input)
+{
+    uint32_t seed = 12345;
+
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+
+        switch (input)
+        {
+        case sort_input::random:        keys[i] = seed;             break;
+        case sort_input::sorted:        keys[i] = (uint32_t)i;      break;
+        case sort_input::few_unique:    keys[i] = seed % 16;        break;
+        default:                                                    break;
+        }
+    }
+}
+
+};
+
+void jobsMain()
+{
+    jobs::scheduler scheduler;
+    scheduler.set_max_jobs(1000);
+    scheduler.set_max_counters(1000);
+    scheduler.add_thread_pool(jobs::scheduler::get_logical_core_count(), jobs::priority::all);
+    scheduler.add_fiber_pool(1000, 64 * 1024);
+
+    jobs::result result = scheduler.init();
+    assert(result == jobs::result::success);
+
+    const size_t sizes[] = { 1000, 100000, 1000000, 10000000 };
+
+    JOBS_PRINTF("%12s %16s %16s %16s %16s\n", "size", "accumulate (us)", "reduce (us)", "incl_scan (us)", "scan (us)");
+
+    for (size_t size : sizes)
+    {
+        std::vector<uint64_t> input(size);
+        std::vector<uint64_t> serial_output(size);
+        std::vector<uint64_t> parallel_output(size);
+
+        for (size_t i = 0; i < size; i++)
+        {
+            input[i] = i % 251;
+        }
+
+        auto add = [](uint64_t a, uint64_t b) { return a + b; };
+
+        // Reductions.
+        uint64_t serial_sum = 0;
+        double accumulate_time = benchmark([&]() {
+            serial_sum = std::accumulate(input.begin(), input.end(), (uint64_t)0);
+        });
+
+        uint64_t parallel_sum = 0;
+        double reduce_time = benchmark([&]() {
+            jobs::parallel_reduce(scheduler, 0, size, (uint64_t)0, [&](size_t index) { return input[index]; }, add, parallel_sum);
+        });
+
+        check_result(serial_sum == parallel_sum, "parallel_reduce", size);
+
+        // Prefix scans.
+        double inclusive_scan_time = benchmark([&]() {
+            std::inclusive_scan(input.begin(), input.end(), serial_output.begin());
+        });
+
+        double scan_time = benchmark([&]() {
+            jobs::parallel_scan(scheduler, input.data(), parallel_output.data(), size, (uint64_t)0, add);
+        });
+
+        check_result(serial_output == parallel_output, "parallel_scan", size);
+
+        JOBS_PRINTF("%12zi %16.1f %16.1f %16.1f %16.1f\n", size, accumulate_time, reduce_time, inclusive_scan_time, scan_time);
+    }
+
+    const char* sort_input_names[] = { "random", "sorted", "few unique" };
+
+    JOBS_PRINTF("\n%12s %12s %16s %16s\n", "size", "input", "std::sort (us)", "sort (us)");
+
+    for (size_t size : sizes)
+    {
+        std::vector<uint32_t> keys(size);
+        std::vector<uint32_t> serial_keys(size);
+        std::vector<uint32_t> parallel_keys(size);
+
+        for (size_t input = 0; input < (size_t)sort_input::count; input++)
+        {
+            generate_sort_input(keys, (sort_input)input);
+
+            double std_sort_time = benchmark([&]() { serial_keys = keys; }, [&]() {
+                std::sort(serial_keys.begin(), serial_keys.end());
+            });
+
+            double sort_time = benchmark([&]() { parallel_keys = keys; }, [&]() {
+                jobs::parallel_sort(scheduler, parallel_keys.data(), size);
+            });
+
+            check_result(serial_keys == parallel_keys, "parallel_sort", size);
+
+            JOBS_PRINTF("%12zi %12s %16.1f %16.1f\n", size, sort_input_names[input], std_sort_time, sort_time);
+        }
+    }
+
+    // Merging the two halves of an array that have been sorted separately.
+    JOBS_PRINTF("\n%12s %16s %16s\n", "size", "std::merge (us)", "merge (us)");
+
+    for (size_t size : sizes)
+    {
+        std::vector<uint32_t> keys(size);
+        std::vector<uint32_t> serial_output(size);
+        std::vector<uint32_t> parallel_output(size);
+
+        generate_sort_input(keys, sort_input::random);
+
+        size_t half = size / 2;
+        std::sort(keys.begin(), keys.begin() + half);
+        std::sort(keys.begin() + half, keys.end());
+
+        double std_merge_time = benchmark([&]() {
+            std::merge(keys.begin(), keys.begin() + half, keys.begin() + half, keys.end(), serial_output.begin());
+        });
+
+        double merge_time = benchmark([&]() {
+            jobs::parallel_merge(scheduler, keys.data(), half, keys.data() + half, size - half, parallel_output.data());
+        });
+
+        check_result(serial_output == parallel_output, "parallel_merge", size);
+
+        JOBS_PRINTF("%12zi %16.1f %16.1f\n", size, std_merge_time, merge_time);
+    }
+
+    // Integrating a structure-of-arrays particle system, with each field in its own array.
+    JOBS_PRINTF("\n%12s %16s %16s\n", "size", "serial (us)", "chunked (us)");
+
+    for (size_t size : sizes)
+    {
+        std::vector<float> position(size, 0.0f);
+        std::vector<float> velocity(size, 1.0f);
+        std::vector<float> serial_position(size);
+
+        const float delta = 1.0f / 60.0f;
+
+        auto integrate = [&](float* output, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                output[i] = position[i] + velocity[i] * delta;
+            }
+        };
+
+        double serial_time = benchmark([&]() {
+            integrate(serial_position.data(), 0, size);
+        });
+
+        // Each chunk is aligned in all three arrays and a whole number of 8-wide vectors long, so
+        // the compiler can vectorize the loop without peeling it for alignment.
+        std::vector<float> parallel_position(size);
+        double chunked_time = benchmark([&]() {
+            auto integrate_range = [&](size_t begin, size_t end) { integrate(parallel_position.data(), begin, end); };
+
+            jobs::parallel_for_each_chunk(scheduler, size, 8, integrate_range, integrate_range, jobs::parallel_options(), 
+                parallel_position.data(), position.data(), velocity.data());
+        });
+
+        check_result(serial_position == parallel_position, "parallel_for_each_chunk", size);
+
+        JOBS_PRINTF("%12zi %16.1f %16.1f\n", size, serial_time, chunked_time);
+    }
+
+    JOBS_PRINTF("\n%s\n", results_mismatched ? "Some parallel results were incorrect." : "All parallel results matched.");
+}
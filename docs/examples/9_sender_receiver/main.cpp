@@ -0,0 +1,82 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+// This example shows how work can be composed with the sender/receiver interface
+// in jobs_execution.h, rather than by creating and dispatching jobs directly.
+
+// Comments on topics previously discussed in other examples have been removed 
+// or simplified, go back to older examples if you are unsure of anything.
+
+#include <jobs.h>
+#include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+void jobsMain()
+{
+    jobs::scheduler scheduler;
+    scheduler.set_max_jobs(100);
+    scheduler.set_max_counters(100);
+    scheduler.add_thread_pool(jobs::scheduler::get_logical_core_count(), jobs::priority::all);
+    scheduler.add_fiber_pool(100, 64 * 1024);
+
+    jobs::result result = scheduler.init();
+    assert(result == jobs::result::success);
+
+    // A job_scheduler is a cheap handle describing where, and at what priority, senders run their work.
+    jobs::execution::job_scheduler job_scheduler(scheduler, jobs::priority::normal, 64 * 1024);
+
+    // Senders only describe work, nothing runs until they are started. schedule() completes on a new job, 
+    // and then() continues on that same job with whatever the previous sender completed with.
+    auto answer = jobs::execution::then(
+        jobs::execution::then(jobs::execution::schedule(job_scheduler), []() { 
+            return 21; 
+        }),
+        [](int value) { 
+            return value * 2; 
+        }
+    );
+
+    // bulk() calls a function for every index, split between the workers in the same way as the parallel algorithms.
+    std::vector<uint64_t> squares(100000);
+    auto fill_squares = jobs::execution::bulk(jobs::execution::schedule(job_scheduler), squares.size(), [&squares](size_t index) {
+        squares[index] = (uint64_t)index * index;
+    });
+
+    // when_all() starts both senders at once and completes with all of their values once the last one 
+    // finishes. The bulk sender has no values, so the combined sender completes with just the answer.
+    auto both = jobs::execution::when_all(answer, fill_squares);
+
+    // sync_wait() starts the sender and waits for it. Outside of a job this blocks, inside one it suspends the job instead.
+    std::tuple<int> values;
+    result = jobs::execution::sync_wait(both, values);
+    assert(result == jobs::result::success);
+
+    bool squares_correct = true;
+    for (size_t i = 0; i < squares.size(); i++)
+    {
+        squares_correct &= (squares[i] == (uint64_t)i * i);
+    }
+
+    JOBS_PRINTF("answer=%i squares %s\n", std::get<0>(values), squares_correct ? "correct" : "incorrect");
+}
@@ -29,15 +29,21 @@
 #define __JOBS_H__
 
 #include "jobs_defines.h"
+#include "jobs_algorithms.h"
 #include "jobs_callback_scheduler.h"
 #include "jobs_counter.h"
+#include "jobs_ebr.h"
 #include "jobs_enums.h"
 #include "jobs_event.h"
+#include "jobs_execution.h"
 #include "jobs_fiber.h"
+#include "jobs_future.h"
+#include "jobs_group.h"
 #include "jobs_job.h"
 #include "jobs_memory.h"
 #include "jobs_scheduler.h"
 #include "jobs_thread.h"
+#include "jobs_topology.h"
 #include "jobs_utils.h"
 
 #endif /* __JOBS_H__ */
\ No newline at end of file
@@ -0,0 +1,878 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+/**
+ *  \file jobs_algorithms.h
+ *
+ *  Include header for parallel algorithms built on top of the scheduler.
+ */
+
+#ifndef __JOBS_ALGORITHMS_H__
+#define __JOBS_ALGORITHMS_H__
+
+#include "jobs_defines.h"
+#include "jobs_enums.h"
+#include "jobs_job.h"
+#include "jobs_scheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <numeric>
+
+namespace jobs {
+
+/**
+ *  \brief Controls how the parallel algorithms split their work into jobs.
+ */
+struct parallel_options
+{
+    /** Number of elements processed each time a worker claims work, or 0 to choose one based on the number of workers. */
+    size_t grain = 0;
+
+    /** Stack size of the jobs the work is executed in. */
+    size_t stack_size = 0;
+
+    /** Priority of the jobs the work is executed in. */
+    priority job_priority = priority::normal;
+
+    /** Tag given to the jobs the work is executed in. */
+    const char* tag = "parallel";
+};
+
+namespace internal {
+
+/** Size of a cache line, used to pad values written by different workers. */
+const size_t cache_line_size = 64;
+
+/** Size of the narrowest vector registers on the supported platforms (SSE and NEON), used when a loop's vector width isn't known. */
+const size_t vector_register_size = 16;
+
+/** Number of chunks each worker is given on average when no grain is provided, higher values balance load better at the cost of overhead. */
+const size_t parallel_chunks_per_worker = 4;
+
+/** Size in bytes of the runs sorted by parallel_sort when no grain is provided, small enough that a run and the run it is merged with stay in cache. */
+const size_t parallel_sort_run_bytes = 128 * 1024;
+
+/** Minimum number of elements in runs sorted by parallel_sort when no grain is provided. Arrays smaller than this are sorted serially. */
+const size_t parallel_sort_min_run = 1024;
+
+/**
+ * Holds a value padded out to a cache line so values written by different workers
+ * don't share cache lines.
+ */
+template <typename value_type>
+struct alignas(cache_line_size) padded_value
+{
+    /** Value being held. */
+    value_type value;
+};
+
+/**
+ * \brief Holds an array of cache line padded values allocated from a schedulers memory functions.
+ *
+ * Values are constructed as copies of an initial value and destroyed when the array goes out of scope.
+ */
+template <typename value_type>
+class padded_array
+{
+public:
+
+    /**
+     * \brief Constructor
+     *
+     * \param scheduler Scheduler whose memory functions are used to allocate the array.
+     * \param count Number of values in the array.
+     * \param initial_value Value each element is initialized to.
+     */
+    padded_array(scheduler& scheduler, size_t count, const value_type& initial_value)
+        : m_scheduler(scheduler)
+        , m_count(0)
+    {
+        m_values = static_cast<padded_value<value_type>*>(scheduler.alloc_memory(sizeof(padded_value<value_type>) * count, alignof(padded_value<value_type>)));
+        if (m_values != nullptr)
+        {
+            for (; m_count < count; m_count++)
+            {
+                new(&m_values[m_count]) padded_value<value_type>{ initial_value };
+            }
+        }
+    }
+
+    /** Destructor */
+    ~padded_array()
+    {
+        for (size_t i = 0; i < m_count; i++)
+        {
+            m_values[i].~padded_value<value_type>();
+        }
+
+        m_scheduler.free_memory(m_values);
+    }
+
+    padded_array(const padded_array& other) = delete;
+    padded_array& operator=(const padded_array& other) = delete;
+
+    /**
+     * \brief Determines if the array was allocated successfully.
+     *
+     * \return True if the array is valid.
+     */
+    bool is_valid() const
+    {
+        return m_values != nullptr;
+    }
+
+    /**
+     * \brief Gets a value in the array.
+     *
+     * \param index Index of value.
+     *
+     * \return Reference to value.
+     */
+    value_type& operator[](size_t index)
+    {
+        return m_values[index].value;
+    }
+
+private:
+
+    /** Scheduler the array was allocated from. */
+    scheduler& m_scheduler;
+
+    /** Padded values. */
+    padded_value<value_type>* m_values;
+
+    /** Number of values that have been constructed. */
+    size_t m_count;
+
+};
+
+/**
+ * \brief Holds a temporary array of values allocated from a schedulers memory functions.
+ *
+ * Values are default constructed, so arrays of trivial types are left uninitialized.
+ */
+template <typename value_type>
+class scratch_array
+{
+public:
+
+    /**
+     * \brief Constructor
+     *
+     * \param scheduler Scheduler whose memory functions are used to allocate the array.
+     * \param count Number of values in the array.
+     */
+    scratch_array(scheduler& scheduler, size_t count)
+        : m_scheduler(scheduler)
+        , m_count(count)
+    {
+        m_values = static_cast<value_type*>(scheduler.alloc_memory(sizeof(value_type) * count, alignof(value_type)));
+        if (m_values != nullptr)
+        {
+            std::uninitialized_default_construct_n(m_values, m_count);
+        }
+    }
+
+    /** Destructor */
+    ~scratch_array()
+    {
+        if (m_values != nullptr)
+        {
+            std::destroy_n(m_values, m_count);
+        }
+
+        m_scheduler.free_memory(m_values);
+    }
+
+    scratch_array(const scratch_array& other) = delete;
+    scratch_array& operator=(const scratch_array& other) = delete;
+
+    /**
+     * \brief Determines if the array was allocated successfully.
+     *
+     * \return True if the array is valid.
+     */
+    bool is_valid() const
+    {
+        return m_values != nullptr;
+    }
+
+    /**
+     * \brief Gets a pointer to the first value in the array.
+     *
+     * \return Pointer to values.
+     */
+    value_type* data()
+    {
+        return m_values;
+    }
+
+private:
+
+    /** Scheduler the array was allocated from. */
+    scheduler& m_scheduler;
+
+    /** Values in the array. */
+    value_type* m_values;
+
+    /** Number of values in the array. */
+    size_t m_count;
+
+};
+
+/**
+ * \brief Gets the number of threads that can work on a parallel algorithm.
+ *
+ * \param scheduler Scheduler the algorithm is running on.
+ *
+ * \return Number of active workers, plus the calling thread which also takes part.
+ */
+inline size_t get_parallel_slot_count(scheduler& scheduler)
+{
+    return scheduler.get_active_worker_count() + 1;
+}
+
+/**
+ * \brief Gets the number of elements each chunk of a parallel algorithm should process.
+ *
+ * \param count Number of elements being processed.
+ * \param slot_count Number of threads that will work on the elements.
+ * \param grain User requested grain, or 0 if one should be chosen.
+ *
+ * \return Number of elements in each chunk.
+ */
+inline size_t get_parallel_grain(size_t count, size_t slot_count, size_t grain)
+{
+    if (grain > 0)
+    {
+        return grain;
+    }
+
+    size_t target_chunks = slot_count * parallel_chunks_per_worker;
+    return JOBS_MAX((count + target_chunks - 1) / target_chunks, (size_t)1);
+}
+
+/**
+ * \brief Executes a function for each chunk of work in parallel.
+ *
+ * Chunks are claimed dynamically from a shared cursor by a single job dispatched with one
+ * instance per slot. The calling thread claims chunks as well before waiting for the job,
+ * so it assists when called from outside the scheduler and the wait is cooperative when
+ * called from inside a job. If a job cannot be created all chunks are executed on the calling thread.
+ *
+ * \param scheduler Scheduler to execute the chunks on.
+ * \param chunk_count Number of chunks to execute.
+ * \param slot_count Maximum number of threads to execute chunks on, each is given a unique slot index in [0, slot_count).
+ * \param options Options describing the jobs to execute chunks in.
+ * \param function Function called as function(chunk_index, slot_index) for each chunk.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename chunk_function>
+result parallel_chunks(scheduler& scheduler, size_t chunk_count, size_t slot_count, const parallel_options& options, const chunk_function& function)
+{
+    std::atomic<size_t> cursor{ 0 };
+
+    auto run_chunks = [&cursor, &function, chunk_count](size_t slot_index) {
+        while (true)
+        {
+            size_t chunk_index = cursor.fetch_add(1);
+            if (chunk_index >= chunk_count)
+            {
+                break;
+            }
+
+            function(chunk_index, slot_index);
+        }
+    };
+
+    // The calling thread takes slot 0, so only the remaining slots need a job instance.
+    size_t instance_count = JOBS_MIN(slot_count, chunk_count);
+    instance_count = (instance_count > 0) ? instance_count - 1 : 0;
+
+    bool dispatched = false;
+
+    job_handle job;
+    if (instance_count > 0 && scheduler.create_job(job) == result::success)
+    {
+        job.set_tag(options.tag);
+        job.set_stack_size(options.stack_size);
+        job.set_priority(options.job_priority);
+        job.set_work([&run_chunks]() {
+            size_t instance_index = 0;
+            scheduler::get_instance_index(instance_index);
+
+            run_chunks(instance_index + 1);
+        });
+
+        dispatched = (job.dispatch_instances(instance_count) == result::success);
+    }
+
+    run_chunks(0);
+
+    // The job references our stack, so we have to wait for it even if our share of the work is done.
+    if (dispatched)
+    {
+        return job.wait();
+    }
+
+    return result::success;
+}
+
+/**
+ * \brief Finds how many elements of the first array are in the first elements of a stable merge of two sorted arrays.
+ *
+ * \param first First sorted array, its elements are ordered before equal elements of the second.
+ * \param first_count Number of elements in the first array.
+ * \param second Second sorted array.
+ * \param second_count Number of elements in the second array.
+ * \param output_index Number of elements at the start of the merged output.
+ * \param compare Function returning true if its first argument is ordered before its second.
+ *
+ * \return Number of elements from the first array, the remainder come from the second.
+ */
+template <typename value_type, typename compare_function>
+size_t get_merge_split(const value_type* first, size_t first_count, const value_type* second, size_t second_count, size_t output_index, const compare_function& compare)
+{
+    size_t low = (output_index > second_count) ? output_index - second_count : 0;
+    size_t high = JOBS_MIN(output_index, first_count);
+
+    while (low < high)
+    {
+        size_t first_index = low + (high - low) / 2;
+        size_t second_index = output_index - first_index - 1;
+
+        if (compare(second[second_index], first[first_index]))
+        {
+            high = first_index;
+        }
+        else
+        {
+            low = first_index + 1;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * \brief Merges a range of the output of a stable merge of two sorted arrays.
+ *
+ * Any range of the output can be merged independently of the others, which is what lets
+ * a single merge be split between workers.
+ *
+ * \param first First sorted array.
+ * \param first_count Number of elements in the first array.
+ * \param second Second sorted array.
+ * \param second_count Number of elements in the second array.
+ * \param output Array the full merged output is stored in.
+ * \param output_begin Index of first output element to merge.
+ * \param output_end Index one past the last output element to merge.
+ * \param compare Function returning true if its first argument is ordered before its second.
+ */
+template <typename value_type, typename compare_function>
+void merge_range(const value_type* first, size_t first_count, const value_type* second, size_t second_count, value_type* output, size_t output_begin, size_t output_end, const compare_function& compare)
+{
+    size_t first_begin = get_merge_split(first, first_count, second, second_count, output_begin, compare);
+    size_t first_end = get_merge_split(first, first_count, second, second_count, output_end, compare);
+
+    std::merge(
+        first + first_begin, first + first_end,
+        second + (output_begin - first_begin), second + (output_end - first_end),
+        output + output_begin,
+        compare
+    );
+}
+
+/**
+ * \brief Determines if an element of an array starts on a cache line boundary.
+ *
+ * \param span Array containing the element.
+ * \param index Index of element.
+ *
+ * \return True if the element is cache line aligned.
+ */
+template <typename value_type>
+bool is_cache_line_aligned(const value_type* span, size_t index)
+{
+    return (reinterpret_cast<uintptr_t>(span + index) % cache_line_size) == 0;
+}
+
+/**
+ * \brief Gets the number of elements in each aligned block of a set of parallel arrays.
+ *
+ * A block is a whole number of vectors long, and if the first element of a block is cache line 
+ * aligned in every array then so is the first element of the following block.
+ *
+ * \param vector_width Number of elements processed by each iteration of a vectorized loop.
+ *
+ * \return Number of elements in each block.
+ */
+template <typename... value_types>
+size_t get_aligned_block_size(size_t vector_width)
+{
+    // The fewest elements of each array that span a whole number of cache lines, elements whose size doesn't 
+    // divide the line need several lines (a 12 byte element needs 16 of them, 3 lines). A block has to be a 
+    // multiple of that count for every array at once.
+    size_t line_elements = 1;
+    ((line_elements = std::lcm(line_elements, cache_line_size / std::gcd(cache_line_size, sizeof(value_types)))), ...);
+
+    return std::lcm(JOBS_MAX(vector_width, (size_t)1), line_elements);
+}
+
+/**
+ * \brief Gets the number of leading elements before every one of a set of parallel arrays is cache line aligned.
+ *
+ * \param block_size Number of elements in each aligned block, as returned by \ref get_aligned_block_size.
+ * \param head_count Reference to store the number of leading elements in.
+ * \param spans Arrays being processed.
+ *
+ * \return True if the arrays are all aligned at the same index, false if they never can be.
+ */
+template <typename... value_types>
+bool get_aligned_head_count(size_t block_size, size_t& head_count, const value_types*... spans)
+{
+    for (size_t i = 0; i < block_size; i++)
+    {
+        if ((is_cache_line_aligned(spans, i) && ...))
+        {
+            head_count = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}; /* namespace internal */
+
+/**
+ * \brief Reduces a range of indices to a single value in parallel.
+ *
+ * Each index in [begin, end) is mapped to a value, and all values are combined together. Each
+ * thread taking part accumulates into its own cache line padded partial value, the partial
+ * values are then combined on the calling thread.
+ *
+ * Can be called from inside a job, in which case waiting for other workers is cooperative, or
+ * from outside the scheduler, in which case the calling thread assists until all work is claimed.
+ *
+ * As values are accumulated in an unspecified order, combine must be associative and commutative.
+ *
+ * \param scheduler Scheduler to execute the reduction on.
+ * \param begin First index in the range.
+ * \param end Index one past the last index in the range.
+ * \param identity Value that leaves any value unchanged when combined with it.
+ * \param map Function called as map(index) to get the value of an index.
+ * \param combine Function called as combine(a, b) to combine two values.
+ * \param output Reference to store the reduced value in.
+ * \param options Options describing how the work is split into jobs.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename value_type, typename map_function, typename combine_function>
+result parallel_reduce(scheduler& scheduler, size_t begin, size_t end, const value_type& identity, const map_function& map, const combine_function& combine, value_type& output, const parallel_options& options = parallel_options())
+{
+    size_t count = (end > begin) ? end - begin : 0;
+    size_t slot_count = internal::get_parallel_slot_count(scheduler);
+    size_t grain = internal::get_parallel_grain(count, slot_count, options.grain);
+    size_t chunk_count = (count + grain - 1) / grain;
+
+    internal::padded_array<value_type> partials(scheduler, slot_count, identity);
+    if (!partials.is_valid())
+    {
+        return result::out_of_memory;
+    }
+
+    result res = internal::parallel_chunks(scheduler, chunk_count, slot_count, options, [&](size_t chunk_index, size_t slot_index) {
+        size_t chunk_begin = begin + chunk_index * grain;
+        size_t chunk_end = JOBS_MIN(chunk_begin + grain, end);
+
+        // Accumulate locally so the partial's cache line is only touched once per chunk.
+        value_type accumulator = partials[slot_index];
+        for (size_t i = chunk_begin; i < chunk_end; i++)
+        {
+            accumulator = combine(accumulator, map(i));
+        }
+
+        partials[slot_index] = accumulator;
+    });
+
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    value_type reduced = identity;
+    for (size_t i = 0; i < slot_count; i++)
+    {
+        reduced = combine(reduced, partials[i]);
+    }
+
+    output = reduced;
+    return result::success;
+}
+
+/**
+ * \brief Calculates an inclusive prefix scan of an array in parallel.
+ *
+ * Each output element is the combination of every input element up to and including it. A
+ * work-efficient two pass algorithm is used: the first pass calculates the total of each chunk,
+ * which are scanned serially to find each chunks offset, and the second pass scans each chunk
+ * starting from its offset.
+ *
+ * Can be called from inside a job, in which case waiting for other workers is cooperative, or
+ * from outside the scheduler, in which case the calling thread assists until all work is claimed.
+ *
+ * Chunks are combined in order, so combine only needs to be associative.
+ *
+ * \param scheduler Scheduler to execute the scan on.
+ * \param input Array of values to scan.
+ * \param output Array to store scanned values in, may be the same as input.
+ * \param count Number of values in the arrays.
+ * \param identity Value that leaves any value unchanged when combined with it.
+ * \param combine Function called as combine(a, b) to combine two values.
+ * \param options Options describing how the work is split into jobs.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename value_type, typename combine_function>
+result parallel_scan(scheduler& scheduler, const value_type* input, value_type* output, size_t count, const value_type& identity, const combine_function& combine, const parallel_options& options = parallel_options())
+{
+    size_t slot_count = internal::get_parallel_slot_count(scheduler);
+    size_t grain = internal::get_parallel_grain(count, slot_count, options.grain);
+    size_t chunk_count = (count + grain - 1) / grain;
+
+    if (chunk_count == 0)
+    {
+        return result::success;
+    }
+
+    internal::padded_array<value_type> offsets(scheduler, chunk_count, identity);
+    if (!offsets.is_valid())
+    {
+        return result::out_of_memory;
+    }
+
+    // First pass, total each chunk. The last chunk's total is never needed.
+    result res = internal::parallel_chunks(scheduler, chunk_count - 1, slot_count, options, [&](size_t chunk_index, size_t) {
+        size_t chunk_begin = chunk_index * grain;
+        size_t chunk_end = JOBS_MIN(chunk_begin + grain, count);
+
+        value_type accumulator = input[chunk_begin];
+        for (size_t i = chunk_begin + 1; i < chunk_end; i++)
+        {
+            accumulator = combine(accumulator, input[i]);
+        }
+
+        offsets[chunk_index] = accumulator;
+    });
+
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    // Turn the chunk totals into an exclusive scan, giving the offset each chunk starts from.
+    value_type running = identity;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        value_type total = offsets[i];
+        offsets[i] = running;
+        running = combine(running, total);
+    }
+
+    // Second pass, scan each chunk from its offset.
+    return internal::parallel_chunks(scheduler, chunk_count, slot_count, options, [&](size_t chunk_index, size_t) {
+        size_t chunk_begin = chunk_index * grain;
+        size_t chunk_end = JOBS_MIN(chunk_begin + grain, count);
+
+        value_type accumulator = offsets[chunk_index];
+        for (size_t i = chunk_begin; i < chunk_end; i++)
+        {
+            accumulator = combine(accumulator, input[i]);
+            output[i] = accumulator;
+        }
+    });
+}
+
+/**
+ * \brief Merges two sorted arrays into a single sorted array in parallel.
+ *
+ * The output is split into chunks which are merged independently, the start of each chunk in
+ * the input arrays being found with a binary search. The merge is stable, elements of the first
+ * array are ordered before equal elements of the second.
+ *
+ * \param scheduler Scheduler to execute the merge on.
+ * \param first First sorted array.
+ * \param first_count Number of elements in the first array.
+ * \param second Second sorted array.
+ * \param second_count Number of elements in the second array.
+ * \param output Array to store merged elements in, must hold first_count + second_count elements and not overlap either input.
+ * \param compare Function returning true if its first argument is ordered before its second.
+ * \param options Options describing how the work is split into jobs.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename value_type, typename compare_function = std::less<value_type>>
+result parallel_merge(scheduler& scheduler, const value_type* first, size_t first_count, const value_type* second, size_t second_count, value_type* output, const compare_function& compare = compare_function(), const parallel_options& options = parallel_options())
+{
+    size_t count = first_count + second_count;
+    size_t slot_count = internal::get_parallel_slot_count(scheduler);
+    size_t grain = internal::get_parallel_grain(count, slot_count, options.grain);
+    size_t chunk_count = (count + grain - 1) / grain;
+
+    return internal::parallel_chunks(scheduler, chunk_count, slot_count, options, [&](size_t chunk_index, size_t) {
+        size_t chunk_begin = chunk_index * grain;
+        size_t chunk_end = JOBS_MIN(chunk_begin + grain, count);
+
+        internal::merge_range(first, first_count, second, second_count, output, chunk_begin, chunk_end, compare);
+    });
+}
+
+/**
+ * \brief Sorts an array in parallel.
+ *
+ * The array is split into runs that are sorted with std::sort in parallel, then merged together
+ * in passes, each merge being split between workers so all of them are kept busy as runs get longer.
+ * Runs are kept small enough to stay in cache, the grain in the options overrides the run size.
+ * Arrays no larger than a single run are sorted with std::sort on the calling thread.
+ *
+ * A temporary buffer the size of the array is allocated from the schedulers memory functions
+ * for the duration of the sort. The sort is not stable.
+ *
+ * \param scheduler Scheduler to execute the sort on.
+ * \param data Array to sort.
+ * \param count Number of elements in the array.
+ * \param compare Function returning true if its first argument is ordered before its second.
+ * \param options Options describing how the work is split into jobs.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename value_type, typename compare_function = std::less<value_type>>
+result parallel_sort(scheduler& scheduler, value_type* data, size_t count, const compare_function& compare = compare_function(), const parallel_options& options = parallel_options())
+{
+    size_t slot_count = internal::get_parallel_slot_count(scheduler);
+
+    // Runs should fit in cache, but there need to be enough of them to keep every worker busy.
+    size_t run_size = options.grain;
+    if (run_size == 0)
+    {
+        size_t cache_run_size = JOBS_MAX(internal::parallel_sort_run_bytes / sizeof(value_type), (size_t)1);
+        size_t balanced_run_size = (count + slot_count - 1) / slot_count;
+        run_size = JOBS_MAX(JOBS_MIN(cache_run_size, balanced_run_size), internal::parallel_sort_min_run);
+    }
+
+    if (count <= run_size)
+    {
+        std::sort(data, data + count, compare);
+        return result::success;
+    }
+
+    internal::scratch_array<value_type> scratch(scheduler, count);
+    if (!scratch.is_valid())
+    {
+        return result::out_of_memory;
+    }
+
+    size_t run_count = (count + run_size - 1) / run_size;
+
+    result res = internal::parallel_chunks(scheduler, run_count, slot_count, options, [&](size_t run_index, size_t) {
+        size_t run_begin = run_index * run_size;
+        size_t run_end = JOBS_MIN(run_begin + run_size, count);
+
+        std::sort(data + run_begin, data + run_end, compare);
+    });
+
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    // Merge pairs of runs, ping-ponging between the array and the scratch buffer.
+    value_type* source = data;
+    value_type* destination = scratch.data();
+
+    for (size_t width = run_size; width < count; width *= 2)
+    {
+        size_t pair_size = width * 2;
+        size_t pair_count = (count + pair_size - 1) / pair_size;
+        size_t chunks_per_pair = (pair_size + run_size - 1) / run_size;
+
+        res = internal::parallel_chunks(scheduler, pair_count * chunks_per_pair, slot_count, options, [&](size_t chunk_index, size_t) {
+            size_t pair_begin = (chunk_index / chunks_per_pair) * pair_size;
+            size_t pair_end = JOBS_MIN(pair_begin + pair_size, count);
+            size_t middle = JOBS_MIN(pair_begin + width, pair_end);
+
+            // The last pair can be shorter than the rest, so some of its chunks may be empty.
+            size_t chunk_begin = (chunk_index % chunks_per_pair) * run_size;
+            size_t chunk_end = JOBS_MIN(chunk_begin + run_size, pair_end - pair_begin);
+            if (chunk_begin >= chunk_end)
+            {
+                return;
+            }
+
+            internal::merge_range(
+                source + pair_begin, middle - pair_begin, 
+                source + middle, pair_end - middle, 
+                destination + pair_begin, chunk_begin, chunk_end, 
+                compare
+            );
+        });
+
+        if (res != result::success)
+        {
+            return res;
+        }
+
+        std::swap(source, destination);
+    }
+
+    // If we finished on the scratch buffer the result needs moving back into the array.
+    if (source != data)
+    {
+        size_t chunk_count = (count + run_size - 1) / run_size;
+
+        res = internal::parallel_chunks(scheduler, chunk_count, slot_count, options, [&](size_t chunk_index, size_t) {
+            size_t chunk_begin = chunk_index * run_size;
+            size_t chunk_end = JOBS_MIN(chunk_begin + run_size, count);
+
+            std::move(source + chunk_begin, source + chunk_end, data + chunk_begin);
+        });
+    }
+
+    return res;
+}
+
+/**
+ * \brief Processes a set of parallel arrays, such as the fields of a structure-of-arrays, in aligned chunks.
+ *
+ * The arrays are split so that vectorized loops can run at full speed on every worker. Each chunk
+ * passed to chunk_function is a whole number of vectors long and starts at an index where every array
+ * is cache line aligned, so no two workers write to the same cache line. The leading elements before
+ * the arrays are aligned and the trailing elements that don't fill a vector are passed to remainder_function,
+ * once for each, on the calling thread.
+ *
+ * If the arrays can never all be aligned at the same index only the first array is aligned, and if the first
+ * array itself is misaligned for its element type chunks are only guaranteed to be a whole number of vectors long.
+ *
+ * \param scheduler Scheduler to execute the chunks on.
+ * \param count Number of elements in each array.
+ * \param vector_width Number of elements processed by each iteration of the vectorized loop in chunk_function.
+ * \param chunk_function Function called as chunk_function(begin, end) for each aligned chunk.
+ * \param remainder_function Function called as remainder_function(begin, end) for the unaligned leading and trailing elements.
+ * \param options Options describing how the work is split into jobs, the grain is rounded up to a whole number of blocks.
+ * \param first_span First array being processed.
+ * \param spans Remaining arrays being processed.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename chunk_function_type, typename remainder_function_type, typename first_value_type, typename... value_types>
+result parallel_for_each_chunk(scheduler& scheduler, size_t count, size_t vector_width, const chunk_function_type& chunk_function, const remainder_function_type& remainder_function, const parallel_options& options, const first_value_type* first_span, const value_types*... spans)
+{
+    vector_width = JOBS_MAX(vector_width, (size_t)1);
+
+    size_t block_size = internal::get_aligned_block_size<first_value_type, value_types...>(vector_width);
+
+    // Arrays that can't all be aligned together are aligned on the first array alone, and if 
+    // even that is misaligned we settle for chunks that are a whole number of vectors long.
+    size_t head_count = 0;
+    if (!internal::get_aligned_head_count(block_size, head_count, first_span, spans...) &&
+        !internal::get_aligned_head_count(block_size, head_count, first_span))
+    {
+        head_count = 0;
+    }
+
+    head_count = JOBS_MIN(head_count, count);
+
+    size_t body_count = ((count - head_count) / vector_width) * vector_width;
+    size_t body_end = head_count + body_count;
+
+    size_t slot_count = internal::get_parallel_slot_count(scheduler);
+    size_t grain = internal::get_parallel_grain(body_count, slot_count, options.grain);
+    size_t chunk_size = ((grain + block_size - 1) / block_size) * block_size;
+    size_t chunk_count = (body_count + chunk_size - 1) / chunk_size;
+
+    result res = internal::parallel_chunks(scheduler, chunk_count, slot_count, options, [&](size_t chunk_index, size_t) {
+        size_t chunk_begin = head_count + chunk_index * chunk_size;
+        size_t chunk_end = JOBS_MIN(chunk_begin + chunk_size, body_end);
+
+        chunk_function(chunk_begin, chunk_end);
+    });
+
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    if (head_count > 0)
+    {
+        remainder_function((size_t)0, head_count);
+    }
+    if (body_end < count)
+    {
+        remainder_function(body_end, count);
+    }
+
+    return result::success;
+}
+
+/**
+ * \brief Transforms each element of an array into an element of another array in parallel.
+ *
+ * Work is split with \ref parallel_for_each_chunk, so each worker transforms whole cache lines of 
+ * the output and the compiler is free to vectorize the loop over each chunk.
+ *
+ * \param scheduler Scheduler to execute the transform on.
+ * \param input Array of elements to transform.
+ * \param output Array to store transformed elements in, may be the same as input.
+ * \param count Number of elements in the arrays.
+ * \param transform Function called as transform(element) to get the transformed value of an element.
+ * \param options Options describing how the work is split into jobs.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename input_type, typename output_type, typename transform_function>
+result parallel_transform(scheduler& scheduler, const input_type* input, output_type* output, size_t count, const transform_function& transform, const parallel_options& options = parallel_options())
+{
+    auto transform_range = [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+        {
+            output[i] = transform(input[i]);
+        }
+    };
+
+    // The compiler picks the real width when it vectorizes the loop, so assume the narrowest registers. Chunks are
+    // still whole cache lines, \ref parallel_for_each_chunk rounds them up to aligned blocks.
+    size_t vector_width = JOBS_MAX(internal::vector_register_size / JOBS_MIN(sizeof(input_type), sizeof(output_type)), (size_t)1);
+
+    // Output is listed first so it takes priority when both arrays can't be aligned together, as it's what workers contend on.
+    return parallel_for_each_chunk(scheduler, count, vector_width, transform_range, transform_range, options, (const output_type*)output, input);
+}
+
+}; /* namespace jobs */
+
+#endif /* __JOBS_ALGORITHMS_H__ */
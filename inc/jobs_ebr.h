@@ -0,0 +1,148 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+/**
+ *  \file jobs_ebr.h
+ *
+ *  Include header for epoch based reclamation of objects shared between jobs.
+ */
+
+#ifndef __JOBS_EBR_H__
+#define __JOBS_EBR_H__
+
+#include "jobs_defines.h"
+#include "jobs_enums.h"
+
+#include <atomic>
+
+namespace jobs {
+
+class scheduler;
+
+namespace ebr {
+
+/**
+ *  \brief Function called to free an object once no job can still be reading it.
+ */
+typedef void (*reclaim_function)(void* object);
+
+/**
+ * \brief Frees an object once every job that could be reading it has finished.
+ *
+ * Objects removed from a shared structure are retired rather than freed. Jobs can then read
+ * such structures without any locks, hazard pointers or reference counts. Each worker passes
+ * through a quiescent state every time it returns to its loop between jobs. Once every worker
+ * has done so twice since the object was retired, no job still running can hold a pointer to
+ * it, and it is reclaimed by one of the workers.
+ *
+ * Because quiescent states are only passed between jobs, a job must not hold a pointer to a
+ * retired object across anything that can suspend it. That includes waits, sleeps, yields,
+ * and child-first dispatches. Workers that have nothing to do don't hold up reclamation, but
+ * a long running job does. Only jobs are protected readers, threads outside the scheduler must
+ * synchronize with writers in some other way.
+ *
+ * Retired objects are tracked in a pool sized by \ref scheduler::set_max_retired_objects. Objects
+ * retired from inside a job go in the retire list of the worker running it, others go in a shared list.
+ * A worker's list is moved to the shared list when it goes idle, so it is still reclaimed by the workers
+ * that are running. Anything still retired when the scheduler is destroyed is reclaimed then.
+ *
+ * \param scheduler Scheduler whose jobs may be reading the object.
+ * \param object Object to reclaim. This must already be unreachable for new readers.
+ * \param reclaim Function called with the object to free it.
+ *
+ * \return Value indicating the success of this function.
+ */
+result retire(scheduler& scheduler, void* object, reclaim_function reclaim);
+
+/**
+ * \brief Deletes an object once every job that could be reading it has finished.
+ *
+ * See \ref retire. The object is freed with delete.
+ *
+ * \param scheduler Scheduler whose jobs may be reading the object.
+ * \param object Object to delete.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename object_type>
+result retire(scheduler& scheduler, object_type* object)
+{
+    return retire(scheduler, static_cast<void*>(object), [](void* ptr) {
+        delete static_cast<object_type*>(ptr);
+    });
+}
+
+}; /* namespace ebr */
+
+namespace internal {
+
+/**
+ * An object waiting to be reclaimed once it can no longer be read. This is used
+ * for internal storage, and shouldn't ever need to be touched by outside code.
+ */
+class retired_object
+{
+public:
+
+    /**
+     * \brief Constructor
+     *
+     * \param in_pool_index Index into the scheduler's pool where this is held.
+     */
+    retired_object(size_t in_pool_index)
+        : pool_index(in_pool_index)
+    {
+    }
+
+    /** Index into the scheduler's pool where this is held. */
+    size_t pool_index;
+
+    /** Object to reclaim. */
+    void* object = nullptr;
+
+    /** Function used to reclaim the object. */
+    ebr::reclaim_function reclaim = nullptr;
+
+    /** Global epoch when the object was retired. */
+    uint64_t epoch = 0;
+
+    /** Next object in the retire list, retired in the same or a later epoch. */
+    retired_object* next = nullptr;
+
+};
+
+/**
+ * A list of retired objects, in the order they were retired.
+ */
+struct retire_list
+{
+    /** First object retired. */
+    retired_object* head = nullptr;
+
+    /** Last object retired. */
+    retired_object* tail = nullptr;
+};
+
+}; /* namespace internal */
+}; /* namespace jobs */
+
+#endif /* __JOBS_EBR_H__ */
@@ -30,6 +30,7 @@
 
 #include "jobs_defines.h"
 #include <stdint.h>
+#include <stddef.h>
 #include <chrono>
 
 namespace jobs {
@@ -62,6 +63,7 @@ enum class result
     not_in_job,             /**< Attempt to execution a function that can only be run under a jobs context. */
     already_complete,       /**< Attempt was made to stop or cancel an operation which has already completed. */
     empty,                  /**< Operation failed as container was empty. */
+    invalid_thread,         /**< Operation cannot be performed on the calling thread. */
 };
 
 /**
@@ -71,19 +73,106 @@ enum class result
  *  attempt to execute higher priorities first.
  *
  *  Should be ordered most to least priority.
+ *
+ *  Each bit represents one priority level, with bit 0 being the highest. The named priorities
+ *  occupy the first levels, schedulers configured with more levels than this (see 
+ *  \ref scheduler::set_priority_level_count) can address the remaining ones with \ref priority_level.
  */
-enum class priority
+enum class priority : uint64_t
 {
-    critical     = 1 << 0,          /**< Critical priority jobs */
-    high         = 1 << 1,          /**< High priority jobs */
-    normal       = 1 << 2,          /**< Medium priority jobs */
-    low          = 1 << 3,          /**< Low priority jobs */
-    slow         = 1 << 4,          /**< Very slow and long running jobs should be assigned this priority, it allows easy segregation to prevent saturating thread pools. */
+    critical     = 1 << 0,              /**< Critical priority jobs */
+    high         = 1 << 1,              /**< High priority jobs */
+    normal       = 1 << 2,              /**< Medium priority jobs */
+    low          = 1 << 3,              /**< Low priority jobs */
+    slow         = 1 << 4,              /**< Very slow and long running jobs should be assigned this priority, it allows easy segregation to prevent saturating thread pools. */
     
-    count        = 5,        
+    count        = 5,                   /**< Number of named priorities, and the default number of priority levels. */
+
+    all          = UINT64_MAX,          /**< All priorities together. */  
+    all_but_slow = UINT64_MAX & ~slow,  /**< All priorities together except slow. */  
+};
+
+/** Maximum number of priority levels a scheduler can be configured with. */
+const size_t max_priority_levels = 64;
+
+/**
+ * \brief Gets the priority of a single priority level.
+ *
+ * \param level Index of level, 0 being the highest priority.
+ *
+ * \return Priority bitmask containing only the given level.
+ */
+inline priority priority_level(size_t level)
+{
+    return (priority)((uint64_t)1 << level);
+}
+
+/**
+ * \brief Gets a priority bitmask covering a range of priority levels.
+ *
+ * \param first_level Index of first level in range.
+ * \param last_level Index of last level in range, inclusive.
+ *
+ * \return Priority bitmask containing all levels in the range.
+ */
+inline priority priority_levels(size_t first_level, size_t last_level)
+{
+    uint64_t upto_last = (last_level >= max_priority_levels - 1) ? UINT64_MAX : (((uint64_t)1 << (last_level + 1)) - 1);
+    uint64_t below_first = ((uint64_t)1 << first_level) - 1;
+    return (priority)(upto_last & ~below_first);
+}
+
+/**
+ * \brief Combines two priority bitmasks.
+ *
+ * \param lhs First bitmask.
+ * \param rhs Second bitmask.
+ *
+ * \return Bitmask containing the priorities in both lhs and rhs.
+ */
+inline priority operator|(priority lhs, priority rhs)
+{
+    return (priority)((uint64_t)lhs | (uint64_t)rhs);
+}
+
+/**
+ *  \brief Determines how workers choose which priority queue to take their next job from.
+ */
+enum class scheduling_policy
+{
+    strict_priority,    /**< The highest priority queue with jobs in it is always taken from first. Lower priorities can be starved indefinitely. */
+    weighted_fair,      /**< Priorities are serviced round-robin, each taking a number of jobs proportional to its weight per round. */
+    aging,              /**< As strict_priority, except any priority that has not been serviced for longer than the aging threshold is taken from first. */
+};
+
+/**
+ *  \brief Determines how jobs with a deadline are ordered relative to other jobs.
+ */
+enum class deadline_policy
+{
+    ignored,            /**< Deadlines are only used to record misses, jobs are queued by priority like any other. */
+    within_priority,    /**< Jobs with deadlines are executed earliest-deadline-first, but never ahead of jobs of a higher priority. */
+    across_priorities,  /**< Jobs with deadlines are executed earliest-deadline-first, ahead of all jobs without a deadline regardless of priority. */
+};
+
+/**
+ *  \brief Determines what happens to a job that dispatches another job, see \ref job_handle::dispatch.
+ */
+enum class spawn_mode
+{
+    help_first,         /**< The dispatched job is queued and the dispatching job carries on running. */
+    child_first,        /**< The worker switches straight to the dispatched job, and the dispatching job is queued to be resumed once it completes, unless another worker steals it first. */
+};
 
-    all          = 0xFFFF,          /**< All priorities together. */  
-    all_but_slow = 0xFFFF & ~slow,  /**< All priorities together except slow. */  
+/**
+ *  \brief Determines how the workers of a thread pool are placed onto the logical processors of the system.
+ */
+enum class thread_placement
+{
+    logical_cores,      /**< Workers are placed on logical processors in index order. */
+    physical_cores,     /**< One worker per physical core, SMT siblings are never used. */
+    smt_siblings_last,  /**< Workers are spread over all physical cores before any SMT siblings are used. */
+    group_by_cache,     /**< Workers are packed onto processors sharing a last-level cache (L3 / CCX) before moving onto the next one. */
 };
 
 /**
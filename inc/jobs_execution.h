@@ -0,0 +1,1062 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+/**
+ *  \file jobs_execution.h
+ *
+ *  Include header for the sender/receiver (P2300 std::execution style) interface to the scheduler.
+ *
+ *  This follows the member function form of the proposal: senders provide connect(), operation states
+ *  provide start(), and receivers provide set_value(), set_error() and set_stopped(). Senders describe
+ *  the values they complete with as a std::tuple in a value_types member, and errors are always a
+ *  jobs::result. Operation states are returned by value and held inline by whoever connects them,
+ *  so no memory is allocated to compose work.
+ */
+
+#ifndef __JOBS_EXECUTION_H__
+#define __JOBS_EXECUTION_H__
+
+#include "jobs_defines.h"
+#include "jobs_enums.h"
+#include "jobs_algorithms.h"
+#include "jobs_counter.h"
+#include "jobs_job.h"
+#include "jobs_scheduler.h"
+
+#include <atomic>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace jobs {
+namespace execution {
+
+class job_scheduler;
+
+}; /* namespace execution */
+
+namespace internal {
+
+/** Gets the value_types of a sender that completes with the value returned by a function, which may be void. */
+template <typename value_type>
+struct single_value_types
+{
+    using type = std::tuple<value_type>;
+};
+
+template <>
+struct single_value_types<void>
+{
+    using type = std::tuple<>;
+};
+
+/** Gets the type returned by calling a function with the values held in a tuple. */
+template <typename function_type, typename tuple_type>
+struct apply_result;
+
+template <typename function_type, typename... value_types>
+struct apply_result<function_type, std::tuple<value_types...>>
+{
+    using type = std::invoke_result_t<function_type, value_types&...>;
+};
+
+/**
+ * Operation state that completes on a job dispatched to the scheduler when started.
+ */
+template <typename receiver_type>
+class schedule_operation
+{
+public:
+
+    /**
+     * \brief Constructor
+     *
+     * \param scheduler Scheduler to dispatch job to.
+     * \param job_priority Priority of the dispatched job.
+     * \param stack_size Stack size of the dispatched job.
+     * \param receiver Receiver to complete.
+     */
+    schedule_operation(scheduler* scheduler, priority job_priority, size_t stack_size, receiver_type receiver)
+        : m_scheduler(scheduler)
+        , m_priority(job_priority)
+        , m_stack_size(stack_size)
+        , m_receiver(std::move(receiver))
+    {
+    }
+
+    schedule_operation(const schedule_operation& other) = delete;
+    schedule_operation& operator=(const schedule_operation& other) = delete;
+
+    /** Dispatches a job that completes the receiver. */
+    void start() noexcept
+    {
+        job_handle job;
+        result res = m_scheduler->create_job(job);
+        if (res == result::success)
+        {
+            job.set_tag("schedule");
+            job.set_priority(m_priority);
+            job.set_stack_size(m_stack_size);
+
+            // Only capturing this keeps the work inside std::function's small buffer, so nothing is allocated.
+            job.set_work([this]() {
+                m_receiver.set_value();
+            });
+
+            res = job.dispatch();
+        }
+
+        if (res != result::success)
+        {
+            m_receiver.set_error(res);
+        }
+    }
+
+private:
+
+    /** Scheduler to dispatch job to. */
+    scheduler* m_scheduler;
+
+    /** Priority of the dispatched job. */
+    priority m_priority;
+
+    /** Stack size of the dispatched job. */
+    size_t m_stack_size;
+
+    /** Receiver to complete. */
+    receiver_type m_receiver;
+
+};
+
+/** Receiver connected to the sender a then operation continues from. */
+template <typename operation_type>
+class then_receiver
+{
+public:
+
+    /** Pointer to the then operation this receiver belongs to. */
+    operation_type* operation;
+
+    /** Calls the function with the values and completes the downstream receiver with its result. */
+    template <typename... value_types>
+    void set_value(value_types&&... values) noexcept
+    {
+        operation->complete(std::forward<value_types>(values)...);
+    }
+
+    /** Forwards the error to the downstream receiver. */
+    void set_error(result error) noexcept
+    {
+        operation->receiver.set_error(error);
+    }
+
+    /** Forwards the stop to the downstream receiver. */
+    void set_stopped() noexcept
+    {
+        operation->receiver.set_stopped();
+    }
+
+};
+
+/**
+ * Operation state that calls a function with the values of another sender.
+ */
+template <typename sender_type, typename function_type, typename receiver_type>
+class then_operation
+{
+public:
+
+    /**
+     * \brief Constructor
+     *
+     * \param sender Sender to continue from.
+     * \param in_function Function to call with the senders values.
+     * \param in_receiver Receiver to complete with the functions result.
+     */
+    then_operation(const sender_type& sender, const function_type& in_function, receiver_type in_receiver)
+        : function(in_function)
+        , receiver(std::move(in_receiver))
+        , child(sender.connect(then_receiver<then_operation>{ this }))
+    {
+    }
+
+    then_operation(const then_operation& other) = delete;
+    then_operation& operator=(const then_operation& other) = delete;
+
+    /** Starts the sender being continued from. */
+    void start() noexcept
+    {
+        child.start();
+    }
+
+    /** Calls the function and completes the receiver with its result. */
+    template <typename... value_types>
+    void complete(value_types&&... values)
+    {
+        if constexpr (std::is_void<std::invoke_result_t<function_type, value_types&...>>::value)
+        {
+            function(values...);
+            receiver.set_value();
+        }
+        else
+        {
+            receiver.set_value(function(values...));
+        }
+    }
+
+    /** Function to call with the senders values. */
+    function_type function;
+
+    /** Receiver to complete with the functions result. */
+    receiver_type receiver;
+
+    /** Operation state of the sender being continued from. */
+    decltype(std::declval<const sender_type&>().connect(std::declval<then_receiver<then_operation>>())) child;
+
+};
+
+/** Receiver connected to the sender a bulk operation continues from. */
+template <typename operation_type>
+class bulk_receiver
+{
+public:
+
+    /** Pointer to the bulk operation this receiver belongs to. */
+    operation_type* operation;
+
+    /** Runs the function for every index and then forwards the values to the downstream receiver. */
+    template <typename... value_types>
+    void set_value(value_types&&... values) noexcept
+    {
+        operation->complete(std::forward<value_types>(values)...);
+    }
+
+    /** Forwards the error to the downstream receiver. */
+    void set_error(result error) noexcept
+    {
+        operation->receiver.set_error(error);
+    }
+
+    /** Forwards the stop to the downstream receiver. */
+    void set_stopped() noexcept
+    {
+        operation->receiver.set_stopped();
+    }
+
+};
+
+/**
+ * Operation state that calls a function for each index in a range in parallel, once another sender has completed.
+ */
+template <typename sender_type, typename function_type, typename receiver_type>
+class bulk_operation
+{
+public:
+
+    /**
+     * \brief Constructor
+     *
+     * \param sender Sender to continue from.
+     * \param in_shape Number of indices to call the function for.
+     * \param in_function Function called as function(index, values...) for each index.
+     * \param in_receiver Receiver to complete with the senders values.
+     */
+    bulk_operation(const sender_type& sender, size_t in_shape, const function_type& in_function, receiver_type in_receiver)
+        : scheduler(&sender.get_completion_scheduler().get_scheduler())
+        , job_priority(sender.get_completion_scheduler().get_priority())
+        , shape(in_shape)
+        , function(in_function)
+        , receiver(std::move(in_receiver))
+        , child(sender.connect(bulk_receiver<bulk_operation>{ this }))
+    {
+    }
+
+    bulk_operation(const bulk_operation& other) = delete;
+    bulk_operation& operator=(const bulk_operation& other) = delete;
+
+    /** Starts the sender being continued from. */
+    void start() noexcept
+    {
+        child.start();
+    }
+
+    /** Runs the function for every index and completes the receiver. */
+    template <typename... value_types>
+    void complete(value_types&&... values)
+    {
+        parallel_options options;
+        options.job_priority = job_priority;
+        options.tag = "bulk";
+
+        size_t slot_count = get_parallel_slot_count(*scheduler);
+        size_t grain = get_parallel_grain(shape, slot_count, 0);
+        size_t chunk_count = (shape + grain - 1) / grain;
+
+        // The sender we continue from completes inside a job, so waiting for the other workers here suspends rather than blocks.
+        result res = parallel_chunks(*scheduler, chunk_count, slot_count, options, [&](size_t chunk_index, size_t) {
+            size_t chunk_begin = chunk_index * grain;
+            size_t chunk_end = JOBS_MIN(chunk_begin + grain, shape);
+
+            for (size_t i = chunk_begin; i < chunk_end; i++)
+            {
+                function(i, values...);
+            }
+        });
+
+        if (res != result::success)
+        {
+            receiver.set_error(res);
+            return;
+        }
+
+        receiver.set_value(std::forward<value_types>(values)...);
+    }
+
+    /** Scheduler the indices are executed on. */
+    jobs::scheduler* scheduler;
+
+    /** Priority of the jobs the indices are executed in. */
+    priority job_priority;
+
+    /** Number of indices to call the function for. */
+    size_t shape;
+
+    /** Function to call for each index. */
+    function_type function;
+
+    /** Receiver to complete with the senders values. */
+    receiver_type receiver;
+
+    /** Operation state of the sender being continued from. */
+    decltype(std::declval<const sender_type&>().connect(std::declval<bulk_receiver<bulk_operation>>())) child;
+
+};
+
+/** Receiver connected to one of the senders a when_all operation is waiting for. */
+template <typename operation_type, size_t index>
+class when_all_receiver
+{
+public:
+
+    /** Pointer to the when_all operation this receiver belongs to. */
+    operation_type* operation;
+
+    /** Stores the values and completes the operation if this was the last sender. */
+    template <typename... value_types>
+    void set_value(value_types&&... values) noexcept
+    {
+        std::get<index>(operation->values).emplace(std::forward<value_types>(values)...);
+        operation->child_complete();
+    }
+
+    /** Records the error and completes the operation if this was the last sender. */
+    void set_error(result error) noexcept
+    {
+        operation->child_failed(error, false);
+    }
+
+    /** Records the stop and completes the operation if this was the last sender. */
+    void set_stopped() noexcept
+    {
+        operation->child_failed(result::success, true);
+    }
+
+};
+
+/** Holds the operation states of all the senders a when_all operation is waiting for. */
+template <typename operation_type, size_t index, typename... sender_types>
+class when_all_children
+{
+public:
+
+    /** Constructor */
+    when_all_children(operation_type*)
+    {
+    }
+
+    /** Starts all the operations. */
+    void start() noexcept
+    {
+    }
+
+};
+
+template <typename operation_type, size_t index, typename sender_type, typename... sender_types>
+class when_all_children<operation_type, index, sender_type, sender_types...>
+{
+public:
+
+    /**
+     * \brief Constructor
+     *
+     * \param operation Operation the children belong to.
+     * \param sender First sender.
+     * \param senders Remaining senders.
+     */
+    when_all_children(operation_type* operation, const sender_type& sender, const sender_types&... senders)
+        : child(sender.connect(when_all_receiver<operation_type, index>{ operation }))
+        , remaining(operation, senders...)
+    {
+    }
+
+    /** Starts all the operations. */
+    void start() noexcept
+    {
+        child.start();
+        remaining.start();
+    }
+
+    /** Operation state of the first sender. */
+    decltype(std::declval<const sender_type&>().connect(std::declval<when_all_receiver<operation_type, index>>())) child;
+
+    /** Operation states of the remaining senders. */
+    when_all_children<operation_type, index + 1, sender_types...> remaining;
+
+};
+
+/**
+ * Operation state that completes once all of a set of senders have completed.
+ */
+template <typename receiver_type, typename... sender_types>
+class when_all_operation
+{
+public:
+
+    /**
+     * \brief Constructor
+     *
+     * \param senders Senders to wait for.
+     * \param in_receiver Receiver to complete with the values of all senders.
+     */
+    when_all_operation(const std::tuple<sender_types...>& senders, receiver_type in_receiver)
+        : when_all_operation(senders, std::move(in_receiver), std::index_sequence_for<sender_types...>())
+    {
+    }
+
+    when_all_operation(const when_all_operation& other) = delete;
+    when_all_operation& operator=(const when_all_operation& other) = delete;
+
+    /** Starts all the senders. */
+    void start() noexcept
+    {
+        children.start();
+    }
+
+    /** Called as each sender completes with values. */
+    void child_complete()
+    {
+        // A single countdown, whichever sender finishes last completes the operation.
+        if (--remaining == 0)
+        {
+            complete();
+        }
+    }
+
+    /** Called as each sender completes with an error or stop. */
+    void child_failed(result error, bool stopped)
+    {
+        bool expected = false;
+        if (failed.compare_exchange_strong(expected, true))
+        {
+            failure_error = error;
+            failure_stopped = stopped;
+        }
+
+        child_complete();
+    }
+
+    /** Completes the receiver with the values of all senders, or the first failure. */
+    void complete()
+    {
+        if (failed.load())
+        {
+            if (failure_stopped)
+            {
+                receiver.set_stopped();
+            }
+            else
+            {
+                receiver.set_error(failure_error);
+            }
+            return;
+        }
+
+        auto all_values = std::apply([](auto&... child_values) {
+            return std::tuple_cat(std::move(*child_values)...);
+        }, values);
+
+        std::apply([this](auto&... value) {
+            receiver.set_value(std::move(value)...);
+        }, all_values);
+    }
+
+    /** Receiver to complete with the values of all senders. */
+    receiver_type receiver;
+
+    /** Number of senders that have not completed yet. */
+    std::atomic<size_t> remaining;
+
+    /** Set when any sender fails. */
+    std::atomic<bool> failed{ false };
+
+    /** Error of the first sender to fail. */
+    result failure_error = result::success;
+
+    /** True if the first sender to fail was stopped rather than failing with an error. */
+    bool failure_stopped = false;
+
+    /** Values each sender completed with. */
+    std::tuple<std::optional<typename sender_types::value_types>...> values;
+
+    /** Operation states of the senders. */
+    when_all_children<when_all_operation, 0, sender_types...> children;
+
+private:
+
+    /** Constructor that unpacks the senders. */
+    template <size_t... indices>
+    when_all_operation(const std::tuple<sender_types...>& senders, receiver_type in_receiver, std::index_sequence<indices...>)
+        : receiver(std::move(in_receiver))
+        , remaining(sizeof...(sender_types))
+        , children(this, std::get<indices>(senders)...)
+    {
+    }
+
+};
+
+/** State shared between \ref execution::sync_wait and the receiver it connects. */
+template <typename value_types>
+struct sync_wait_state
+{
+    /** Counter incremented when the sender completes. */
+    counter_handle complete_counter;
+
+    /** Values the sender completed with. */
+    std::optional<value_types> values;
+
+    /** Error the sender completed with. */
+    result error = result::success;
+};
+
+/** Receiver that stores the values of the sender waited on by \ref execution::sync_wait. */
+template <typename value_types>
+class sync_wait_receiver
+{
+public:
+
+    /** State to store completion in. */
+    sync_wait_state<value_types>* state;
+
+    /** Stores the values and wakes the waiter. */
+    template <typename... completion_types>
+    void set_value(completion_types&&... values) noexcept
+    {
+        state->values.emplace(std::forward<completion_types>(values)...);
+        notify();
+    }
+
+    /** Stores the error and wakes the waiter. */
+    void set_error(result error) noexcept
+    {
+        state->error = error;
+        notify();
+    }
+
+    /** Wakes the waiter, which will see no values. */
+    void set_stopped() noexcept
+    {
+        notify();
+    }
+
+private:
+
+    /** Wakes the waiter. */
+    void notify()
+    {
+        // The waiter can return, destroying the state, as soon as the counter changes. So work on a copy of the handle.
+        counter_handle complete_counter = state->complete_counter;
+        complete_counter.add(1);
+    }
+
+};
+
+}; /* namespace internal */
+
+namespace execution {
+
+class schedule_sender;
+
+/**
+ * \brief Scheduler that produces work executed as jobs on a \ref jobs::scheduler.
+ *
+ * This is a lightweight handle that can be copied freely, two job_schedulers are equal
+ * if they schedule onto the same scheduler with the same settings.
+ */
+class job_scheduler
+{
+public:
+
+    /**
+     * \brief Constructor
+     *
+     * \param scheduler Scheduler jobs are dispatched to.
+     * \param job_priority Priority of dispatched jobs.
+     * \param stack_size Stack size of dispatched jobs.
+     */
+    explicit job_scheduler(scheduler& scheduler, priority job_priority = priority::normal, size_t stack_size = 0)
+        : m_scheduler(&scheduler)
+        , m_priority(job_priority)
+        , m_stack_size(stack_size)
+    {
+    }
+
+    /**
+     * \brief Gets a sender that completes on a job executed by the scheduler.
+     *
+     * \return Sender that completes with no values.
+     */
+    schedule_sender schedule() const;
+
+    /**
+     * \brief Gets the scheduler jobs are dispatched to.
+     *
+     * \return Reference to scheduler.
+     */
+    scheduler& get_scheduler() const
+    {
+        return *m_scheduler;
+    }
+
+    /**
+     * \brief Gets the priority of dispatched jobs.
+     *
+     * \return Priority of jobs.
+     */
+    priority get_priority() const
+    {
+        return m_priority;
+    }
+
+    /**
+     * \brief Gets the stack size of dispatched jobs.
+     *
+     * \return Stack size of jobs.
+     */
+    size_t get_stack_size() const
+    {
+        return m_stack_size;
+    }
+
+    /**
+     * \brief Equality operator
+     *
+     * \param rhs Object to compare against.
+     *
+     * \return True if objects are equal.
+     */
+    bool operator==(const job_scheduler& rhs) const
+    {
+        return m_scheduler == rhs.m_scheduler && m_priority == rhs.m_priority && m_stack_size == rhs.m_stack_size;
+    }
+
+    /**
+     * \brief Inequality operator
+     *
+     * \param rhs Object to compare against.
+     *
+     * \return True if objects are inequal.
+     */
+    bool operator!=(const job_scheduler& rhs) const
+    {
+        return !(*this == rhs);
+    }
+
+private:
+
+    /** Scheduler jobs are dispatched to. */
+    scheduler* m_scheduler;
+
+    /** Priority of dispatched jobs. */
+    priority m_priority;
+
+    /** Stack size of dispatched jobs. */
+    size_t m_stack_size;
+
+};
+
+/**
+ * \brief Sender that completes, with no values, on a job executed by a \ref job_scheduler.
+ */
+class schedule_sender
+{
+public:
+
+    /** Values this sender completes with. */
+    using value_types = std::tuple<>;
+
+    /**
+     * \brief Constructor
+     *
+     * \param scheduler Scheduler to complete on.
+     */
+    explicit schedule_sender(const job_scheduler& scheduler)
+        : m_scheduler(scheduler)
+    {
+    }
+
+    /**
+     * \brief Connects this sender to a receiver.
+     *
+     * \param receiver Receiver to complete.
+     *
+     * \return Operation state that dispatches a job when started.
+     */
+    template <typename receiver_type>
+    internal::schedule_operation<receiver_type> connect(receiver_type receiver) const
+    {
+        return internal::schedule_operation<receiver_type>(&m_scheduler.get_scheduler(), m_scheduler.get_priority(), m_scheduler.get_stack_size(), std::move(receiver));
+    }
+
+    /**
+     * \brief Gets the scheduler this sender completes on.
+     *
+     * \return Scheduler this sender completes on.
+     */
+    job_scheduler get_completion_scheduler() const
+    {
+        return m_scheduler;
+    }
+
+private:
+
+    /** Scheduler to complete on. */
+    job_scheduler m_scheduler;
+
+};
+
+inline schedule_sender job_scheduler::schedule() const
+{
+    return schedule_sender(*this);
+}
+
+/**
+ * \brief Sender that completes with the result of calling a function with the values of another sender.
+ */
+template <typename sender_type, typename function_type>
+class then_sender
+{
+public:
+
+    /** Values this sender completes with. */
+    using value_types = typename internal::single_value_types<typename internal::apply_result<function_type, typename sender_type::value_types>::type>::type;
+
+    /**
+     * \brief Constructor
+     *
+     * \param sender Sender to continue from.
+     * \param function Function to call with the senders values.
+     */
+    then_sender(const sender_type& sender, const function_type& function)
+        : m_sender(sender)
+        , m_function(function)
+    {
+    }
+
+    /**
+     * \brief Connects this sender to a receiver.
+     *
+     * \param receiver Receiver to complete.
+     *
+     * \return Operation state.
+     */
+    template <typename receiver_type>
+    internal::then_operation<sender_type, function_type, receiver_type> connect(receiver_type receiver) const
+    {
+        return internal::then_operation<sender_type, function_type, receiver_type>(m_sender, m_function, std::move(receiver));
+    }
+
+    /**
+     * \brief Gets the scheduler this sender completes on.
+     *
+     * \return Scheduler this sender completes on.
+     */
+    job_scheduler get_completion_scheduler() const
+    {
+        return m_sender.get_completion_scheduler();
+    }
+
+private:
+
+    /** Sender to continue from. */
+    sender_type m_sender;
+
+    /** Function to call with the senders values. */
+    function_type m_function;
+
+};
+
+/**
+ * \brief Sender that calls a function for each index in a range in parallel, then completes with the values of another sender.
+ */
+template <typename sender_type, typename function_type>
+class bulk_sender
+{
+public:
+
+    /** Values this sender completes with. */
+    using value_types = typename sender_type::value_types;
+
+    /**
+     * \brief Constructor
+     *
+     * \param sender Sender to continue from.
+     * \param shape Number of indices to call function for.
+     * \param function Function called as function(index, values...) for each index.
+     */
+    bulk_sender(const sender_type& sender, size_t shape, const function_type& function)
+        : m_sender(sender)
+        , m_shape(shape)
+        , m_function(function)
+    {
+    }
+
+    /**
+     * \brief Connects this sender to a receiver.
+     *
+     * \param receiver Receiver to complete.
+     *
+     * \return Operation state.
+     */
+    template <typename receiver_type>
+    internal::bulk_operation<sender_type, function_type, receiver_type> connect(receiver_type receiver) const
+    {
+        return internal::bulk_operation<sender_type, function_type, receiver_type>(m_sender, m_shape, m_function, std::move(receiver));
+    }
+
+    /**
+     * \brief Gets the scheduler this sender completes on.
+     *
+     * \return Scheduler this sender completes on.
+     */
+    job_scheduler get_completion_scheduler() const
+    {
+        return m_sender.get_completion_scheduler();
+    }
+
+private:
+
+    /** Sender to continue from. */
+    sender_type m_sender;
+
+    /** Number of indices to call function for. */
+    size_t m_shape;
+
+    /** Function to call for each index. */
+    function_type m_function;
+
+};
+
+/**
+ * \brief Sender that completes with the values of all of a set of senders once they have all completed.
+ */
+template <typename sender_type, typename... sender_types>
+class when_all_sender
+{
+public:
+
+    /** Values this sender completes with, the values of each sender in order. */
+    using value_types = decltype(std::tuple_cat(std::declval<typename sender_type::value_types>(), std::declval<typename sender_types::value_types>()...));
+
+    /**
+     * \brief Constructor
+     *
+     * \param sender First sender to wait for.
+     * \param senders Remaining senders to wait for.
+     */
+    when_all_sender(const sender_type& sender, const sender_types&... senders)
+        : m_senders(sender, senders...)
+    {
+    }
+
+    /**
+     * \brief Connects this sender to a receiver.
+     *
+     * \param receiver Receiver to complete.
+     *
+     * \return Operation state.
+     */
+    template <typename receiver_type>
+    internal::when_all_operation<receiver_type, sender_type, sender_types...> connect(receiver_type receiver) const
+    {
+        return internal::when_all_operation<receiver_type, sender_type, sender_types...>(m_senders, std::move(receiver));
+    }
+
+    /**
+     * \brief Gets the scheduler this sender completes on, which is that of the first sender.
+     *
+     * \return Scheduler this sender completes on.
+     */
+    job_scheduler get_completion_scheduler() const
+    {
+        return std::get<0>(m_senders).get_completion_scheduler();
+    }
+
+private:
+
+    /** Senders to wait for. */
+    std::tuple<sender_type, sender_types...> m_senders;
+
+};
+
+/**
+ * \brief Gets a sender that completes on a job executed by a scheduler.
+ *
+ * \param scheduler Scheduler to complete on.
+ *
+ * \return Sender that completes with no values.
+ */
+inline schedule_sender schedule(const job_scheduler& scheduler)
+{
+    return scheduler.schedule();
+}
+
+/**
+ * \brief Gets a sender that calls a function with the values of another sender, and completes with its result.
+ *
+ * \param sender Sender to continue from.
+ * \param function Function called as function(values...).
+ *
+ * \return Sender that completes with the functions result.
+ */
+template <typename sender_type, typename function_type>
+then_sender<sender_type, function_type> then(const sender_type& sender, const function_type& function)
+{
+    return then_sender<sender_type, function_type>(sender, function);
+}
+
+/**
+ * \brief Gets a sender that calls a function for each index in [0, shape) in parallel once another sender completes.
+ *
+ * Indices are split between the workers of the scheduler the sender completes on, in the same way as
+ * \ref jobs::parallel_reduce. The sender completes with the values of the sender it continues from.
+ *
+ * \param sender Sender to continue from.
+ * \param shape Number of indices.
+ * \param function Function called as function(index, values...) for each index.
+ *
+ * \return Sender that completes once every index has been processed.
+ */
+template <typename sender_type, typename function_type>
+bulk_sender<sender_type, function_type> bulk(const sender_type& sender, size_t shape, const function_type& function)
+{
+    return bulk_sender<sender_type, function_type>(sender, shape, function);
+}
+
+/**
+ * \brief Gets a sender that completes once all the given senders have completed.
+ *
+ * A single countdown is decremented as each sender completes, the last sender to complete
+ * completes the returned sender with the values of every sender in order. If any sender fails
+ * the returned sender fails with the first error once all have completed.
+ *
+ * \param sender First sender to wait for.
+ * \param senders Remaining senders to wait for.
+ *
+ * \return Sender that completes with the values of all senders.
+ */
+template <typename sender_type, typename... sender_types>
+when_all_sender<sender_type, sender_types...> when_all(const sender_type& sender, const sender_types&... senders)
+{
+    return when_all_sender<sender_type, sender_types...>(sender, senders...);
+}
+
+/**
+ * \brief Starts a sender and waits for it to complete.
+ *
+ * If called from a job this is non-blocking, the job's fiber is suspended until
+ * the sender completes. If called from any other place, it will block. The operation
+ * state is held on the callers stack.
+ *
+ * \param sender Sender to wait for.
+ * \param output Reference to store the values the sender completes with.
+ *
+ * \return Value indicating the success of this function, or the error the sender failed with.
+ *         result::empty if the sender was stopped.
+ */
+template <typename sender_type>
+result sync_wait(const sender_type& sender, typename sender_type::value_types& output)
+{
+    using value_types = typename sender_type::value_types;
+
+    internal::sync_wait_state<value_types> state;
+
+    result res = sender.get_completion_scheduler().get_scheduler().create_counter(state.complete_counter);
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    {
+        auto operation = sender.connect(internal::sync_wait_receiver<value_types>{ &state });
+        operation.start();
+
+        res = state.complete_counter.wait_for(1);
+        if (res != result::success)
+        {
+            return res;
+        }
+    }
+
+    if (state.error != result::success)
+    {
+        return state.error;
+    }
+    if (!state.values.has_value())
+    {
+        return result::empty;
+    }
+
+    output = std::move(*state.values);
+    return result::success;
+}
+
+/**
+ * \brief Starts a sender and waits for it to complete, discarding its values.
+ *
+ * See \ref sync_wait.
+ *
+ * \param sender Sender to wait for.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename sender_type>
+result sync_wait(const sender_type& sender)
+{
+    typename sender_type::value_types values;
+    return sync_wait(sender, values);
+}
+
+}; /* namespace execution */
+}; /* namespace jobs */
+
+#endif /* __JOBS_EXECUTION_H__ */
@@ -0,0 +1,447 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+/**
+ *  \file jobs_future.h
+ *
+ *  Include header for typed futures and continuations.
+ */
+
+#ifndef __JOBS_FUTURE_H__
+#define __JOBS_FUTURE_H__
+
+#include "jobs_defines.h"
+#include "jobs_enums.h"
+#include "jobs_job.h"
+#include "jobs_scheduler.h"
+
+#include <new>
+#include <type_traits>
+
+namespace jobs {
+
+template <typename value_type>
+class future;
+
+namespace internal {
+
+class future_access;
+
+/**
+ * Functionality shared by all futures regardless of the type of value they produce.
+ */
+class future_base
+{
+protected:
+
+    friend class future_access;
+
+public:
+
+    /**
+     * \brief Determines if this future refers to a valid job.
+     *
+     * \return True if future is valid.
+     */
+    bool is_valid();
+
+    /**
+     * \brief Determines if the job producing this futures value has completed.
+     *
+     * \return True if complete.
+     */
+    bool is_complete();
+
+    /**
+     * \brief Waits for the job producing this futures value to complete.
+     *
+     * If called from a job this is non-blocking, and will queue the job
+     * for execution after the value is produced. If called from any other
+     * place, it will block.
+     *
+     * \param in_timeout If provided, this function will wait a maximum of this time. If
+     *                   the function returns due to a timeout the result provided will be
+     *                   result::timeout.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result wait(timeout in_timeout = timeout::infinite);
+
+    /**
+     * \brief Gets the job that produces this futures value.
+     *
+     * Futures created with \ref create_future are not dispatched, this can be used to configure
+     * their job before calling \ref dispatch.
+     *
+     * \return Handle to job.
+     */
+    job_handle get_job();
+
+    /**
+     * \brief Dispatches the job that produces this futures value.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result dispatch();
+
+protected:
+
+    /** Handle to job that produces this futures value. */
+    job_handle m_job;
+
+};
+
+/**
+ * Gives the future templates access to the scheduler internals they are built on. This is used
+ * internally, and shouldn't ever need to be touched by outside code.
+ */
+class future_access
+{
+public:
+
+    /**
+     * \brief Creates a job to produce the value of a future.
+     *
+     * \param scheduler Scheduler to create job on.
+     * \param has_value True if the job produces a value and needs a result slot.
+     * \param output Future to point at the new job.
+     * \param slot Reference to store the result slot in, or nullptr if the job has no value.
+     *
+     * \return Value indicating the success of this function.
+     */
+    static result create(scheduler* scheduler, bool has_value, future_base& output, future_result*& slot);
+
+    /**
+     * \brief Gets the scheduler that owns a futures job.
+     *
+     * \param future Future to get scheduler of.
+     *
+     * \return Owning scheduler, or nullptr if the future is invalid.
+     */
+    static scheduler* get_scheduler(future_base& future);
+
+    /**
+     * \brief Gets the slot holding the value of a future.
+     *
+     * \param future Future to get slot of.
+     *
+     * \return Result slot, or nullptr if the future has no value.
+     */
+    static future_result* get_result_slot(future_base& future);
+
+    /**
+     * \brief Dispatches a future that continues on from other futures.
+     *
+     * The continuations job is dispatched but not queued, it is queued directly by the scheduler when
+     * the last (or with release_on_any, the first) of the futures it continues from completes.
+     *
+     * \param continuation Future to dispatch.
+     * \param predecessors Array of futures that are continued from.
+     * \param count Number of futures in predecessors.
+     * \param release_on_any If true the continuation is queued when the first predecessor completes.
+     *
+     * \return Value indicating the success of this function.
+     */
+    static result dispatch_continuation(future_base& continuation, future_base* const* predecessors, size_t count, bool release_on_any);
+
+};
+
+/**
+ * \brief Destroys a value held in a result slot.
+ *
+ * \param value Pointer to value to destroy.
+ */
+template <typename value_type>
+void destroy_future_value(void* value)
+{
+    static_cast<value_type*>(value)->~value_type();
+}
+
+/**
+ * \brief Runs a function and stores the value it produces in a result slot.
+ *
+ * \param slot Slot to store value in, unused if value_type is void.
+ * \param function Function producing the value.
+ */
+template <typename value_type, typename function_type>
+void store_future_value(future_result* slot, const function_type& function)
+{
+    if constexpr (std::is_void<value_type>::value)
+    {
+        function();
+    }
+    else
+    {
+        static_assert(sizeof(value_type) <= future_result::max_value_size, "future value is too large to be held in a result slot.");
+        static_assert(alignof(value_type) <= alignof(std::max_align_t), "future value is over-aligned for a result slot.");
+
+        // Any value from a previous dispatch was discarded when this one was dispatched.
+        new(slot->storage) value_type(function());
+        slot->destroy_value = &destroy_future_value<value_type>;
+    }
+}
+
+/**
+ * \brief Creates a future that continues on from another.
+ *
+ * \param predecessor Future to continue from.
+ * \param output Future to store continuation in.
+ * \param function Function called with the predecessors value to produce the continuations value.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename value_type, typename result_type, typename function_type>
+result then(future_base& predecessor, future_base& output, const function_type& function)
+{
+    future_result* slot = nullptr;
+    result res = future_access::create(future_access::get_scheduler(predecessor), !std::is_void<result_type>::value, output, slot);
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    // Holding the predecessors job keeps its result slot alive until the continuation is freed.
+    job_handle predecessor_job = predecessor.get_job();
+    future_result* predecessor_slot = future_access::get_result_slot(predecessor);
+
+    output.get_job().set_work([slot, predecessor_job, predecessor_slot, function]() {
+
+        // Predecessors that skipped their work, such as those in a cancelled group, have no value to continue from.
+        if (predecessor_slot != nullptr && predecessor_slot->destroy_value == nullptr)
+        {
+            return;
+        }
+
+        store_future_value<result_type>(slot, [&]() -> result_type {
+            if constexpr (std::is_void<value_type>::value)
+            {
+                return function();
+            }
+            else
+            {
+                return function(*reinterpret_cast<const value_type*>(predecessor_slot->storage));
+            }
+        });
+
+    });
+
+    future_base* predecessors[] = { &predecessor };
+    return future_access::dispatch_continuation(output, predecessors, 1, false);
+}
+
+}; /* namespace internal */
+
+/**
+ * \brief Represents a value that will be produced by a job.
+ *
+ * The value is held in a result slot owned by the job (see \ref scheduler::set_max_futures), so
+ * no memory is allocated to pass it between jobs. Values must fit in
+ * \ref internal::future_result::max_value_size bytes.
+ *
+ * Continuations added with \ref then are queued directly by the scheduler when the job completes,
+ * without a counter or a job waiting on the value.
+ */
+template <typename value_type>
+class future : public internal::future_base
+{
+public:
+
+    /**
+     * \brief Gets the value produced by the job, waiting for it if it has not completed.
+     *
+     * \param output Reference to store the value in.
+     *
+     * \return Value indicating the success of this function, result::empty if the job
+     *         skipped its work and produced no value.
+     */
+    result get(value_type& output)
+    {
+        result res = wait();
+        if (res != result::success)
+        {
+            return res;
+        }
+
+        internal::future_result* slot = internal::future_access::get_result_slot(*this);
+        if (slot == nullptr || slot->destroy_value == nullptr)
+        {
+            return result::empty;
+        }
+
+        output = *reinterpret_cast<const value_type*>(slot->storage);
+        return result::success;
+    }
+
+    /**
+     * \brief Creates a future whose value is produced by calling a function with this futures value.
+     *
+     * The continuation is dispatched immediately and queued as soon as this future completes, it can
+     * be added before or after this future has been dispatched or completed. Captures that don't fit
+     * in a job_entry_point's small buffer will be heap allocated, keep them small.
+     *
+     * \param output Future to store continuation in.
+     * \param function Function called as function(value) to produce the continuations value.
+     *
+     * \return Value indicating the success of this function.
+     */
+    template <typename result_type, typename function_type>
+    result then(future<result_type>& output, const function_type& function)
+    {
+        return internal::then<value_type, result_type>(*this, output, function);
+    }
+
+};
+
+/**
+ * \brief Represents the completion of a job that produces no value.
+ *
+ * See \ref future.
+ */
+template <>
+class future<void> : public internal::future_base
+{
+public:
+
+    /**
+     * \brief Waits for the job to complete.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result get()
+    {
+        return wait();
+    }
+
+    /**
+     * \brief Creates a future whose value is produced by calling a function once this future completes.
+     *
+     * See \ref future::then.
+     *
+     * \param output Future to store continuation in.
+     * \param function Function called as function() to produce the continuations value.
+     *
+     * \return Value indicating the success of this function.
+     */
+    template <typename result_type, typename function_type>
+    result then(future<result_type>& output, const function_type& function)
+    {
+        return internal::then<void, result_type>(*this, output, function);
+    }
+
+};
+
+/**
+ * \brief Creates a future whose value is produced by running a function in a job.
+ *
+ * The job is not dispatched, it can be configured through \ref future::get_job and
+ * is then dispatched with \ref future::dispatch.
+ *
+ * \param scheduler Scheduler to create job on.
+ * \param output Future to store the new future in.
+ * \param work Function called as work() to produce the futures value.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename value_type, typename function_type>
+result create_future(scheduler& scheduler, future<value_type>& output, const function_type& work)
+{
+    internal::future_result* slot = nullptr;
+    result res = internal::future_access::create(&scheduler, !std::is_void<value_type>::value, output, slot);
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    return output.get_job().set_work([slot, work]() {
+        internal::store_future_value<value_type>(slot, work);
+    });
+}
+
+namespace internal {
+
+/**
+ * \brief Creates a future that continues on from a set of others.
+ *
+ * \param output Future to store continuation in.
+ * \param release_on_any If true the continuation completes after the first future, rather than the last.
+ * \param futures Futures to continue from.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename... future_types>
+result combine_futures(future<void>& output, bool release_on_any, future_types&... futures)
+{
+    future_base* predecessors[] = { static_cast<future_base*>(&futures)... };
+
+    future_result* slot = nullptr;
+    result res = future_access::create(future_access::get_scheduler(*predecessors[0]), false, output, slot);
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    output.get_job().set_work([]() {});
+
+    return future_access::dispatch_continuation(output, predecessors, sizeof...(futures), release_on_any);
+}
+
+}; /* namespace internal */
+
+/**
+ * \brief Creates a future that completes once all the given futures have completed.
+ *
+ * A single countdown is released by each future as it completes, the last one queues
+ * the returned future directly.
+ *
+ * \param output Future to store the combined future in.
+ * \param first First future to wait for.
+ * \param futures Remaining futures to wait for.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename first_future_type, typename... future_types>
+result when_all(future<void>& output, first_future_type& first, future_types&... futures)
+{
+    return internal::combine_futures(output, false, first, futures...);
+}
+
+/**
+ * \brief Creates a future that completes once any of the given futures have completed.
+ *
+ * The first future to complete queues the returned future directly, the rest do nothing.
+ * Use \ref internal::future_base::is_complete to find which futures have completed.
+ *
+ * \param output Future to store the combined future in.
+ * \param first First future to wait for.
+ * \param futures Remaining futures to wait for.
+ *
+ * \return Value indicating the success of this function.
+ */
+template <typename first_future_type, typename... future_types>
+result when_any(future<void>& output, first_future_type& first, future_types&... futures)
+{
+    return internal::combine_futures(output, true, first, futures...);
+}
+
+}; /* namespace jobs */
+
+#endif /* __JOBS_FUTURE_H__ */
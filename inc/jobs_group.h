@@ -0,0 +1,252 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+  
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+
+/**
+ *  \file jobs_group.h
+ *
+ *  Include header for job group functionality.
+ */
+
+#ifndef __JOBS_GROUP_H__
+#define __JOBS_GROUP_H__
+
+#include "jobs_defines.h"
+#include "jobs_enums.h"
+#include "jobs_utils.h"
+#include "jobs_event.h"
+
+#include <atomic>
+
+namespace jobs {
+    
+class scheduler;
+
+namespace internal {
+
+class job_definition;
+
+/**
+ * Encapsulates all the settings required to manage a group. This is used 
+ * for internal storage, and shouldn't ever need to be touched by outside code.
+ */
+class group_definition
+{
+public:
+
+    /** Constructor */
+    group_definition();
+
+    /** Resets data so definition can be recycled. */
+    void reset();
+
+public:	
+
+    /** Number of handles that reference this group. Used to track and recycle groups when no longer used. */
+    std::atomic<size_t> ref_count;
+
+    /** Number of jobs in this group that have been dispatched but not yet completed. */
+    sharded_activity_counter active_jobs;
+
+    /** Set when the group is cancelled. Jobs in the group that have not started yet will skip their work. */
+    std::atomic<bool> cancelled;
+
+    /** Number of threads or jobs currently waiting for this group to become idle. */
+    std::atomic<size_t> waiter_count;
+
+    /** Manual-reset event signaled when the last job in the group completes while someone is waiting. */
+    event_handle idle_event;
+
+    /** Maximum number of jobs in the group that can be running or holding a fiber at once, or 0 if unlimited. */
+    std::atomic<size_t> concurrency_limit;
+
+    /** Protects the admitted count and throttled job list. */
+    spinwait_mutex throttle_mutex;
+
+    /** Number of jobs currently admitted by the concurrency limit. */
+    size_t admitted_jobs;
+
+    /** First job waiting for the group to drop below its concurrency limit. */
+    job_definition* throttled_head;
+
+    /** Last job waiting for the group to drop below its concurrency limit. */
+    job_definition* throttled_tail;
+
+};
+
+}; /* namespace internal */
+
+/**
+ * \brief Represents an instance of a job group that has been created by the scheduler.
+ *
+ * Groups data is owned by the scheduler, be careful accessing handles if 
+ * the scheduler has been destroyed.
+ *
+ * Groups allow a set of jobs to be waited on or cancelled together, without
+ * waiting for the entire scheduler to become idle. Jobs are added to a group with 
+ * \ref job_handle::set_group before they are dispatched, this can be done from inside other 
+ * jobs to extend the group while it is running.
+ *
+ * Each group holds an event internally, so creating a group consumes one of the 
+ * counters provided to \ref scheduler::set_max_counters.
+ */
+class group_handle
+{
+protected:
+
+    friend class scheduler;
+
+    /**
+     * \brief Constructor
+     *
+     * \param scheduler Scheduler that owns this group.
+     * \param index Index into the scheduler's group pool where this groups data is held.
+     */
+    group_handle(scheduler* scheduler, size_t index);
+
+    /** Increases the reference count of this group. */
+    void increase_ref();
+
+    /** Decreases the reference count of this group. When it reaches zero, it will be disposed of. */
+    void decrease_ref();
+
+public:
+
+    /** Constructor */
+    group_handle();
+
+    /**
+     * \brief Copy constructor
+     *
+     * \param other Object to copy.
+     */
+    group_handle(const group_handle& other);
+
+    /** Destructor */
+    ~group_handle();
+
+    /**
+     * \brief Waits for all jobs dispatched into this group to complete.
+     *
+     * If called from a job this is non-blocking, and will queue the job
+     * for execution after the group becomes idle. If called
+     * from any other place, it will block.
+     *
+     * Jobs dispatched into the group while waiting extend the wait.
+     *
+     * \param in_timeout If provided, this function will wait a maximum of this time. If
+     *                   the function returns due to a timeout the result provided will be
+     *                   result::timeout.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result wait(timeout in_timeout = timeout::infinite);
+
+    /**
+     * \brief Cancels this group.
+     *
+     * Cancellation is cooperative, jobs in the group that have already started will 
+     * run to completion, any that have not started yet will complete without executing
+     * their work. Long running jobs can poll \ref is_cancelled to exit early. 
+     *
+     * Cancellation cannot be undone, create a new group to dispatch more work.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result cancel();
+
+    /**
+     * \brief Gets if this group has been cancelled.
+     *
+     * \return True if group has been cancelled.
+     */
+    bool is_cancelled() const;
+
+    /**
+     * \brief Limits how many jobs in this group can be running at once.
+     *
+     * Jobs over the limit are held by the group, without a fiber or a place in the 
+     * schedulers queues, and are released in dispatch order as admitted jobs complete. Jobs
+     * that are suspended while waiting on something still count towards the limit, as 
+     * they hold onto their fiber. 
+     *
+     * This should be set before any jobs are dispatched into the group.
+     *
+     * \param limit Maximum number of jobs to run concurrently, or 0 for no limit.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_concurrency_limit(size_t limit);
+
+    /**
+     * \brief Gets if all jobs dispatched into this group have completed.
+     *
+     * \return True if group has no outstanding jobs.
+     */
+    bool is_idle() const;
+
+    /**
+     * \brief Assignment operator
+     *
+     * \param other Object to assign.
+     *
+     * \return Reference to this object.
+     */
+    group_handle& operator=(const group_handle& other);
+
+    /**
+     * \brief Equality operator
+     *
+     * \param rhs Object to compare against.
+     *
+     * \return True if objects are equal.
+     */
+    bool operator==(const group_handle& rhs) const;
+
+    /**
+     * \brief Inequality operator
+     *
+     * \param rhs Object to compare against.
+     *
+     * \return True if objects are inequal.
+     */
+    bool operator!=(const group_handle& rhs) const;
+
+    /**
+     * \brief Returns true if this handle points to a valid group instance.
+     *
+     * \return True if handle is valid.
+     */
+    bool is_valid() const;
+
+private:
+
+    /** Pointer to the owning scheduler of this handle. */
+    scheduler* m_scheduler = nullptr;
+
+    /** Index into the scheduler's group pool where this groups data is held. */
+    size_t m_index = 0;
+
+};
+
+}; /* namespace jobs */
+
+#endif /* __JOBS_GROUP_H__ */
\ No newline at end of file
@@ -29,6 +29,7 @@
 #define __JOBS_JOB_H__
 
 #include <atomic>
+#include <cstddef>
 
 #include "jobs_defines.h"
 #include "jobs_utils.h"
@@ -37,6 +38,7 @@
 #include "jobs_fiber.h"
 #include "jobs_event.h"
 #include "jobs_counter.h"
+#include "jobs_group.h"
 
 namespace jobs {
 
@@ -47,12 +49,30 @@ class scheduler;
  */
 typedef std::function<void()> job_entry_point;
 
+/**
+ * Value used in place of a worker index to indicate that a job can be executed by any worker.
+ */
+const size_t any_worker = SIZE_MAX;
+
+/**
+ * Value used in place of a worker index to indicate that a job can only be executed by the 
+ * thread calling \ref jobs::scheduler::pump rather than by a worker.
+ */
+const size_t pump_thread = SIZE_MAX - 1;
+
+/**
+ * Value used in place of an affinity key to indicate that a job has no preferred worker.
+ */
+const uint64_t no_affinity_key = UINT64_MAX;
+
 namespace internal {
     
 class job_definition;
 class job_dependency;
 class job_context;
 class profile_scope_definition;
+class future_result;
+class future_access;
 
 /**
  * Holds the execution context of a job, this provides various functionality to 
@@ -69,6 +89,9 @@ protected:
     /** True if this job context has been assigned a fiber. */
     bool has_fiber = false;
 
+    /** True while a worker is executing on this contexts fiber, cleared once the worker has switched back off it. */
+    std::atomic<bool> fiber_active{ false };
+
     /** If the fiber assigned to this context is held in \ref raw_fiber or indirectly through \ref fiber_index / \ref fiber_pool_index. */
     bool is_fiber_raw;
 
@@ -78,11 +101,56 @@ protected:
     /** Index of the fiber pool the fiber assigned to this context is contained in. */
     size_t fiber_pool_index;
 
+    /** Numa node of the fiber pool the fiber assigned to this context is contained in. */
+    size_t fiber_numa_node;
+
     /** Raw fiber assigned to this context, rather than a pooled fiber. */
     fiber raw_fiber;
 
-    /** Bitmask of all queues the job being run is contained in. */
-    size_t queues_contained_in;
+    /** Bitmask of all queues the job being run is contained in. Atomic as priority inheritance can add queues from other workers. */
+    std::atomic<uint64_t> queues_contained_in;
+
+    /** Bitmask of the queues the job is placed in when queued, derived from its priority on dispatch and raised by priority inheritance. */
+    std::atomic<uint64_t> queue_mask;
+
+    /** True if the job is held in a thread-affine queue. */
+    bool in_affine_queue;
+
+    /** True if the job is held in an ordered queue. */
+    bool in_ordered_queue;
+
+    /** True if the job has an entry in the local queue of its preferred worker. Only cleared when that entry is popped. */
+    std::atomic<bool> in_local_queue;
+
+    /** Index of the worker that last switched to this jobs fiber, or SIZE_MAX if none. */
+    size_t last_worker;
+
+    /** Time on the schedulers timer, in microseconds, the job should complete by. Calculated on dispatch. */
+    uint64_t deadline_time;
+
+    /** Estimated cost of this job plus the longest chain of successors following it. Calculated on batch dispatch. */
+    uint64_t critical_path;
+
+    /** Pass of the critical path calculation that last visited this job. */
+    size_t critical_path_pass;
+
+    /** Next successor to visit during the critical path calculation. */
+    job_dependency* critical_path_cursor;
+
+    /** Time, in microseconds, the job has spent executing so far. Only measured when critical path ordering is enabled. */
+    uint64_t execution_time;
+
+    /** True if the job has been admitted by its groups concurrency limit and counts towards it until complete. */
+    bool concurrency_admitted;
+
+    /** Next job held back by the same groups concurrency limit. */
+    job_definition* next_throttled;
+
+    /** Number of waited on jobs currently being executed inline on this contexts fiber. */
+    size_t inline_depth;
+
+    /** Total stack size requested by the jobs currently being executed inline on this contexts fiber. */
+    size_t inline_stack_size;
 
     /** Depth of profile marker stack. */
     size_t profile_scope_depth;
@@ -154,6 +222,7 @@ class job_handle
 protected:
 
     friend class scheduler;
+    friend class internal::future_access;
 
     /**
      * \brief Constructor
@@ -231,6 +300,75 @@ public:
      */
     result set_priority(priority job_priority);
 
+    /**
+     * \brief Sets the numa node this job would prefer to execute on.
+     *
+     * When dispatched the job is placed in the queues of the given node, and will be picked up
+     * by workers on that node before any others. Workers on other nodes can still steal the job
+     * if they run out of local work. By default jobs are queued on the node of the thread that dispatches them.
+     *
+     * \param numa_node Index of numa node to prefer, or \ref jobs::any_numa_node to use the dispatching thread's node.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_numa_node(size_t numa_node);
+
+    /**
+     * \brief Sets the thread this job is bound to.
+     *
+     * Thread-affine jobs are only ever executed by the thread they are bound to, this includes resuming
+     * after they have waited or slept. This is intended for work that has to run on a specific OS thread,
+     * such as calls into single-threaded libraries or render APIs. Workers are numbered sequentially across
+     * all thread pools in the order the pools were added. 
+     *
+     * Jobs bound to \ref jobs::pump_thread are only executed when \ref jobs::scheduler::pump is called.
+     *
+     * \param worker_index Index of worker to bind job to, \ref jobs::pump_thread or \ref jobs::any_worker.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_thread_affinity(size_t worker_index);
+
+    /**
+     * \brief Sets a key identifying the data this job works on, so jobs working on the same data run on the same worker.
+     *
+     * Jobs with the same key are queued on the same worker, chosen by hashing the key, so the data 
+     * they work on stays in that workers caches. For example, the successive ticks of an entity 
+     * could use the entity's address. Unlike \ref set_thread_affinity this is only a preference,
+     * workers with nothing else to do will steal jobs queued on busy workers. If the preferred 
+     * worker doesn't execute the jobs priority, or is parked, the next worker that can is used.
+     *
+     * \param key Key to hash, or \ref jobs::no_affinity_key to queue the job normally.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_affinity_key(uint64_t key);
+
+    /**
+     * \brief Sets the time by which this job should complete, relative to when it is dispatched.
+     *
+     * How deadlines affect the order jobs are executed in is controlled by \ref jobs::scheduler::set_deadline_policy.
+     * Regardless of policy, jobs completing after their deadline are counted in the schedulers statistics.
+     *
+     * \param deadline Time after dispatch the job should complete by, or timeout::infinite for no deadline.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_deadline(timeout deadline);
+
+    /**
+     * \brief Sets an estimate of how long this job takes to execute.
+     *
+     * Used by \ref jobs::scheduler::set_critical_path_ordering to work out which jobs in a dependency graph
+     * are on the longest path and should be started first. Jobs without a hint use the average time 
+     * previously measured for jobs with the same tag, or a nominal cost if neither is available.
+     *
+     * \param cost Estimated execution time in microseconds, or 0 to clear the hint.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_cost_hint(uint64_t cost);
+
     /**
      * \brief Sets a counter that will be incremented when the job completes.
      *
@@ -240,6 +378,18 @@ public:
      */
     result set_completion_counter(const counter_handle& counter);
 
+    /**
+     * \brief Sets the group this job belongs to.
+     *
+     * The job is counted as part of the group from when it is dispatched until it completes, 
+     * and will skip its work if the group is cancelled before it starts.
+     *
+     * \param group Handle of group to add job to.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_group(const group_handle& group);
+
     /**
      * \brief Clears the internal dependency list for this job.
      *
@@ -342,6 +492,47 @@ public:
      */
     result dispatch();
 
+    /**
+     * \brief Dispatches this job, choosing whether it or the job dispatching it runs first.
+     *
+     * With spawn_mode::child_first, calling this from a job suspends the calling job and the worker
+     * runs this job immediately. The calling job is queued where any idle worker can steal it, and
+     * if nobody has by the time this job completes or suspends, the worker resumes it itself. This
+     * executes recursive work depth first, in the same order as the serial program, so only a
+     * single path through the recursion is in flight on each worker at once.
+     *
+     * Falls back to a normal dispatch if not called from a job, if this job has outstanding
+     * predecessors, if either job is thread-affine, ordered by deadline or critical path or
+     * concurrency limited, or if this job requires a numa node or priority the calling worker
+     * isn't executing.
+     *
+     * \param mode Determines if this job or the calling job runs first.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result dispatch(spawn_mode mode);
+
+    /**
+     * \brief Dispatches this job so its work is executed once for each index in [0, count).
+     *
+     * Instances are executed in parallel across workers, each claiming grain indices at a time. 
+     * The current index can be retrieved from inside the work with \ref jobs::scheduler::get_instance_index.
+     * The job is only complete, and its successors and completion counter only triggered, 
+     * once every instance has finished.
+     *
+     * Only this job needs creating, regardless of the number of instances. While it executes it 
+     * creates up to one internal helper job per worker that can run its priority, and each helper 
+     * holds a job slot, a fiber and a counter until it returns. Size \ref jobs::scheduler::set_max_jobs and
+     * the fiber pools for that many extra jobs per running dispatch. If none are free the instances 
+     * are spread over fewer workers.
+     *
+     * \param count Number of instances to execute.
+     * \param grain Number of consecutive instances executed each time a worker claims work.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result dispatch_instances(size_t count, size_t grain = 1);
+
     /**
      * \brief Assignment operator
      *
@@ -416,9 +607,39 @@ public:
     /** Bitmask of all priorities assigned to job. This determines the work queues it gets placed in. */
     priority job_priority;
 
+    /** Numa node this job prefers to be queued on, or any_numa_node to use the dispatching threads node. */
+    size_t numa_node;
+
+    /** Index of the worker this job is bound to, or pump_thread / any_worker. */
+    size_t thread_affinity;
+
+    /** Key hashed to choose the worker this job prefers, or no_affinity_key. */
+    uint64_t affinity_key;
+
+    /** Time after dispatch this job should complete by. */
+    timeout deadline;
+
+    /** User-provided estimate of execution time in microseconds, or 0 if not provided. */
+    uint64_t cost_hint;
+
+    /** Number of times work is executed when dispatched with \ref job_handle::dispatch_instances. */
+    size_t instance_count;
+
+    /** Number of instances claimed at a time, or 0 if the job was dispatched normally. */
+    size_t instance_grain;
+
+    /** Next instance index to be claimed. */
+    std::atomic<size_t> instance_cursor;
+
+    /** Index of the instance this job is currently executing. */
+    size_t instance_index;
+
     /** Handle to counter which will be incremented on completino. */
     counter_handle completion_counter;
 
+    /** Handle to group this job belongs to. */
+    group_handle group;
+
     /** Current execution status of the job. */
     std::atomic<job_status> status;
 
@@ -449,6 +670,12 @@ public:
     /** Linked list link for this job within the wait-list in the job we are waiting on. */
     multiple_writer_single_reader_list<internal::job_definition*>::link wait_list_link;
 
+    /** 
+     * If set this is a fake-job used by a non-job thread to wait on another job. Rather than being 
+     * requeued when the job completes, the thread blocked on this slot is woken up.
+     */
+    parking_slot* wait_parking_slot;
+
     /** Linked list holding all jobs which are currently waiting for us to complete */
     multiple_writer_single_reader_list<internal::job_definition*> wait_list;
 
@@ -459,9 +686,27 @@ public:
     /** Head of single linked list holding all predecessor job dependencies. */
     job_dependency* first_predecessor = nullptr;
 
+    /** Held while changing \ref first_predecessor or \ref wait_job, so priority inheritance can safely follow them from other workers. */
+    spinwait_mutex dependency_lock;
+
     /** Head of single linked list holding all successor job dependencies. */
     job_dependency* first_successor = nullptr;
 
+    /** 
+     * Head of single linked list holding continuations to release when this job completes. Unlike successors
+     * these can be added while the job is running, once the job has completed this holds \ref completed_continuations.
+     */
+    std::atomic<job_dependency*> first_continuation;
+
+    /** Value held by \ref first_continuation once the job has completed, continuations added after this are released immediately. */
+    static job_dependency* const completed_continuations;
+
+    /** If true this job is released to run when the first continuation it was added as is released, rather than the last. */
+    bool release_on_any;
+
+    /** Slot holding the value produced by this job if it is used as a future, or nullptr if it produces no value. */
+    future_result* result_slot;
+
     /** Atomic counter counting down how many pending predecessors need to finish executing before we can run. */
     std::atomic<size_t> pending_predecessors;
 
@@ -513,6 +758,49 @@ public:
 
 };
 
+/**
+ * Holds the value produced by a job that is used as a future, allocated from a pool by the 
+ * scheduler. The value is constructed in place so no allocation is needed to store it.
+ */
+class future_result
+{
+public:
+
+    /** Maximum size of a value that can be held. */
+    static const size_t max_value_size = 64;
+
+    /**
+     * \brief Constructor
+     *
+     * \param in_pool_index Index into the scheduler's pool where this results data is held.
+     */
+    future_result(size_t in_pool_index)
+        : pool_index(in_pool_index)
+    {
+    }
+
+    /** Resets data so this can be recycled, destroying any value held. */
+    void reset()
+    {
+        // pool_index should not be reset, it should be persistent.
+        if (destroy_value != nullptr)
+        {
+            destroy_value(storage);
+            destroy_value = nullptr;
+        }
+    }
+
+    /** Index into the scheduler's pool where this results data is held. */
+    size_t pool_index;
+
+    /** Function that destroys the value held in \ref storage, or nullptr if no value has been stored. */
+    void (*destroy_value)(void* value) = nullptr;
+
+    /** Storage the value is constructed in. */
+    alignas(std::max_align_t) unsigned char storage[max_value_size];
+
+};
+
 /**
  * Represents an individual scope in a fibers profiling hierarchy.
  * This is stored together as a single linked list.
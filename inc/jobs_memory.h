@@ -57,6 +57,20 @@ typedef std::function<void*(size_t size, size_t alignment)> memory_alloc_functio
  */
 typedef std::function<void(void* ptr)> memory_free_function;
 
+/**
+ *  \brief User-defined numa-aware memory allocation function.
+ *
+ *  Function prototype that can be passed into a job scheduler through
+ *  set_memory_functions to control the placement of memory the scheduler
+ *  wants to keep local to a given numa node (job queues, fiber pools, worker state).
+ *
+ *  \param size Size of block of memory to be allocated.
+ *  \param alignment Alignment of block of memory to be allocated.
+ *  \param numa_node Index of numa node the memory should be physically backed by.
+ *  \return Pointer to block of memory that was allocated, or nullptr on failure.
+ */
+typedef std::function<void*(size_t size, size_t alignment, size_t numa_node)> memory_alloc_numa_function;
+
 /**
  *  \brief Holds all overrided functions used for managing memory.
  */
@@ -67,6 +81,12 @@ struct memory_functions
 
     /** Function to use for deallocation of memory. */
     memory_free_function user_free = nullptr;
+
+    /** Function to use for allocation of memory on a specific numa node. If not provided user_alloc is used instead. */
+    memory_alloc_numa_function user_alloc_numa = nullptr;
+
+    /** Function to use for deallocation of memory allocated with user_alloc_numa. */
+    memory_free_function user_free_numa = nullptr;
 };
 
 }; /* namespace jobs */
@@ -32,8 +32,10 @@
 #include "jobs_enums.h"
 #include "jobs_memory.h"
 #include "jobs_job.h"
+#include "jobs_ebr.h"
 #include "jobs_utils.h"
 #include "jobs_callback_scheduler.h"
+#include "jobs_topology.h"
 
 #include <functional>
 #include <condition_variable>
@@ -44,16 +46,20 @@ namespace jobs {
 class job_handle;
 class event_handle;
 class counter_handle;
+class group_handle;
 
 namespace internal {
     
 class profile_scope_definition;
 class job_definition;
 class job_dependency;
+class future_result;
+class future_access;
 class job_context;
 class thread;
 class fiber;
 class counter_definition;
+class group_definition;
 class callback_scheduler;
 class profile_scope_internal;
 
@@ -93,6 +99,33 @@ struct profile_functions
     profile_leave_scope_function leave_scope = nullptr;
 };
 
+/**
+ *  \brief Statistics gathered by the scheduler while running, as returned by \ref scheduler::get_stats.
+ */
+struct scheduler_stats
+{
+    /** Number of jobs with a deadline that have completed. */
+    size_t deadline_jobs_completed = 0;
+
+    /** Number of jobs that completed after their deadline had passed. */
+    size_t deadline_misses = 0;
+
+    /** Largest time, in microseconds, any job completed after its deadline. */
+    uint64_t max_deadline_overrun_us = 0;
+
+    /** Number of times a job waited on a lower priority job, causing its priority to be inherited. */
+    size_t priority_inversions = 0;
+
+    /** Number of jobs that have been boosted to a higher priority, including predecessors boosted transitively. */
+    size_t priority_boosts = 0;
+
+    /** Number of waits on a job that had not started yet, that were satisfied by executing it inline on the waiting fiber. */
+    size_t inline_waits = 0;
+
+    /** Number of jobs queued on a preferred worker that were stolen and executed by a different worker. */
+    size_t local_steals = 0;
+};
+
 /**
  *  The scheduler is the heart of the library. Its responsible for managing the 
  *  creation and execution of all threads, fibers and jobs.
@@ -185,6 +218,41 @@ public:
      */
     result set_max_counters(size_t max_counters);
 
+    /**
+     * \brief Sets the maximum number of job groups that can be created.
+     *
+     * This has a direct effect on the quantity of memory allocated by the scheduler when initialized.
+     *
+     * \param max_groups New maximum number of groups.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_max_groups(size_t max_groups);
+
+    /**
+     * \brief Sets the maximum number of futures that can hold a value at the same time.
+     *
+     * Each future that produces a value, including continuations, holds a result slot until its 
+     * job is freed. Futures that produce no value do not use a slot.
+     * This has a direct effect on the quantity of memory allocated by the scheduler when initialized.
+     *
+     * \param max_futures New maximum number of futures.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_max_futures(size_t max_futures);
+
+    /**
+     * \brief Sets the maximum number of objects that can be waiting to be reclaimed after being retired with \ref ebr::retire.
+     *
+     * This has a direct effect on the quantity of memory allocated by the scheduler when initialized.
+     *
+     * \param max_retired_objects New maximum number of retired objects.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_max_retired_objects(size_t max_retired_objects);
+
     /**
      * \brief Sets the maximum number of latent callbacks that can be scheduld and used for syncronization.
      *
@@ -204,12 +272,75 @@ public:
      * Thread pools can be assigned multiple job priorities, and will only execute jobs queued with one of
      * these priorities. This can be used to segregate long-running and time-critical work onto different threads.
      *
+     * On numa systems each worker is bound to the processors of a single node and will prefer to
+     * execute jobs queued on that node, only stealing work from other nodes once its own node is empty.
+     *
+     * Each worker is pinned to a single logical processor chosen by the pools placement policy. Pools
+     * are placed in the order they are added, each continuing from where the previous pool finished, so
+     * multiple pools do not pile onto the same processors until all have been used.
+     *
      * \param thread_count Number of threads to create in the new pool.
      * \param job_priorities Bitmask of all the job priorities this thread pool will execute.
+     * \param numa_node Numa node all threads in this pool should be bound to. If \ref jobs::any_numa_node the 
+     *                  threads are spread evenly between all nodes that have processors.
+     * \param placement Policy used to decide which logical processors the threads in this pool are pinned to.
      * 
      * \return Value indicating the success of this function.
      */
-    result add_thread_pool(size_t thread_count, priority job_priorities = priority::all);
+    result add_thread_pool(size_t thread_count, priority job_priorities = priority::all, size_t numa_node = any_numa_node, thread_placement placement = thread_placement::logical_cores);
+
+    /**
+     * \brief Adds a new pool of worker threads that grows and shrinks with load.
+     *
+     * This behaves the same as \ref add_thread_pool, except only min_thread_count workers are active 
+     * to begin with. Additional workers are activated whenever jobs are queued faster than the active 
+     * workers can pick them up, and retire again once they have been idle for longer than the timeout
+     * given to \ref set_worker_idle_timeout. Retired workers are deep-parked on a condition variable,
+     * they do not spin or poll and cost nothing until they are needed again.
+     *
+     * All max_thread_count threads are still created during \ref init.
+     *
+     * \param min_thread_count Minimum number of threads that are always active in this pool.
+     * \param max_thread_count Maximum number of threads that can be active in this pool.
+     * \param job_priorities Bitmask of all the job priorities this thread pool will execute.
+     * \param numa_node Numa node all threads in this pool should be bound to, or \ref jobs::any_numa_node.
+     * \param placement Policy used to decide which logical processors the threads in this pool are pinned to.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result add_elastic_thread_pool(size_t min_thread_count, size_t max_thread_count, priority job_priorities = priority::all, size_t numa_node = any_numa_node, thread_placement placement = thread_placement::logical_cores);
+
+    /**
+     * \brief Sets how long a worker in an elastic thread pool can be idle before it retires.
+     *
+     * \param idle_timeout Time a worker must be idle before retiring.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_worker_idle_timeout(timeout idle_timeout);
+
+    /**
+     * \brief Limits the total number of workers that are allowed to execute jobs.
+     *
+     * This can be called at any time, before or after initialization, and is intended to allow 
+     * multiple services sharing a machine to divide the cores between them. Workers beyond the 
+     * limit are parked once they finish their current job. The limit is shared between thread pools 
+     * in proportion to their size, and every pool always keeps at least one worker active.
+     *
+     * If tracking of available cores is enabled, the lower of the two limits is used.
+     *
+     * \param max_active_workers Maximum number of active workers, or SIZE_MAX for no limit.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_active_worker_limit(size_t max_active_workers);
+
+    /**
+     * \brief Gets the number of workers that are currently allowed to execute jobs.
+     *
+     * \return Number of active, non-parked, workers.
+     */
+    size_t get_active_worker_count();
     
     /**
      * \brief Adds a new pool of fibers threads to the scheduler.
@@ -224,12 +355,153 @@ public:
      * Multiple pools with different granularities of stack sizes should be created to reduce the memory overhead. Creating a single 
      * large pool with a large stack size will result in unnecessarily high memory usage (as the memory allocated is equal to fiber_count * stack_size).
      *
+     * On numa systems the fibers are split between all nodes that have workers, with the stacks allocated
+     * on memory local to that node. Workers will allocate fibers from their own node first.
+     *
      * \param fiber_count Number of fibers to create in the new pool.
      * \param stack_size Size of the stack each fiber is allocated.
      * 
      * \return Value indicating the success of this function.
      */
     result add_fiber_pool(size_t fiber_count, size_t stack_size);
+
+    /**
+     * \brief Sets if the scheduler should follow changes to the number of cores available to the process.
+     *
+     * Container cpu quotas and process affinity can change while the process is running. When tracking 
+     * is enabled the workers periodically re-query \ref get_logical_core_count while looking for work, and 
+     * park any workers beyond that count so the process does not oversubscribe its quota. Parked workers 
+     * resume when the count rises again. Cores are shared between thread pools in proportion to their 
+     * size, and every pool always keeps at least one worker active.
+     *
+     * \param track True if available core count should be tracked.
+     * \param poll_interval Minimum time between queries of the available core count.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_track_available_cores(bool track, timeout poll_interval = timeout(1000));
+
+    /**
+     * \brief Sets the policy workers use to decide which priority to take their next job from.
+     *
+     * By default priorities are strictly ordered, which gives the lowest latency for high priority jobs
+     * but can starve lower priorities indefinitely if higher priority jobs are queued faster than they 
+     * are executed. The other policies trade some latency of high priority jobs for bounded latency of
+     * lower priority ones.
+     *
+     * \param policy Policy to use.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_scheduling_policy(scheduling_policy policy);
+
+    /**
+     * \brief Sets the number of priority levels jobs can be queued at.
+     *
+     * By default there is one level for each of the named priorities. Additional levels are lower priority
+     * than \ref priority::slow and can be addressed with \ref priority_level and \ref priority_levels. Jobs
+     * with no priority within the configured levels are queued at the lowest level. 
+     *
+     * Each level has its own queue on each numa node, so this has a direct effect on the quantity of memory 
+     * allocated by the scheduler when initialized. Empty levels cost nothing when looking for work.
+     *
+     * \param level_count Number of priority levels, between 1 and \ref max_priority_levels.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_priority_level_count(size_t level_count);
+
+    /**
+     * \brief Sets the weight of one or more priorities when using \ref scheduling_policy::weighted_fair.
+     *
+     * Each round, every priority is allowed to execute up to its weight in jobs before moving onto the 
+     * next. By default each priority has double the weight of the priority below it.
+     *
+     * \param job_priorities Bitmask of priorities to set the weight of.
+     * \param weight Number of jobs the priorities can execute each round, must be at least 1.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_priority_weight(priority job_priorities, size_t weight);
+
+    /**
+     * \brief Sets how long a priority can go without being serviced before it is promoted when using \ref scheduling_policy::aging.
+     *
+     * \param threshold Time jobs can wait at a priority before it is serviced ahead of higher priorities.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_priority_aging_threshold(timeout threshold);
+
+    /**
+     * \brief Sets how jobs with a deadline are ordered relative to other jobs.
+     *
+     * When not ignored, jobs with a deadline are held in an ordered heap on each worker, 
+     * rather than in the priority queues. Workers take the job with the earliest deadline out of all 
+     * the heaps they can execute jobs from, stealing it from another worker if required.
+     *
+     * \param policy Policy used to order jobs with deadlines.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_deadline_policy(deadline_policy policy);
+
+    /**
+     * \brief Sets if jobs waited on by higher priority jobs inherit the priority of the waiter.
+     *
+     * When a job waits on another job with a lower priority, the waited-on job and any predecessors
+     * it is still waiting for are queued at the priority of the waiter as well as their own. This
+     * stops a high priority job being held up behind a queue of low priority work, or behind a job 
+     * that only a pool which does not execute high priority work can pick up. Boosts last until the
+     * boosted job is next dispatched. Thread-affine jobs, and jobs ordered by deadline or critical path, are not boosted.
+     *
+     * Enabled by default.
+     *
+     * \param enabled True if priority inheritance should be performed.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_priority_inheritance(bool enabled);
+
+    /**
+     * \brief Sets if ready jobs within a priority are ordered by the length of the dependency chain that follows them.
+     *
+     * When enabled, \ref dispatch_batch works out the critical path length of each job in the batch, and every
+     * successor reachable from it - the jobs own cost plus that of the longest chain of successors following it.
+     * Those jobs are held in the same per-worker heaps as jobs with deadlines, and once ready are executed 
+     * longest path first, ahead of other jobs of the same priority. This gets long chains started early so 
+     * they don't dominate the time taken for the whole graph to complete.
+     *
+     * Costs come from \ref job_handle::set_cost_hint, or from the measured execution time of previous jobs
+     * with the same tag. Jobs with a deadline are ordered by that instead.
+     *
+     * \param enabled True if critical path ordering should be performed.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_critical_path_ordering(bool enabled);
+
+    /**
+     * \brief Sets if jobs waiting on a job that has not started yet execute it themselves.
+     *
+     * When a job waits on another job that is still sitting in a queue, the waiter claims it and runs
+     * it directly on its own fiber, rather than suspending until another worker has picked it up and
+     * then being requeued. The waited-on job must have no unfinished predecessors and must be queued
+     * normally - thread-affine, ordered, concurrency limited and instanced jobs are always left to be
+     * picked up from their queues. It must also fit in the part of the waiters fiber stack the waiter 
+     * did not request for itself, and no more than \ref max_inline_wait_depth jobs are nested this way.
+     * Waits with a timeout always suspend.
+     *
+     * While executing inline the job shares the waiters context, so if it waits or yields the waiter 
+     * is suspended along with it.
+     *
+     * Enabled by default.
+     *
+     * \param enabled True if waits should execute unstarted jobs inline.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result set_inline_waits(bool enabled);
     
     /**
      * \brief Initializes this scheduler so it's ready to accept jobs.
@@ -270,6 +542,15 @@ public:
      * \return Value indicating the success of this function.
      */
     result create_counter(counter_handle& instance);
+
+    /**
+     * \brief Creates a new group that jobs can be dispatched into and waited on or cancelled together.
+     *
+     * \param instance On success the created group will be stored here.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result create_group(group_handle& instance);
     
     /**
      * \brief Dispatches multiple jobs for execution in a single go.
@@ -284,6 +565,42 @@ public:
      */
     result dispatch_batch(job_handle* job_array, size_t count);
 
+    /**
+     * \brief Gets statistics gathered since the scheduler was initialized or \ref reset_stats was last called.
+     *
+     * \param stats Reference to store statistics in.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result get_stats(scheduler_stats& stats);
+
+    /**
+     * \brief Resets all statistics returned by \ref get_stats.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result reset_stats();
+
+    /**
+     * \brief Allocates memory using the memory functions the scheduler was configured with.
+     *
+     * Intended for transient buffers needed by work running on the scheduler, such as the
+     * scratch space used by the parallel algorithms. Only valid once the scheduler is initialized.
+     *
+     * \param size Size of block of memory to be allocated.
+     * \param alignment Alignment of block of memory to be allocated.
+     *
+     * \return Pointer to block of memory that was allocated, or nullptr on failure.
+     */
+    void* alloc_memory(size_t size, size_t alignment);
+
+    /**
+     * \brief Frees memory previously allocated with \ref alloc_memory.
+     *
+     * \param ptr Pointer to memory to be deallocated.
+     */
+    void free_memory(void* ptr);
+
     /**
      * \brief Waits until all jobs are complete and the schedulers workers are idle.
      *
@@ -304,6 +621,24 @@ public:
      */
     bool is_idle() const;
 
+    /**
+     * \brief Executes jobs that have been bound to \ref jobs::pump_thread on the calling thread.
+     *
+     * This should be called regularly by the thread that owns the pump-affine jobs (typically the main
+     * or render thread). Jobs are executed until none are left queued or max_time has elapsed. Pump-affine 
+     * jobs that wait or sleep are resumed by a later call to this function once they are ready again, so
+     * all calls should be made from the same thread.
+     *
+     * This cannot be called from a worker thread or from inside a job.
+     *
+     * \param max_time Maximum time to spend executing jobs. Jobs are not pre-empted, so a long running job
+     *                 can cause this to be exceeded.
+     *
+     * \return Value indicating the success of this function. If jobs were still queued when max_time
+     *         elapsed the result will be result::timeout.
+     */
+    result pump(timeout max_time = timeout::infinite);
+
     /**
      * \brief Puts the job or thread to sleep for the given amount of time.
      *
@@ -318,16 +653,67 @@ public:
     static result sleep(timeout duration = timeout::infinite);
 
     /**
-     * \brief Returns the number of logical cores on the system.
+     * \brief Gives up the worker the calling job is running on so other jobs can execute.
+     *
+     * The job is requeued at the back of its queue and the worker moves straight onto the next
+     * job, taken in the usual priority order. Unlike \ref sleep no latent callback is used, so
+     * if nothing else is waiting the job resumes almost immediately. If called from any other 
+     * place, the calling thread yields its time slice.
+     *
+     * \return Value indicating the success of this function.
+     */
+    static result yield();
+
+    /**
+     * \brief Yields the calling job if it has been running for longer than the given quantum.
+     *
+     * This lets long running jobs share workers with latency-sensitive ones by calling this 
+     * periodically. The time is measured from when the job was last resumed by its worker, so 
+     * checking it only costs a read of the clock.
+     *
+     * \param quantum Time the job can run for before yielding.
+     *
+     * \return Value indicating the success of this function.
+     */
+    static result yield_if_expired(timeout quantum);
+
+    /**
+     * \brief Gets the instance index being executed by the calling job.
+     *
+     * Jobs dispatched with \ref job_handle::dispatch_instances use this to find out which 
+     * instance they are executing. Jobs dispatched normally always execute instance 0.
+     *
+     * \param index Reference to store instance index in.
+     *
+     * \return Value indicating the success of this function.
+     */
+    static result get_instance_index(size_t& index);
+
+    /**
+     * \brief Returns the number of logical cores available to the process.
      *
      * This is provided to given a rough idea of the amount of worker 
      * threads that should be spawned by the scheduler to provide maximum
      * utilization of system resources.
      *
-     * \return Number of logical cores on the system.
+     * This takes into account the processors the process has affinity with and any cpu
+     * quota imposed by the container or job object the process runs in, so it may be
+     * considerably lower than the number of processors in the system.
+     *
+     * \return Number of logical cores available to the process.
      */
     static size_t get_logical_core_count();
 
+    /**
+     * \brief Returns the number of numa nodes on the system.
+     *
+     * This can be used to decide how many thread pools to create and which nodes
+     * to bind them to. Systems without numa support will always return 1.
+     *
+     * \return Number of numa nodes on the system.
+     */
+    static size_t get_numa_node_count();
+
     /**
      * \brief Gets the context of the worker management fiber running individual jobs.
      *
@@ -380,6 +766,21 @@ private:
         /** Number of threads in this pool. */
         size_t thread_count = 0;
 
+        /** Numa node the threads in this pool are bound to, or any_numa_node to spread them between nodes. */
+        size_t numa_node = any_numa_node;
+
+        /** Policy deciding which logical processors the threads in this pool are pinned to. */
+        thread_placement placement = thread_placement::logical_cores;
+
+        /** Minimum number of threads that are always active, if less than thread_count the pool is elastic. */
+        size_t min_thread_count = 0;
+
+        /** Number of threads in this pool the elastic load balancing wants active. */
+        std::atomic<size_t> active_thread_count{ 0 };
+
+        /** Maximum number of threads in this pool allowed to be active, derived from the active worker limit. Threads beyond min(active_thread_count, active_thread_limit) are parked. */
+        std::atomic<size_t> active_thread_limit{ 0 };
+
         /** Pool of threads. */
         internal::fixed_pool<internal::thread> pool;
     };
@@ -393,8 +794,11 @@ private:
         /** Number of fibers in this pool. */
         size_t fiber_count = 0;
 
-        /** Pool of fibers. */
-        internal::fixed_pool<internal::fiber> pool;
+        /** Number of fibers in this pool allocated to each numa node. */
+        size_t node_fiber_count[internal::max_numa_nodes] = {};
+
+        /** Pool of fibers for each numa node. */
+        internal::fixed_pool<internal::fiber> pool[internal::max_numa_nodes];
     };
 
     /** Internal representation of a queue of pending tasks */
@@ -402,6 +806,60 @@ private:
     {
         /** Queue of all job indices that are currently pending execution. */
         internal::atomic_queue<size_t> pending_job_indicies;
+
+        /** Time on m_scheduler_timer this queue was last taken from, or became non-empty. Only maintained when aging. */
+        std::atomic<uint64_t> last_service_time{ 0 };
+    };
+
+    /** Average execution time of jobs with a given tag. */
+    struct cost_history_entry
+    {
+        /** Hash of tag, or 0 if entry is unused. */
+        std::atomic<uint64_t> tag_hash{ 0 };
+
+        /** Moving average of execution time in microseconds. */
+        std::atomic<uint64_t> average_cost{ 0 };
+    };
+
+    /** Entry in an ordered queue. */
+    struct ordered_entry
+    {
+        /** Sort key, lower keys are executed first. */
+        uint64_t key;
+
+        /** Priority queue mask of the job. */
+        uint64_t queue_mask;
+
+        /** Index of the job. */
+        size_t job_index;
+
+        /** Orders entries so a heap built with std::greater has the lowest key at the top. */
+        bool operator>(const ordered_entry& other) const
+        {
+            return key > other.key;
+        }
+    };
+
+    /** Internal representation of a heap of jobs ordered by deadline or critical path. */
+    struct ordered_queue
+    {
+        /** Lock that must be held while modifying the heap. */
+        internal::spinwait_mutex lock;
+
+        /** Binary min-heap of entries, ordered by key. */
+        ordered_entry* entries = nullptr;
+
+        /** Number of entries in heap. */
+        size_t count = 0;
+
+        /** Maximum number of entries in heap. */
+        size_t capacity = 0;
+
+        /** Key of the entry at the top of the heap, or UINT64_MAX if empty. Allows other workers to look for work without locking. */
+        std::atomic<uint64_t> top_key{ UINT64_MAX };
+
+        /** Queue mask of the entry at the top of the heap. */
+        std::atomic<uint64_t> top_queue_mask{ 0 };
     };
 
 protected:
@@ -409,9 +867,12 @@ protected:
     friend class job_handle;
     friend class event_handle;
     friend class counter_handle;
+    friend class group_handle;
     friend class internal::job_context;
     friend class internal::callback_scheduler;
     friend class internal::profile_scope_internal;
+    friend class internal::future_access;
+    friend result ebr::retire(scheduler& scheduler, void* object, ebr::reclaim_function reclaim);
 
     /**
      * \brief Gets a job definition by its pool index.
@@ -454,78 +915,413 @@ protected:
      * \brief Dispatches a job for execution given it's pool index.
      *
      * \param index Index of job to dispatch.
+     * \param enqueue If false the job is left pending without being queued, for the caller to claim.
      *
      * \return Value indicating the success of this function.
      */
-    result dispatch_job(size_t index);
+    result dispatch_job(size_t index, bool enqueue = true);
 
     /**
-     * \brief Requeues a job that has previously been picked up for execution.
-     *
-     * This is primarily used when requeueing a job following it being readied
-     * by a condition it is waiting on being fulfilled (counter getting to value, job completing, etc).
+     * \brief Resets the per-dispatch state of a job that is about to be dispatched.
      *
-     * \param index Index of job to requeue.
+     * Shared by \ref dispatch_job and \ref dispatch_batch. This does not start the jobs active job 
+     * accounting or queue the job, as batches do those for every job at once.
      *
-     * \return Value indicating the success of this function.
+     * \param def Definition of job being dispatched.
+     * \param dispatch_time Time on the schedulers timer, in microseconds, the job is being dispatched at.
      */
-    result requeue_job(size_t index);
+    void prepare_job_dispatch(internal::job_definition& def, uint64_t dispatch_time);
 
     /**
-     * \brief Requeues a quantity of jobs that have previously been picked up for execution.
-     *
-     * This works the same as \ref requeue_job except it combines a lot of the overhead to reduce
-     * the overall execution time.
+     * \brief Dispatches a job and switches the calling worker straight to it, leaving the calling job queued.
      *
-     * \param job_array Array of job handles to requeue.
-     * \param count Number of job handles in job_array.
-     * \param job_queues Bitmaks of queues that jobs should be enqueued in (only if their priority mask also contains the queue).
+     * \param index Index of job to dispatch.
      *
      * \return Value indicating the success of this function.
      */
-    result requeue_job_batch(job_handle* job_array, size_t count, size_t job_queues);
+    result dispatch_job_child_first(size_t index);
 
     /**
-     * \brief Gets the next available job from the highest priority queue available.
+     * \brief Determines if a job can hand its worker over to a job it is dispatching.
      *
-     * \param job_index Reference to store retrieved job index in.
-     * \param priorities Priority queues to look for jobs in.
-     * \param can_block If true the function will block until a job is available. Otherwise
-     *                  the return value can be used to determine if a job was found.
+     * \param parent Job doing the dispatching.
+     * \param child Job being dispatched.
      *
-     * \return True if a job was retrieved.
+     * \return True if the child can be dispatched child-first.
      */
-    bool get_next_job(size_t& job_index, priority priorities, bool can_block);
+    bool can_spawn_child_first(const internal::job_definition& parent, const internal::job_definition& child);
 
     /**
-     * \brief Gets the next available job a given queue.
+     * \brief Dispatches a job that executes its work for a range of instance indices.
      *
-     * \param job_index Reference to store retrieved job index in.
-     * \param queue Queue to retrieve job from.
-     * \param queue_mask Priority mask of queue.
+     * \param index Index of job to dispatch.
+     * \param count Number of instances to execute.
+     * \param grain Number of instances claimed at a time.
      *
-     * \return True if a job was retrieved.
+     * \return Value indicating the success of this function.
      */
-    bool get_next_job_from_queue(size_t& job_index, job_queue& queue, size_t queue_mask);
+    result dispatch_job_instances(size_t index, size_t count, size_t grain);
 
     /**
-     * \brief Completes the given job index.
+     * \brief Executes all the instances of the job running on the calling fiber.
      *
-     * When called this will perform any completion processing required by the job, this includes
-     * waking up successors, incrementing counters and so on.
+     * Helper jobs are dispatched so idle workers can claim instances alongside the calling job, which
+     * waits for them before returning.
      *
-     * \param job_index Job index to complete.
+     * \param definition Job to execute instances of.
      */
-    void complete_job(size_t job_index);
+    void execute_job_instances(internal::job_definition& definition);
 
     /**
-     * \brief Waits for a job to complete.
-     *
-     * If called from a job this is non-blocking, and will queue the job
-     * for execution after the given job completes. If called
-     * from any other place, it will block.
+     * \brief Claims and executes instances of a job until there are none left.
      *
-     * \param job_handle Job to wait for completion of.
+     * \param definition Job whose instances are claimed.
+     */
+    void run_job_instances(internal::job_definition& definition);
+
+    /**
+     * \brief Requeues a job that has previously been picked up for execution.
+     *
+     * This is primarily used when requeueing a job following it being readied
+     * by a condition it is waiting on being fulfilled (counter getting to value, job completing, etc).
+     *
+     * \param index Index of job to requeue.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result requeue_job(size_t index);
+
+    /**
+     * \brief Requeues a quantity of jobs that have previously been picked up for execution.
+     *
+     * This works the same as \ref requeue_job except it combines a lot of the overhead to reduce
+     * the overall execution time.
+     *
+     * \param job_array Array of job handles to requeue.
+     * \param count Number of job handles in job_array.
+     * \param job_queues Bitmaks of queues that jobs should be enqueued in (only if their priority mask also contains the queue).
+     *
+     * \return Value indicating the success of this function.
+     */
+    result requeue_job_batch(job_handle* job_array, size_t count, uint64_t job_queues);
+
+    /**
+     * \brief Requeues a job that is bound to a specific thread into the queue of that thread.
+     *
+     * \param index Index of job to requeue.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result requeue_affine_job(size_t index);
+
+    /**
+     * \brief Gets the worker a job should be queued on, either from its affinity key or the worker it last ran on.
+     *
+     * \param definition Job to get preferred worker of.
+     *
+     * \return Index of worker, or SIZE_MAX if the job should go in the shared queues.
+     */
+    size_t get_preferred_worker(const internal::job_definition& definition);
+
+    /**
+     * \brief Requeues a job into the local queue of the worker it prefers.
+     *
+     * \param index Index of job to requeue.
+     * \param worker_index Index of worker to queue job on.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result requeue_local_job(size_t index, size_t worker_index);
+
+    /**
+     * \brief Requeues a job with a deadline or critical path into the ordered queue of a worker able to execute it.
+     *
+     * The calling worker's queue is used if it can execute the job, otherwise workers are chosen round-robin.
+     *
+     * \param index Index of job to requeue.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result requeue_ordered_job(size_t index);
+
+    /**
+     * \brief Gets the next job with the lowest key out of all workers ordered queues.
+     *
+     * Jobs are never taken ahead of a higher priority with jobs waiting in the priority queues, except for 
+     * jobs with deadlines when using \ref deadline_policy::across_priorities.
+     *
+     * \param job_index Reference to store retrieved job index in.
+     * \param priorities Priority queues to look for jobs in.
+     *
+     * \return True if a job was retrieved.
+     */
+    bool get_next_ordered_job(size_t& job_index, priority priorities);
+
+    /**
+     * \brief Removes the entry with the lowest key that can be executed from an ordered queue. The queue's lock must be held.
+     *
+     * \param queue Queue to remove entry from.
+     * \param priorities Priority queues the caller is able to execute.
+     * \param key_limit Only entries with a key lower than this are removed.
+     * \param entry Reference to store the removed entry in.
+     *
+     * \return True if an entry was removed.
+     */
+    bool pop_ordered_entry(ordered_queue& queue, priority priorities, uint64_t key_limit, ordered_entry& entry);
+
+    /**
+     * \brief Gets if a job should be placed in an ordered queue rather than the priority queues.
+     *
+     * \param definition Job to check.
+     *
+     * \return True if job should be placed in an ordered queue.
+     */
+    bool is_ordered_queued(const internal::job_definition& definition);
+
+    /**
+     * \brief Gets if a job belongs to a group with a concurrency limit.
+     *
+     * \param definition Job to check.
+     *
+     * \return True if job has to be admitted by its group before being queued.
+     */
+    bool is_concurrency_limited(const internal::job_definition& definition);
+
+    /**
+     * \brief Attempts to admit a job under its groups concurrency limit.
+     *
+     * If the group is at its limit the job is held by the group until \ref release_concurrency_limit
+     * makes room for it.
+     *
+     * \param definition Job to admit.
+     *
+     * \return True if the job was admitted and can be queued.
+     */
+    bool admit_concurrency_limited_job(internal::job_definition& definition);
+
+    /**
+     * \brief Releases a completed jobs place under its groups concurrency limit, queueing the next held job if there is one.
+     *
+     * \param definition Job that has completed.
+     */
+    void release_concurrency_limit(internal::job_definition& definition);
+
+    /**
+     * \brief Records the completion of a job with a deadline in the scheduler statistics.
+     *
+     * \param definition Job that has completed.
+     */
+    void record_deadline_completion(const internal::job_definition& definition);
+
+    /**
+     * \brief Boosts a job, and transitively everything it is waiting on, to at least the highest priority in a queue mask.
+     *
+     * \param job_index Index of job to boost.
+     * \param queue_mask Queue mask of the waiting job whose priority should be inherited.
+     * \param depth Number of jobs between this one and the original waiter.
+     *
+     * \return Number of jobs that were boosted.
+     */
+    size_t inherit_priority(size_t job_index, uint64_t queue_mask, size_t depth = 0);
+
+    /**
+     * \brief Claims a job that has not started yet and executes it on the calling jobs fiber.
+     *
+     * \param context Context of the job waiting on the job.
+     * \param job_index Index of job to execute.
+     *
+     * \return True if the job was executed and completed, false if it could not be claimed.
+     */
+    bool try_execute_job_inline(internal::job_context& context, size_t job_index);
+
+    /**
+     * \brief Gets the amount of stack a job may use. Jobs that don't set a stack size may use all of the smallest fiber's stack.
+     *
+     * \param definition Job to get stack size of.
+     *
+     * \return Stack size in bytes.
+     */
+    size_t get_job_stack_size(const internal::job_definition& definition);
+
+    /**
+     * \brief Calculates the critical path length of every job in an array, and every successor reachable from them.
+     *
+     * \param job_array Array of jobs to calculate critical path of.
+     * \param count Number of jobs in job_array.
+     */
+    void calculate_critical_paths(job_handle* job_array, size_t count);
+
+    /**
+     * \brief Gets the estimated execution time of a job.
+     *
+     * \param definition Job to get the cost of.
+     *
+     * \return Estimated execution time in microseconds.
+     */
+    uint64_t get_job_cost(const internal::job_definition& definition);
+
+    /**
+     * \brief Records the execution time of a completed job against its tag, for use in future cost estimates.
+     *
+     * \param definition Job that has completed.
+     */
+    void record_job_cost(const internal::job_definition& definition);
+
+    /**
+     * \brief Gets the slot in the cost history table used by a given tag.
+     *
+     * \param tag Tag to look up.
+     * \param create If true and the tag has no slot, one will be assigned if the table is not full.
+     *
+     * \return Pointer to slot, or nullptr if none was found.
+     */
+    cost_history_entry* get_cost_history_entry(const char* tag, bool create);
+
+    /**
+     * \brief Gets the next available job from the highest priority queue available.
+     *
+     * Queues on the calling workers numa node are always searched first, queues on other
+     * nodes are only searched (stolen from) once all local queues are empty.
+     *
+     * \param job_index Reference to store retrieved job index in.
+     * \param priorities Priority queues to look for jobs in.
+     * \param can_block If true the function will block until a job is available. Otherwise
+     *                  the return value can be used to determine if a job was found.
+     *
+     * \return True if a job was retrieved.
+     */
+    bool get_next_job(size_t& job_index, priority priorities, bool can_block);
+
+    /**
+     * \brief Gets the next available job a given queue.
+     *
+     * \param job_index Reference to store retrieved job index in.
+     * \param queue Queue to retrieve job from.
+     * \param queue_mask Priority mask of queue, or 0 if this is a thread-affine queue.
+     *
+     * \return True if a job was retrieved. The caller is responsible for reducing the count of available jobs.
+     */
+    bool get_next_job_from_queue(size_t& job_index, job_queue& queue, uint64_t queue_mask);
+
+    /**
+     * \brief Gets the next available job from a workers local queue.
+     *
+     * \param job_index Reference to store retrieved job index in.
+     * \param worker_index Index of worker whose queue the job should be taken from.
+     *
+     * \return True if a job was retrieved.
+     */
+    bool get_next_job_from_local_queue(size_t& job_index, size_t worker_index);
+
+    /**
+     * \brief Takes a job from the local queue of any worker, starting with the calling worker.
+     *
+     * \param job_index Reference to store retrieved job index in.
+     * \param priorities Bitmask of priorities the calling worker can execute.
+     *
+     * \return True if a job was retrieved.
+     */
+    bool steal_local_job(size_t& job_index, priority priorities);
+
+    /**
+     * \brief Gets the next available job of a single priority, from the local numa node first then any other.
+     *
+     * \param job_index Reference to store retrieved job index in.
+     * \param priority_index Index of priority queue to retrieve job from.
+     *
+     * \return True if a job was retrieved.
+     */
+    bool get_next_job_from_priority(size_t& job_index, size_t priority_index);
+
+    /**
+     * \brief Gets the next available job from a single priority queue on a given numa node.
+     *
+     * If the queue is found to be empty it is removed from the nodes ready bitmap.
+     *
+     * \param job_index Reference to store retrieved job index in.
+     * \param numa_node Numa node of queue to retrieve job from.
+     * \param priority_index Index of priority queue to retrieve job from.
+     *
+     * \return True if a job was retrieved.
+     */
+    bool get_next_job_from_node(size_t& job_index, size_t numa_node, size_t priority_index);
+
+    /**
+     * \brief Pushes a job into a single priority queue on a given numa node.
+     *
+     * \param job_index Index of job to push.
+     * \param numa_node Numa node of queue to push job into.
+     * \param priority_index Index of priority queue to push job into.
+     */
+    void push_to_queue(size_t job_index, size_t numa_node, size_t priority_index);
+
+    /**
+     * \brief Gets the next job as chosen by deficit round-robin between priorities.
+     *
+     * \param job_index Reference to store retrieved job index in.
+     * \param priorities Priority queues to look for jobs in.
+     *
+     * \return True if a job was retrieved.
+     */
+    bool get_next_weighted_fair_job(size_t& job_index, priority priorities);
+
+    /**
+     * \brief Gets the next job from whichever queue has gone unserviced the longest, if longer than the aging threshold.
+     *
+     * \param job_index Reference to store retrieved job index in.
+     * \param priorities Priority queues to look for jobs in.
+     *
+     * \return True if a job was retrieved.
+     */
+    bool get_next_aged_job(size_t& job_index, priority priorities);
+
+    /**
+     * \brief Records that a job is about to be pushed into the given queue.
+     *
+     * \param queue Queue job is being pushed into.
+     */
+    void on_queue_push(job_queue& queue);
+
+    /**
+     * \brief Gets the mask of queues a job should be placed in.
+     *
+     * Jobs with multiple priorities are placed into the single highest priority queue that every 
+     * thread pool able to execute the job looks in. Only if no such queue exists is the job placed
+     * into one queue for each of its priorities.
+     *
+     * \param definition Job to get queue mask for.
+     *
+     * \return Bitmask of priority queues to place job in.
+     */
+    uint64_t get_job_queue_mask(const internal::job_definition& definition);
+
+    /**
+     * \brief Completes the given job index.
+     *
+     * When called this will perform any completion processing required by the job, this includes
+     * waking up successors, incrementing counters and so on.
+     *
+     * \param job_index Job index to complete.
+     */
+    void complete_job(size_t job_index);
+
+    /**
+     * \brief Gets if a job has been dispatched and has not yet completed.
+     *
+     * \param job_index Index of job to check, or SIZE_MAX for none.
+     *
+     * \return True if the job is still outstanding.
+     */
+    bool is_job_outstanding(size_t job_index);
+
+    /**
+     * \brief Waits for a job to complete.
+     *
+     * If called from a job this is non-blocking, and will queue the job
+     * for execution after the given job completes. If called
+     * from any other place, it will block.
+     *
+     * \param job_handle Job to wait for completion of.
      * \param wait_timeout If provided, this function will wait a maximum of this time. If
      *                     the function returns due to a timeout the result provided will be
      *                     result::timeout.
@@ -561,28 +1357,138 @@ protected:
      */
     result add_job_dependency(size_t successor, size_t predecessor);
 
+    /**
+     * \brief Allocates a slot to hold the value produced by a job.
+     *
+     * The slot is freed, and any value in it destroyed, when the job is freed.
+     *
+     * \param job_index Index of job to allocate slot for.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result alloc_job_result(size_t job_index);
+
+    /**
+     * \brief Adds an object to the retire list of the calling worker, or the shared list if not called from a worker.
+     *
+     * \param object Object to reclaim.
+     * \param reclaim Function called to reclaim the object.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result retire_object(void* object, ebr::reclaim_function reclaim);
+
+    /**
+     * \brief Called by workers between jobs, when they can't be holding a pointer to any retired object.
+     *
+     * Announces that the calling worker has seen the current global epoch, and if there are objects
+     * waiting to be reclaimed tries to advance the epoch and reclaims any that are now safe.
+     */
+    void enter_quiescent_state();
+
+    /**
+     * \brief Marks the calling worker as holding no pointers to retired objects until it next enters a quiescent state.
+     *
+     * Called before a worker blocks, so idle workers don't hold up reclamation. Anything left in the
+     * workers retire list is moved to the shared list, so other workers can reclaim it in the meantime.
+     */
+    void enter_offline_state();
+
+    /**
+     * \brief Advances the global epoch if every worker not offline has seen the current one.
+     *
+     * \return True if the epoch was advanced.
+     */
+    bool try_advance_epoch();
+
+    /**
+     * \brief Reclaims all objects in a retire list that were retired at least two epochs ago.
+     *
+     * \param list List to reclaim objects from.
+     * \param epoch Global epoch to compare against.
+     */
+    void reclaim_retired_objects(internal::retire_list& list, uint64_t epoch);
+
+    /**
+     * \brief Adds a continuation that is released when a job completes.
+     *
+     * Unlike dependencies, continuations can be added while the job is running or after it has 
+     * completed, in which case the continuation is released immediately.
+     *
+     * \param job_index Index of job that should complete first.
+     * \param continuation_index Index of dispatched job to release.
+     *
+     * \return Value indicating the success of this function.
+     */
+    result add_job_continuation(size_t job_index, size_t continuation_index);
+
+    /**
+     * \brief Releases all the continuations of a job, called when the job completes.
+     *
+     * \param job_index Index of job whose continuations should be released.
+     */
+    void release_job_continuations(size_t job_index);
+
+    /**
+     * \brief Releases a continuation, queueing it once it has been released by enough of the jobs it continues.
+     *
+     * \param continuation_index Index of continuation to release.
+     */
+    void release_continuation(size_t continuation_index);
+
     /**
      * \brief Attempts to allocate a fiber out of the available fiber pools with the required stack size.
      *
-     * Allocation will always be attempted from pools with the smallest stack size first.
+     * Allocation will always be attempted from pools with the smallest stack size first, and within
+     * each pool from the fibers local to the calling threads numa node first.
      *
      * \param required_stack_size Minimum stack size required for allocated fiber.
      * \param fiber_index Reference to store index of allocated fiber.
      * \param fiber_pool_index Reference to store pool index of allocated fiber.
+     * \param fiber_numa_node Reference to store numa node of allocated fiber.
      *
      * \return Value indicating the success of this function.
      */
-    result allocate_fiber(size_t required_stack_size, size_t& fiber_index, size_t& fiber_pool_index);
+    result allocate_fiber(size_t required_stack_size, size_t& fiber_index, size_t& fiber_pool_index, size_t& fiber_numa_node);
 
     /**
      * \brief Frees a fiber allocated with \ref allocate_fiber, so it can be recycled later.
      *
      * \param fiber_index Index of allocated fiber.
      * \param fiber_pool_index Pool index of allocated fiber.
+     * \param fiber_numa_node Numa node of allocated fiber.
      *
      * \return Value indicating the success of this function.
      */
-    result free_fiber(size_t fiber_index, size_t fiber_pool_index);
+    result free_fiber(size_t fiber_index, size_t fiber_pool_index, size_t fiber_numa_node);
+
+    /**
+     * \brief Gets the fiber assigned to the given job context.
+     *
+     * \param context Context to get fiber of.
+     *
+     * \return Fiber assigned to context.
+     */
+    internal::fiber* get_context_fiber(internal::job_context& context);
+
+    /**
+     * \brief Gets the numa node of the calling thread.
+     *
+     * For worker threads this is the node the worker is bound to, for any other thread
+     * its the node it is currently executing on.
+     *
+     * \return Index of numa node of calling thread.
+     */
+    size_t get_current_numa_node();
+
+    /**
+     * \brief Gets the numa node whose queues a job should be placed in.
+     *
+     * \param definition Job to get numa node for.
+     *
+     * \return Index of numa node job should be queued on.
+     */
+    size_t get_job_numa_node(const internal::job_definition& definition);
 
     /**
      * \brief Leaves the given job execution context in preperation for entering another.
@@ -677,22 +1583,160 @@ protected:
      */
     void decrease_counter_ref_count(size_t index);
 
+    /**
+     * \brief Gets a group definition by its pool index.
+     *
+     * \param index Index into the group pool of definition to retrieve.
+     *
+     * \return Group definition at the given index.
+     */
+    JOBS_FORCE_INLINE internal::group_definition& get_group_definition(size_t index)
+    {
+        return *m_group_pool.get_index(index);
+    }
+
+    /**
+     * \brief Free's a group based on its pool index.
+     *
+     * The group will be recycled later.
+     *
+     * \param index Index of group to free.
+     */
+    void free_group(size_t index);
+
+    /**
+     * \brief Increases the reference count of the group based on it's pool index.
+     *
+     * \param index Index of group to increment ref count of.
+     */
+    void increase_group_ref_count(size_t index);
+
+    /**
+     * \brief Decreases the reference count of the group based on it's pool index.
+     *
+     * If the reference count goes to 0 the group will be automatically freed.
+     *
+     * \param index Index of group to decrement ref count of.
+     */
+    void decrease_group_ref_count(size_t index);
+
     /**
      * \brief Notifies any workers that a given number of jobs are available for processing.
      *
      * \param job_count Number of jobs that are newly available.
+     * \param queue_mask Mask of the priority queues the jobs were queued in.
      */
-    void notify_job_available(size_t job_count = 1);
+    void notify_job_available(size_t job_count = 1, uint64_t queue_mask = UINT64_MAX);
 
     /**
-     * \brief Notifies any waiting workers that a job has completed.
+     * \brief Wakes idle workers that can execute jobs from the given queues.
+     *
+     * \param count Maximum number of workers to wake.
+     * \param queue_mask Mask of the priority queues the woken workers should be able to execute.
+     */
+    void wake_idle_workers(size_t count, uint64_t queue_mask);
+
+    /**
+     * \brief Wakes a single worker, whether it is waiting for a job or parked.
+     *
+     * \param worker_index Index of worker to wake.
+     */
+    void wake_worker(size_t worker_index);
+
+    /**
+     * \brief Wakes parked workers so they can check if they are still parked. m_worker_unparked_mutex must be held.
+     *
+     * \param pool_index Index of the thread pool whose workers to wake, or SIZE_MAX for all workers.
+     */
+    void notify_parked_workers(size_t pool_index = SIZE_MAX);
+
+    /**
+     * \brief Pushes a worker onto the idle worker stack. m_task_available_mutex must be held.
+     *
+     * \param worker_index Index of worker that is about to block.
+     */
+    void add_idle_worker(size_t worker_index);
+
+    /**
+     * \brief Removes a worker from the idle worker stack. m_task_available_mutex must be held.
+     *
+     * \param worker_index Index of worker to remove, it must be on the stack.
+     */
+    void remove_idle_worker(size_t worker_index);
+
+    /**
+     * \brief Notifies any threads blocked in \ref wait_until_idle that the scheduler has become idle.
      */
     void notify_job_complete();
 
     /**
      * \brief Blocks until a new job has been singled as being available by \ref notify_job_available.
+     *
+     * \param wait_timeout Maximum time to wait for a job.
+     */
+    void wait_for_job_available(timeout wait_timeout = timeout::infinite);
+
+    /**
+     * \brief Re-queries the number of cores available to the process if the poll interval has elapsed.
+     *
+     * Only one thread will perform the query per interval, all others return immediately.
+     */
+    void poll_available_cores();
+
+    /**
+     * \brief Distributes the active worker limit between thread pools, parking or unparking workers to match.
+     *
+     * The limit used is the lower of the available core count (if tracked) and the user-defined active worker limit.
+     */
+    void update_active_worker_limits();
+
+    /**
+     * \brief Gets the priority levels that have jobs waiting in the shared queues of any node.
+     *
+     * \return Bitmask of priority levels with queued jobs.
+     */
+    uint64_t get_ready_priorities();
+
+    /**
+     * \brief Activates an additional worker in an elastic thread pool if queued jobs outnumber idle workers.
+     *
+     * \param queue_mask Mask of the priority queues holding the waiting jobs. Only pools that can execute 
+     *                   jobs from one of these queues are grown.
+     */
+    void grow_active_workers(uint64_t queue_mask);
+
+    /**
+     * \brief Gets if the calling worker belongs to an elastic thread pool.
+     *
+     * \return True if worker is elastic.
+     */
+    bool is_worker_elastic();
+
+    /**
+     * \brief Gets if the calling worker is the last active worker of an elastic pool, and is allowed to retire.
+     *
+     * \return True if worker can retire.
      */
-    void wait_for_job_available();
+    bool can_worker_retire();
+
+    /**
+     * \brief Retires the calling worker, reducing the active thread count of its pool.
+     *
+     * \return True if the worker was retired.
+     */
+    bool retire_worker();
+
+    /**
+     * \brief Gets if the calling worker has been parked and should not execute jobs.
+     *
+     * \return True if worker is parked.
+     */
+    bool is_worker_parked();
+
+    /**
+     * \brief Blocks the calling worker until it is unparked or the scheduler is destroyed.
+     */
+    void park_worker();
 
 private:
 
@@ -702,6 +1746,12 @@ private:
     /** Default memory deallocation function */
     static void default_free(void* ptr);
 
+    /** Default numa-aware memory allocation function */
+    static void* default_alloc_numa(size_t size, size_t alignment, size_t numa_node);
+
+    /** Default numa-aware memory deallocation function */
+    static void default_free_numa(void* ptr);
+
     /** Entry point for all worker threads. */
     void worker_entry_point(size_t pool_index, size_t worker_index, const internal::thread& this_thread, const thread_pool& thread_pool);
 
@@ -718,6 +1768,32 @@ private:
      */
     bool execute_next_job(priority job_priorities, bool can_block);
 
+    /**
+     * Executes the given job on the calling thread until it completes or yields, followed by any 
+     * jobs it handed the worker over to and their continuations.
+     *
+     * \param job_index Index of job to execute, must already have been picked up from a queue.
+     */
+    void execute_job(size_t job_index);
+
+    /**
+     * Executes the given job on the calling thread until it completes or yields.
+     *
+     * \param job_index Index of job to execute, must already have been picked up from a queue.
+     */
+    void execute_job_slice(size_t job_index);
+
+    /**
+     * Gets the next job the calling worker should run without going through the queues. This is
+     * a job dispatched child-first, or failing that the most recent continuation of one that
+     * has not been stolen.
+     *
+     * \param job_index Reference to store the index of the job in.
+     *
+     * \return True if a job was claimed.
+     */
+    bool get_next_local_job(size_t& job_index);
+
     /** 
      * \brief Executes the job assinged to the fiber we are running within. 
      * 
@@ -740,6 +1816,21 @@ private:
     /** Maximum size of each log message. */
     static const int max_log_size = 256;
 
+    /** Maximum length of a chain of waits and predecessors that priority inheritance will be followed through. */
+    static const size_t max_priority_inheritance_depth = 16;
+
+    /** Maximum number of continuations of child-first dispatches each worker keeps to resume itself. */
+    static const size_t max_child_first_depth = 32;
+
+    /** Maximum number of jobs that can be nested on a single fiber by executing them inline when waited on. */
+    static const size_t max_inline_wait_depth = 4;
+
+    /** Number of distinct tags execution time history is kept for. */
+    static const size_t max_cost_history_entries = 256;
+
+    /** Nominal cost in microseconds of a job with no cost hint or history. */
+    static const uint64_t default_job_cost = 1;
+
     /** Maximum number of jobs this scheduler can handle concurrently. */
     size_t m_max_jobs = 100;
 
@@ -752,9 +1843,18 @@ private:
     /** Maximum number of counters we can have. */
     size_t m_max_counters = 100;
 
+    /** Maximum number of groups we can have. */
+    size_t m_max_groups = 100;
+
     /** Maximum number of callbacks we can have. */
     size_t m_max_callbacks = 100;
 
+    /** Maximum number of future result slots we can have. */
+    size_t m_max_futures = 100;
+
+    /** Maximum number of retired objects waiting to be reclaimed we can have. */
+    size_t m_max_retired_objects = 1000;
+
 private:
 
     /** User-defined memory allocation functions. */
@@ -763,6 +1863,15 @@ private:
     /** Trampolined memory functions that also log allocations. */
     memory_functions m_memory_functions;
 
+    /** Arenas small node-local allocations are carved from. Declared before anything allocated from them so they are destroyed last. */
+    internal::numa_arena m_numa_arenas[internal::max_numa_nodes];
+
+    /** Trampolined memory functions that allocate memory local to each numa node. */
+    memory_functions m_numa_memory_functions[internal::max_numa_nodes];
+
+    /** Number of numa nodes work is distributed between. */
+    size_t m_numa_node_count = 1;
+
     /** User-defined profiling functions. */
     profile_functions m_profile_functions;
 
@@ -814,14 +1923,23 @@ private:
     /** Total memory alloacted */
     std::atomic<size_t> m_total_memory_allocated{ 0 };
 
-    /** Pending job queues, one for each priority. */
-    job_queue m_pending_job_queues[(int)priority::count];
+    /** Pending job queues, one for each priority level on each numa node. */
+    job_queue m_pending_job_queues[internal::max_numa_nodes][max_priority_levels];
+
+    /** Bitmap of the priority levels on each numa node that may have jobs queued. */
+    std::atomic<uint64_t> m_ready_priorities[internal::max_numa_nodes] = {};
+
+    /** Number of priority levels jobs can be queued at. */
+    size_t m_priority_level_count = (size_t)priority::count;
+
+    /** Bitmask with a bit set for each priority level. */
+    uint64_t m_priority_level_mask = ((uint64_t)1 << (size_t)priority::count) - 1;
 
     /** Task available mutex */
     std::mutex m_task_available_mutex;
 
-    /** Task available condition variable */
-    std::condition_variable m_task_available_cvar;
+    /** Indices of workers blocked waiting for a job, most recently idle last. Protected by m_task_available_mutex. */
+    size_t* m_idle_workers = nullptr;
 
     /** Task complete mutex */
     std::mutex m_task_complete_mutex;
@@ -829,18 +1947,138 @@ private:
     /** Task complete condition variable */
     std::condition_variable m_task_complete_cvar;
 
-    /** Number of jobs that have been dispatched but not completed yet. */
-    std::atomic<size_t> m_active_job_count{ 0 };
+    /** Number of jobs that have been dispatched but not completed yet. Only summed when checking for idle. */
+    internal::sharded_activity_counter m_active_jobs;
 
     /** Number of jobs waiting in queues to be executed. */
-    std::atomic<size_t> m_available_jobs{ 0 };
+    internal::sharded_activity_counter m_available_jobs;
+
+    /** Number of non-job threads blocked in \ref wait_until_idle. Completions only check for idle while this is non-zero. */
+    std::atomic<size_t> m_idle_waiter_count{ 0 };
+
+    /** True if the number of cores available to the process is being tracked. */
+    bool m_track_available_cores = false;
+
+    /** Minimum time between queries of the number of available cores. */
+    timeout m_available_cores_poll_interval = timeout(1000);
+
+    /** Timer used to determine when available cores should next be queried. */
+    internal::stopwatch m_available_cores_timer;
+
+    /** Time on m_available_cores_timer at which the available core count should next be queried. */
+    std::atomic<uint64_t> m_available_cores_next_poll{ 0 };
+
+    /** Last queried number of cores available to the process. */
+    std::atomic<size_t> m_available_core_count{ 0 };
+
+    /** User-defined limit of active workers. */
+    std::atomic<size_t> m_active_worker_limit{ SIZE_MAX };
+
+    /** Policy used to choose which priority queue workers take jobs from. */
+    scheduling_policy m_scheduling_policy = scheduling_policy::strict_priority;
+
+    /** Weight of each priority when using the weighted fair scheduling policy. */
+    size_t m_priority_weights[max_priority_levels];
+
+    /** Time a priority can go unserviced before being promoted when using the aging scheduling policy. */
+    timeout m_priority_aging_threshold = timeout(10);
+
+    /** Timer started on initialization, used to timestamp queue activity. */
+    internal::stopwatch m_scheduler_timer;
+
+    /** Policy used to order jobs with deadlines. */
+    deadline_policy m_deadline_policy = deadline_policy::ignored;
+
+    /** Number of jobs currently held in ordered queues. */
+    std::atomic<size_t> m_ordered_job_count{ 0 };
+
+    /** Next worker to try when an ordered job is queued from a thread that cannot execute it. */
+    std::atomic<size_t> m_ordered_queue_cursor{ 0 };
+
+    /** Number of jobs with a deadline that have completed. */
+    std::atomic<size_t> m_stat_deadline_jobs_completed{ 0 };
+
+    /** Number of jobs that completed after their deadline. */
+    std::atomic<size_t> m_stat_deadline_misses{ 0 };
+
+    /** Largest time in microseconds any job completed after its deadline. */
+    std::atomic<uint64_t> m_stat_max_deadline_overrun_us{ 0 };
+
+    /** True if jobs inherit the priority of higher priority jobs waiting on them. */
+    bool m_priority_inheritance = true;
+
+    /** Number of waits that resulted in priority inheritance. */
+    std::atomic<size_t> m_stat_priority_inversions{ 0 };
+
+    /** Number of jobs boosted by priority inheritance. */
+    std::atomic<size_t> m_stat_priority_boosts{ 0 };
+
+    /** True if jobs in dependency graphs are ordered by critical path within each priority. */
+    bool m_critical_path_ordering = false;
+
+    /** True if waiting on a job that has not started yet executes it inline. */
+    bool m_inline_waits = true;
+
+    /** Number of waits satisfied by executing the job inline. */
+    std::atomic<size_t> m_stat_inline_waits{ 0 };
+
+    /** Number of jobs waiting in the local queues of all workers, including ones that have since been claimed elsewhere. */
+    std::atomic<size_t> m_local_job_count{ 0 };
+
+    /** Number of jobs executed by a worker other than the one they were queued on. */
+    std::atomic<size_t> m_stat_local_steals{ 0 };
+
+    /** Mutex held while calculating critical paths. */
+    std::mutex m_critical_path_mutex;
+
+    /** Index of the last critical path calculation, used to mark visited jobs. */
+    size_t m_critical_path_pass = 0;
+
+    /** Stack of job indices used to walk dependency graphs without recursion. Has room for every job. */
+    size_t* m_critical_path_stack = nullptr;
+
+    /** Execution time history of jobs, indexed by a hash of their tag. */
+    cost_history_entry m_cost_history[max_cost_history_entries];
+
+    /** True if any thread pools are elastic. */
+    bool m_has_elastic_pools = false;
+
+    /** Time an elastic worker must be idle before it retires. */
+    timeout m_worker_idle_timeout = timeout(100);
+
+    /** Number of active workers currently waiting for a job to become available. */
+    std::atomic<size_t> m_idle_worker_count{ 0 };
+
+    /** Worker unparked mutex */
+    std::mutex m_worker_unparked_mutex;
 
     /** Pool of dependencies to be allocated. */
     internal::fixed_pool<internal::job_dependency> m_job_dependency_pool;
 
+    /** Pool of result slots held by jobs used as futures. */
+    internal::fixed_pool<internal::future_result> m_future_result_pool;
+
+    /** Pool of retired objects waiting to be reclaimed. */
+    internal::fixed_pool<internal::retired_object> m_retired_object_pool;
+
+    /** Global reclamation epoch. 0 is never used, so it can mark a worker as offline. */
+    std::atomic<uint64_t> m_ebr_epoch{ 1 };
+
+    /** Lock that must be held while accessing m_shared_retire_list. */
+    internal::spinwait_mutex m_shared_retire_lock;
+
+    /** Objects retired from outside of the workers. */
+    internal::retire_list m_shared_retire_list;
+
+    /** Number of objects in m_shared_retire_list. */
+    std::atomic<size_t> m_shared_retired_count{ 0 };
+
     /** Pool of events that can be allocated. */
     internal::fixed_pool<internal::counter_definition> m_counter_pool;
 
+    /** Pool of groups that can be allocated. Declared after the counter pool as groups hold events. */
+    internal::fixed_pool<internal::group_definition> m_group_pool;
+
     /** Instance responsable for queueing and calling latent callbacks. */
     internal::callback_scheduler m_callback_scheduler;
 
@@ -856,8 +2094,11 @@ private:
 
     class worker_thread_state;
 
-    /** Array of worker threads indexed by m_worker_job_index. */
-    worker_thread_state* m_worker_thread_states = nullptr;
+    /** Array of worker threads indexed by m_worker_job_index. Each state is allocated on its workers numa node. */
+    worker_thread_state** m_worker_thread_states = nullptr;
+
+    /** State used by whichever thread is calling \ref pump. */
+    worker_thread_state* m_pump_thread_state = nullptr;
 
     /** Scheduler that owns the current worker thread */
     static thread_local scheduler* m_worker_thread_scheduler;
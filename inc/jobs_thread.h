@@ -31,6 +31,7 @@
 #include "jobs_defines.h"
 #include "jobs_enums.h"
 #include "jobs_memory.h"
+#include "jobs_topology.h"
 
 #include <thread>
 #include <functional>
@@ -68,11 +69,13 @@ public:
      *
      * \param entry_point Function that should be run when the thread starts.
      * \param name Contextual name of this thread to show in debugger.
-     * \param core_affinity Mask of which cores this thread can execute on.
+     * \param core_affinity Set of logical processors this thread can execute on. If empty the thread can execute anywhere.
+     * \param numa_node Numa node this thread should be restricted to, or \ref jobs::any_numa_node to run anywhere. Ignored if 
+     *                  core_affinity is provided.
      *
      * \return Value indicating the success of this function.
      */
-    result init(const thread_entry_point& entry_point, const char* name, size_t core_affinity);
+    result init(const thread_entry_point& entry_point, const char* name, const cpu_set& core_affinity, size_t numa_node = any_numa_node);
 
     /**
      * \brief Blocks until thread completes execution.
@@ -0,0 +1,325 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+/**
+ *  \file jobs_topology.h
+ *
+ *  Include header for querying the processor and memory topology of the system.
+ */
+
+#ifndef __JOBS_TOPOLOGY_H__
+#define __JOBS_TOPOLOGY_H__
+
+#include "jobs_defines.h"
+#include "jobs_enums.h"
+#include "jobs_memory.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+
+namespace jobs {
+
+/**
+ * Value used in place of a numa node index to indicate that any node can be used. When
+ * passed to a thread pool, workers are spread evenly between all nodes in the system.
+ */
+const size_t any_numa_node = SIZE_MAX;
+
+namespace internal {
+
+/** Maximum number of numa nodes the scheduler will distinguish between. Nodes beyond this are folded onto lower ones. */
+const size_t max_numa_nodes = 16;
+
+/** Maximum number of logical processors the scheduler can place workers on. */
+const size_t max_logical_processors = 1024;
+
+/** Number of logical processors in each processor group, matching the width of a 64-bit platform affinity mask. 32-bit platforms only use the low bits of each group. */
+const size_t processors_per_group = 64;
+
+/**
+ *  \brief Set of logical processors a thread is permitted to execute on.
+ *
+ *  Processors are identified by a global index, on platforms with processor groups
+ *  this is equal to (group * processors_per_group) + processor_number_in_group.
+ */
+struct cpu_set
+{
+public:
+
+    /**
+     * \brief Adds the given logical processor to this set.
+     *
+     * \param index Global index of logical processor.
+     */
+    void set(size_t index);
+
+    /**
+     * \brief Gets if the given logical processor is in this set.
+     *
+     * \param index Global index of logical processor.
+     *
+     * \return True if processor is in this set.
+     */
+    bool test(size_t index) const;
+
+    /**
+     * \brief Gets if this set contains no processors.
+     *
+     * \return True if the set is empty.
+     */
+    bool is_empty() const;
+
+    /**
+     * \brief Gets the number of logical processors in this set.
+     *
+     * \return Number of processors in set.
+     */
+    size_t count() const;
+
+    /**
+     * \brief Gets the lowest index logical processor in this set.
+     *
+     * \return Global index of first processor, or max_logical_processors if the set is empty.
+     */
+    size_t first() const;
+
+    /**
+     * \brief Gets the mask of processors in this set that belong to a given processor group.
+     *
+     * \param group Index of processor group.
+     *
+     * \return Bitmask of processors, bit n represents processor n in the group.
+     */
+    uint64_t get_group_mask(size_t group) const;
+
+private:
+
+    /** Bitmask of processors, one element per processor group. */
+    uint64_t m_masks[max_logical_processors / processors_per_group] = {};
+};
+
+/**
+ *  \brief Describes the position of a single logical processor in the systems topology.
+ */
+struct logical_processor
+{
+    /** Global index of this processor, as used in \ref cpu_set. */
+    size_t index = 0;
+
+    /** Identifier of the physical core this processor belongs to. */
+    size_t core = 0;
+
+    /** Index of this processor within its physical core. Anything other than 0 is an SMT sibling. */
+    size_t smt_index = 0;
+
+    /** Identifier of the last level cache (L3 / CCX) this processor shares. */
+    size_t cache_group = 0;
+
+    /** Numa node this processor belongs to. */
+    size_t numa_node = 0;
+};
+
+/**
+ * \brief Gets the topology of all logical processors available to the process.
+ *
+ * Processors are returned sorted by index. Platforms that do not expose any topology information
+ * report each logical processor as its own physical core sharing a single cache.
+ *
+ * \param memory_functions Functions used to allocate any temporary memory required to query the topology.
+ * \param buffer Buffer to store processor information in.
+ * \param buffer_size Maximum number of processors that can be stored in buffer.
+ *
+ * \return Number of processors stored in buffer.
+ */
+size_t get_logical_processors(const memory_functions& memory_functions, logical_processor* buffer, size_t buffer_size);
+
+/**
+ * \brief Orders logical processors in the sequence workers should be assigned to them for a given placement policy.
+ *
+ * \param processors Processor topology as returned by \ref get_logical_processors.
+ * \param processor_count Number of processors in processors.
+ * \param placement Placement policy to order processors for.
+ * \param numa_node If not any_numa_node, only processors on this node are included. If the node
+ *                  has no processors, all processors are included.
+ * \param output Buffer to store indices into processors in. Must be at least processor_count long.
+ *
+ * \return Number of indices stored in output.
+ */
+size_t get_placement_order(const logical_processor* processors, size_t processor_count, thread_placement placement, size_t numa_node, size_t* output);
+
+/**
+ * \brief Gets the number of numa nodes in the system.
+ *
+ * Platforms without numa support always report a single node.
+ *
+ * \return Number of numa nodes, clamped to \ref max_numa_nodes.
+ */
+size_t get_numa_node_count();
+
+/**
+ * \brief Gets the number of logical processors the process can actually make use of.
+ *
+ * This is the intersection of the processors the process has affinity with and any cpu-time
+ * quota imposed on the process by the container or job object it runs in. A quota of 4.5 cores
+ * is rounded up to 5. This value can change over the lifetime of the process.
+ *
+ * \return Number of processors available, always at least 1.
+ */
+size_t get_available_processor_count();
+
+/**
+ * \brief Gets the number of logical processors that belong to the given numa node.
+ *
+ * \param node Index of numa node to query.
+ *
+ * \return Number of logical processors in node, or 0 if the node has no processors.
+ */
+size_t get_numa_node_processor_count(size_t node);
+
+/**
+ * \brief Gets the numa node the calling thread is currently executing on.
+ *
+ * \return Index of the numa node the calling thread is running on.
+ */
+size_t get_current_numa_node();
+
+/**
+ * \brief Restricts the calling thread to only execute on processors within the given numa node.
+ *
+ * \param node Index of numa node to bind thread to.
+ *
+ * \return Value indicating the success of this function.
+ */
+result bind_current_thread_to_numa_node(size_t node);
+
+/**
+ * \brief Allocates a block of memory that is physically backed by the given numa node.
+ *
+ * Memory allocated with this function must be freed with \ref numa_free.
+ *
+ * \param size Size of block of memory to allocate.
+ * \param alignment Alignment of block of memory to allocate. Blocks are always page-aligned on numa systems.
+ * \param node Index of numa node memory should be allocated on.
+ *
+ * \return Pointer to allocated block, or nullptr on failure.
+ */
+void* numa_alloc(size_t size, size_t alignment, size_t node);
+
+/**
+ * \brief Frees a block of memory previously allocated with \ref numa_alloc.
+ *
+ * \param ptr Pointer to block of memory to free.
+ */
+void numa_free(void* ptr);
+
+/**
+ *  \brief Carves small node-local allocations out of larger node-local blocks.
+ *
+ *  Native node-local allocations are made at the granularity of the platform's virtual memory
+ *  system (64KB on windows), which is very wasteful for the small per-worker structures the 
+ *  scheduler places on each node. Allocations are never freed individually, blocks are only
+ *  returned when the arena is destroyed.
+ */
+class numa_arena
+{
+public:
+
+    /** Size of each block allocated from the node. */
+    static const size_t block_size = 64 * 1024;
+
+    /** Largest allocation that will be carved from a block, anything larger should go directly to the node. */
+    static const size_t max_alloc_size = block_size / 4;
+
+    /** Destructor. */
+    ~numa_arena();
+
+    /**
+     * \brief Sets the functions and node used to allocate blocks.
+     *
+     * \param alloc_function Function used to allocate blocks.
+     * \param free_function Function used to free blocks.
+     * \param node Index of numa node blocks are allocated on.
+     */
+    void init(const memory_alloc_numa_function& alloc_function, const memory_free_function& free_function, size_t node);
+
+    /**
+     * \brief Allocates a block of memory from the arena.
+     *
+     * \param size Size of memory to allocate, must be no larger than \ref max_alloc_size.
+     * \param alignment Alignment of memory to allocate.
+     *
+     * \return Pointer to allocated memory, or nullptr on failure.
+     */
+    void* alloc(size_t size, size_t alignment);
+
+    /**
+     * \brief Gets if a pointer was allocated from this arena.
+     *
+     * \param ptr Pointer to check.
+     *
+     * \return True if the pointer lies within one of this arena's blocks.
+     */
+    bool owns(void* ptr);
+
+private:
+
+    /** Header at the start of each block. */
+    struct block
+    {
+        /** Next block in the arena. */
+        block* next;
+
+        /** Number of bytes of this block that have been allocated, including this header. */
+        size_t used;
+    };
+
+    /**
+     * \brief Allocates memory from the unused space at the end of a block.
+     *
+     * \param target Block to allocate from.
+     * \param size Size of memory to allocate.
+     * \param alignment Alignment of memory to allocate.
+     *
+     * \return Pointer to allocated memory, or nullptr if the block does not have enough space left.
+     */
+    void* carve(block* target, size_t size, size_t alignment);
+
+    /** Function used to allocate blocks. */
+    memory_alloc_numa_function m_alloc_function;
+
+    /** Function used to free blocks. */
+    memory_free_function m_free_function;
+
+    /** Index of numa node blocks are allocated on. */
+    size_t m_node = 0;
+
+    /** Most recently allocated block, allocations are carved from this. */
+    block* m_head = nullptr;
+
+    /** Lock that must be held while accessing blocks. */
+    std::mutex m_mutex;
+};
+
+}; /* namespace internal */
+}; /* namespace jobs */
+
+#endif /* __JOBS_TOPOLOGY_H__ */
\ No newline at end of file
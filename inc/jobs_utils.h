@@ -35,6 +35,8 @@
 #include <chrono>
 #include <atomic>
 #include <shared_mutex>
+#include <mutex>
+#include <condition_variable>
 #include <cassert>
 #include <cmath>
 
@@ -43,6 +45,11 @@
 #include <x86intrin.h>
 #endif
 
+#if defined(JOBS_PLATFORM_WINDOWS) || defined(JOBS_PLATFORM_XBOX_ONE)
+// For _BitScanForward64 intrinsic
+#include <intrin.h>
+#endif
+
 /**
 * \brief Returns minimum of two numbers.
 *
@@ -64,6 +71,9 @@
 #define JOBS_MAX(x, y) ((x) > (y) ? (x) : (y))
 
 namespace jobs {
+
+struct timeout;
+
 namespace internal {
     
 /**
@@ -74,6 +84,16 @@ namespace internal {
 */
 void debug_print(const char* format, ...);
 
+/**
+* \brief Gets the shard the calling thread should use when updating a sharded value.
+*
+* Threads are assigned shards round-robin the first time they call this, so threads 
+* spread evenly between shards and always use the same one.
+*
+* \return Index of shard, less than \ref sharded_activity_counter::shard_count.
+*/
+size_t get_thread_shard_index();
+
 /**
 * \brief Gets the index of the highest bit set in a given value.
 *
@@ -87,6 +107,35 @@ data_type get_first_set_bit_pos(data_type value)
     return log2(value & -value) + 1;
 }
 
+/**
+* \brief Gets the number of trailing zero bits in a value, which is the index of the lowest bit set.
+*
+* \param value Value to search, must not be zero.
+*
+* \return Index of lowest bit set in value.
+*/
+inline size_t count_trailing_zeros(uint64_t value)
+{
+    assert(value != 0);
+
+#if defined(JOBS_PLATFORM_WINDOWS) || defined(JOBS_PLATFORM_XBOX_ONE)
+    unsigned long index = 0;
+#   if defined(_M_X64) || defined(_M_ARM64)
+    _BitScanForward64(&index, value);
+#   else
+    // 32-bit targets only have the 32-bit intrinsic, so scan the low half then the high half.
+    if (!_BitScanForward(&index, (unsigned long)value))
+    {
+        _BitScanForward(&index, (unsigned long)(value >> 32));
+        index += 32;
+    }
+#   endif
+    return index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
 /**
 * \brief Performs RAII scope locking of a mutex. Similar to scope_lock except
 *        mutex can be optionally acquired based on parameter passed to constructor.
@@ -275,6 +324,132 @@ private:
 
 }; 
 
+/**
+ *  \brief Tracks the number of outstanding operations across many threads without a single contended atomic.
+ *
+ *  Each shard lives on its own cache line and holds monotonically increasing counts of operations
+ *  started and finished. An operation can start and finish on different shards. Reading every 
+ *  finished count before every started count guarantees that if the totals match, there was a 
+ *  point during the read where nothing was outstanding, as anything started by an operation 
+ *  always happens before that operation finishes.
+ */
+struct sharded_activity_counter
+{
+public:
+
+    /** Number of shards values are spread across. */
+    static const size_t shard_count = 16;
+
+    /** 
+     * \brief Records the start of one or more operations on the calling threads shard. 
+     *
+     * \param count Number of operations started.
+     */
+    JOBS_FORCE_INLINE void start(size_t count = 1)
+    {
+        m_shards[get_thread_shard_index()].started.fetch_add(count);
+    }
+
+    /** 
+     * \brief Records the completion of one or more operations on the calling threads shard. 
+     *
+     * \param count Number of operations finished.
+     */
+    JOBS_FORCE_INLINE void finish(size_t count = 1)
+    {
+        m_shards[get_thread_shard_index()].finished.fetch_add(count);
+    }
+
+    /**
+     * \brief Gets the number of operations outstanding.
+     *
+     * If callers finish operations before recording their start, this may briefly see more finished 
+     * than started, in which case it returns zero rather than wrapping around.
+     *
+     * \return Number of operations started but not yet finished.
+     */
+    size_t get_count() const
+    {
+        uint64_t finished = 0;
+        for (size_t i = 0; i < shard_count; i++)
+        {
+            finished += m_shards[i].finished.load();
+        }
+
+        uint64_t started = 0;
+        for (size_t i = 0; i < shard_count; i++)
+        {
+            started += m_shards[i].started.load();
+        }
+
+        return started > finished ? (size_t)(started - finished) : 0;
+    }
+
+    /**
+     * \brief Gets if there are no operations outstanding.
+     *
+     * \return True if every operation started has finished.
+     */
+    bool is_idle() const
+    {
+        return get_count() == 0;
+    }
+
+private:
+
+    /** Counts held by a single shard, padded to a cache line to avoid false sharing. */
+    struct alignas(64) shard
+    {
+        /** Number of operations started on this shard. */
+        std::atomic<uint64_t> started{ 0 };
+
+        /** Number of operations finished on this shard. */
+        std::atomic<uint64_t> finished{ 0 };
+    };
+
+    /** Per-thread shards. */
+    shard m_shards[shard_count];
+
+};
+
+/**
+ *  \brief Somewhere a single non-job thread can block until another thread explicitly wakes it.
+ *
+ *  Each blocked thread owns its own slot, so waking it up doesn't disturb any other 
+ *  threads that are blocked waiting for unrelated conditions.
+ */
+struct parking_slot
+{
+public:
+
+    /** Constructor */
+    parking_slot();
+
+    /**
+     * \brief Blocks the calling thread until \ref unpark is called.
+     *
+     * \param in_timeout Maximum time to block for.
+     *
+     * \return True if unparked, false if timed out.
+     */
+    bool park(const timeout& in_timeout);
+
+    /** Wakes up the thread blocked on this slot. If nothing is blocked yet, the next call to \ref park returns immediately. */
+    void unpark();
+
+private:
+
+    /** Mutex protecting m_unparked. */
+    std::mutex m_mutex;
+
+    /** Condition variable notified when unparked. */
+    std::condition_variable m_cvar;
+
+    /** Set once \ref unpark has been called. */
+    bool m_unparked = false;
+
+};
+
 /**
  * \brief Thread-safe list that supports having multiple writers but a single reader.
  *
@@ -593,6 +768,11 @@ public:
         m_buffer = (data_type*)memory_functions.user_alloc(sizeof(data_type) * capacity, alignof(data_type));
         m_memory_functions = memory_functions;
 
+        if (m_buffer == nullptr)
+        {
+            return result::out_of_memory;
+        }
+
         m_head = 0;
         m_tail = 0;
         m_uncomitted_head = 0;
@@ -989,12 +1169,14 @@ public:
      * \brief Allocates a new object from the pool.
      *
      * \param output Reference to store index of allocated object.
+     * \param can_block If true and the pool is empty, this function will block until an object is 
+     *                  freed, otherwise \ref result::empty will be returned.
      *
      * \return Value indicating the success of this function.
      */
-    JOBS_FORCE_INLINE result alloc(size_t& output)
+    JOBS_FORCE_INLINE result alloc(size_t& output, bool can_block = true)
     {
-        return m_free_queue.pop(output, true);
+        return m_free_queue.pop(output, can_block);
     }
 
     /**
@@ -1110,7 +1292,7 @@ public:
      *
      *  \return true if an infinite timeout.
      */
-    bool is_infinite()
+    bool is_infinite() const
     {
         return duration == infinite.duration;
     }
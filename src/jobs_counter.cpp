@@ -212,13 +212,22 @@ result counter_handle::wait_for(size_t value, timeout in_timeout)
                 }
                 else
                 {
-                    size_t ms_remaining = in_timeout.duration - timer.get_elapsed_ms();
-                    if (ms_remaining > 0)
+                    uint64_t ms_elapsed = timer.get_elapsed_ms();
+                    if (ms_elapsed < in_timeout.duration)
                     {
-                        def.value_cvar.wait_for(lock, std::chrono::milliseconds(ms_remaining));
+                        def.value_cvar.wait_for(lock, std::chrono::milliseconds(in_timeout.duration - ms_elapsed));
                     }
                     else
                     {
+                        // Take ourselves off the wait list before the fake job goes out of scope, unless 
+                        // the value was reached while we were timing out and we have already been removed.
+                        internal::job_status expected = internal::job_status::waiting_on_counter;
+                        if (!fake_job.status.compare_exchange_strong(expected, internal::job_status::pending))
+                        {
+                            return result::success;
+                        }
+
+                        remove_from_wait_list(&fake_job);
                         return result::timeout;
                     }
                 }
@@ -340,13 +349,22 @@ result counter_handle::remove(size_t value, timeout in_timeout)
                 }
                 else
                 {
-                    size_t ms_remaining = in_timeout.duration - timer.get_elapsed_ms();
-                    if (ms_remaining > 0)
+                    uint64_t ms_elapsed = timer.get_elapsed_ms();
+                    if (ms_elapsed < in_timeout.duration)
                     {
-                        def.value_cvar.wait_for(lock, std::chrono::milliseconds(ms_remaining));
+                        def.value_cvar.wait_for(lock, std::chrono::milliseconds(in_timeout.duration - ms_elapsed));
                     }
                     else
                     {
+                        // Take ourselves off the wait list before the fake job goes out of scope, unless the 
+                        // value was removed for us while we were timing out and we have already been removed.
+                        internal::job_status expected = internal::job_status::waiting_on_counter;
+                        if (!fake_job.status.compare_exchange_strong(expected, internal::job_status::pending))
+                        {
+                            return result::success;
+                        }
+
+                        remove_from_wait_list(&fake_job);
                         return result::timeout;
                     }
                 }
@@ -387,7 +405,8 @@ bool counter_handle::modify_value(size_t new_value, bool absolute, bool subtract
     internal::counter_definition& def = m_scheduler->get_counter_definition(m_index);
 
     {
-        internal::optional_shared_lock<internal::spinwait_mutex> lock(def.wait_list.get_mutex(), lock_required);
+        // Exclusive as we walk the wait list below, this stops a job adding itself after checking the old value but before we notify.
+        internal::optional_lock<internal::spinwait_mutex> lock(def.wait_list.get_mutex(), lock_required);
         
         size_t changed_value = 0;
         if (absolute)
@@ -476,8 +495,8 @@ void counter_handle::notify_value_changed(size_t new_value, bool lock_required)
 
     internal::counter_definition& def = m_scheduler->get_counter_definition(m_index);
 
-    // Go through wait list and mark all jobs as ready to resume if their criteria is met.
-    size_t signalled_job_count = 0;
+    // Go through wait list and mark all jobs as ready to resume if their criteria is met. Requeueing
+    // a job already counts it as available and wakes a worker for it.
     size_t signalled_no_requeue_job_count = 0;
 
     {
@@ -507,7 +526,6 @@ void counter_handle::notify_value_changed(size_t new_value, bool lock_required)
                     if (!job_def->wait_counter_do_not_requeue)
                     {
                         m_scheduler->requeue_job(job_def->index);
-                        signalled_job_count++;
                     }
                     else
                     {
@@ -523,12 +541,6 @@ void counter_handle::notify_value_changed(size_t new_value, bool lock_required)
         }
     }
 
-    if (signalled_job_count > 0)
-    {
-        jobs_profile_scope(profile_scope_type::fiber, "signal worker threads", m_scheduler);
-        m_scheduler->notify_job_available(signalled_job_count);
-    }
-
     if (signalled_no_requeue_job_count > 0)
     {
         jobs_profile_scope(profile_scope_type::fiber, "signal waiting threads", m_scheduler);
@@ -0,0 +1,142 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "jobs_future.h"
+#include "jobs_scheduler.h"
+
+#include <cassert>
+
+namespace jobs {
+namespace internal {
+
+bool future_base::is_valid()
+{
+    return m_job.is_valid();
+}
+
+bool future_base::is_complete()
+{
+    return m_job.is_complete();
+}
+
+result future_base::wait(timeout in_timeout)
+{
+    return m_job.wait(in_timeout);
+}
+
+job_handle future_base::get_job()
+{
+    return m_job;
+}
+
+result future_base::dispatch()
+{
+    return m_job.dispatch();
+}
+
+result future_access::create(scheduler* scheduler, bool has_value, future_base& output, future_result*& slot)
+{
+    if (scheduler == nullptr)
+    {
+        return result::invalid_handle;
+    }
+
+    job_handle job;
+    result res = scheduler->create_job(job);
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    slot = nullptr;
+    if (has_value)
+    {
+        res = scheduler->alloc_job_result(job.m_index);
+        if (res != result::success)
+        {
+            return res;
+        }
+
+        slot = scheduler->get_job_definition(job.m_index).result_slot;
+    }
+
+    output.m_job = job;
+    return result::success;
+}
+
+scheduler* future_access::get_scheduler(future_base& future)
+{
+    return future.m_job.m_scheduler;
+}
+
+future_result* future_access::get_result_slot(future_base& future)
+{
+    if (!future.m_job.is_valid())
+    {
+        return nullptr;
+    }
+
+    return future.m_job.m_scheduler->get_job_definition(future.m_job.m_index).result_slot;
+}
+
+result future_access::dispatch_continuation(future_base& continuation, future_base* const* predecessors, size_t count, bool release_on_any)
+{
+    scheduler* scheduler = continuation.m_job.m_scheduler;
+    size_t continuation_index = continuation.m_job.m_index;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!predecessors[i]->m_job.is_valid() || predecessors[i]->m_job.m_scheduler != scheduler)
+        {
+            return result::invalid_handle;
+        }
+    }
+
+    // The continuation is held back by a countdown that each predecessor releases as it completes. With
+    // release_on_any the countdown starts at one, and only the first predecessor to complete can release it.
+    internal::job_definition& def = scheduler->get_job_definition(continuation_index);
+    def.release_on_any = (release_on_any && count > 0);
+    def.pending_predecessors = def.release_on_any ? 1 : count;
+
+    result res = continuation.m_job.dispatch();
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        job_handle& predecessor = predecessors[i]->m_job;
+
+        // If we can't track the predecessor we have no choice but to wait for it here, as the continuation
+        // has already been dispatched and would otherwise never be released.
+        if (scheduler->add_job_continuation(predecessor.m_index, continuation_index) != result::success)
+        {
+            predecessor.wait();
+            scheduler->release_continuation(continuation_index);
+        }
+    }
+
+    return result::success;
+}
+
+}; /* namespace internal */
+}; /* namespace jobs */
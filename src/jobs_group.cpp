@@ -0,0 +1,226 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+  
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "jobs_group.h"
+#include "jobs_scheduler.h"
+#include "jobs_utils.h"
+
+#include <cassert>
+
+namespace jobs {
+namespace internal {
+
+group_definition::group_definition()
+{
+    reset();
+}	
+
+void group_definition::reset()
+{
+    ref_count = 0;	
+    cancelled = false;
+    waiter_count = 0;
+    concurrency_limit = 0;
+    admitted_jobs = 0;
+    throttled_head = nullptr;
+    throttled_tail = nullptr;
+
+    idle_event = event_handle();
+}
+
+}; /* namespace internal */
+
+group_handle::group_handle(scheduler* scheduler, size_t index)
+    : m_scheduler(scheduler)
+    , m_index(index)
+{
+    increase_ref();
+}
+
+group_handle::group_handle()
+    : m_scheduler(nullptr)
+    , m_index(0)
+{
+}
+
+group_handle::group_handle(const group_handle& other)
+{
+    m_scheduler = other.m_scheduler;
+    m_index = other.m_index;
+
+    increase_ref();
+}
+
+group_handle::~group_handle()
+{
+    decrease_ref();
+}
+
+group_handle& group_handle::operator=(const group_handle& other)
+{
+    if (this != &other)
+    {
+        decrease_ref();
+
+        m_scheduler = other.m_scheduler;
+        m_index = other.m_index;
+
+        increase_ref();
+    }
+
+    return *this;
+}
+
+bool group_handle::is_valid() const
+{
+    return (m_scheduler != nullptr);
+}
+
+void group_handle::increase_ref()
+{
+    if (m_scheduler != nullptr)
+    {
+        m_scheduler->increase_group_ref_count(m_index);
+    }
+}
+
+void group_handle::decrease_ref()
+{
+    if (m_scheduler != nullptr)
+    {
+        m_scheduler->decrease_group_ref_count(m_index);
+    }
+}
+
+result group_handle::wait(timeout in_timeout)
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+
+    jobs_profile_scope(profile_scope_type::fiber, "group::wait", m_scheduler);
+
+    internal::group_definition& def = m_scheduler->get_group_definition(m_index);
+
+    internal::stopwatch timer;
+    timer.start();
+
+    // Completing jobs only signal the idle event when someone is waiting, so register before 
+    // looking at the active count to avoid missing the final completion.
+    def.waiter_count++;
+
+    result res = result::success;
+    while (true)
+    {
+        def.idle_event.reset();
+
+        // Leave the event signaled when idle so other waiters that raced with our reset still wake up.
+        if (def.active_jobs.is_idle())
+        {
+            def.idle_event.signal();
+            break;
+        }
+
+        timeout remaining = timeout::infinite;
+        if (!in_timeout.is_infinite())
+        {
+            uint64_t elapsed = timer.get_elapsed_ms();
+            if (elapsed >= in_timeout.duration)
+            {
+                res = result::timeout;
+                break;
+            }
+
+            remaining = timeout(in_timeout.duration - elapsed);
+        }
+
+        res = def.idle_event.wait(remaining);
+        if (res != result::success && res != result::timeout)
+        {
+            break;
+        }
+    }
+
+    def.waiter_count--;
+
+    return res;
+}
+
+result group_handle::cancel()
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+
+    internal::group_definition& def = m_scheduler->get_group_definition(m_index);
+    def.cancelled = true;
+
+    return result::success;
+}
+
+bool group_handle::is_cancelled() const
+{
+    if (!is_valid())
+    {
+        return false;
+    }
+
+    internal::group_definition& def = m_scheduler->get_group_definition(m_index);
+    return def.cancelled.load();
+}
+
+result group_handle::set_concurrency_limit(size_t limit)
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+
+    internal::group_definition& def = m_scheduler->get_group_definition(m_index);
+    def.concurrency_limit = limit;
+
+    return result::success;
+}
+
+bool group_handle::is_idle() const
+{
+    if (!is_valid())
+    {
+        return true;
+    }
+
+    internal::group_definition& def = m_scheduler->get_group_definition(m_index);
+    return def.active_jobs.is_idle();
+}
+
+bool group_handle::operator==(const group_handle& rhs) const
+{
+    return (m_scheduler == rhs.m_scheduler && m_index == rhs.m_index);
+}
+
+bool group_handle::operator!=(const group_handle& rhs) const
+{
+    return !(*this == rhs);
+}
+
+}; /* namespace jobs */
\ No newline at end of file
@@ -21,6 +21,7 @@
 
 #include "jobs_job.h"
 
+#include <cstdint>
 #include <cstdio>
 #include <cstdarg>
 #include <cassert>
@@ -37,8 +38,23 @@ job_context::job_context()
 void job_context::reset()
 {
     queues_contained_in = 0;
+    queue_mask = 0;
+    in_affine_queue = false;
+    in_ordered_queue = false;
+    in_local_queue = false;
+    last_worker = SIZE_MAX;
+    deadline_time = 0;
+    critical_path = 0;
+    critical_path_pass = 0;
+    critical_path_cursor = nullptr;
+    execution_time = 0;
+    concurrency_admitted = false;
+    next_throttled = nullptr;
+    inline_depth = 0;
+    inline_stack_size = 0;
     fiber_pool_index = 0;
     fiber_index = 0;
+    fiber_numa_node = 0;
     is_fiber_raw = false;
     profile_scope_depth = 0;
 
@@ -124,6 +140,8 @@ result job_context::leave_scope()
     return scheduler->free_scope(original);
 }
 
+job_dependency* const job_definition::completed_continuations = reinterpret_cast<job_dependency*>(UINTPTR_MAX);
+
 job_definition::job_definition(size_t in_index)
 {
     index = in_index;
@@ -137,15 +155,29 @@ void job_definition::reset()
     work = nullptr;
     stack_size = 0;
     job_priority = priority::normal;
+    numa_node = any_numa_node;
+    thread_affinity = any_worker;
+    affinity_key = no_affinity_key;
+    deadline = timeout::infinite;
+    cost_hint = 0;
+    instance_count = 0;
+    instance_grain = 0;
+    instance_cursor = 0;
+    instance_index = 0;
     status = job_status::initialized;
     tag[0] = '\0';
     pending_predecessors = 0;
+    first_continuation = nullptr;
+    release_on_any = false;
+    result_slot = nullptr;
 
     completion_counter = counter_handle();
+    group = group_handle();
 
     wait_counter = counter_handle();
     wait_event = event_handle();
     wait_job = job_handle();
+    wait_parking_slot = nullptr;
 
     context.reset();
 
@@ -323,6 +355,95 @@ result job_handle::set_priority(priority job_priority)
     return result::success;
 }
 
+result job_handle::set_numa_node(size_t numa_node)
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+    if (!is_mutable())
+    {
+        return result::not_mutable;
+    }
+
+    internal::job_definition& definition = m_scheduler->get_job_definition(m_index);
+    definition.numa_node = numa_node;
+
+    return result::success;
+}
+
+result job_handle::set_thread_affinity(size_t worker_index)
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+    if (!is_mutable())
+    {
+        return result::not_mutable;
+    }
+    if (worker_index != any_worker && worker_index != pump_thread && worker_index >= m_scheduler->m_worker_count)
+    {
+        return result::maximum_exceeded;
+    }
+
+    internal::job_definition& definition = m_scheduler->get_job_definition(m_index);
+    definition.thread_affinity = worker_index;
+
+    return result::success;
+}
+
+result job_handle::set_affinity_key(uint64_t key)
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+    if (!is_mutable())
+    {
+        return result::not_mutable;
+    }
+
+    internal::job_definition& definition = m_scheduler->get_job_definition(m_index);
+    definition.affinity_key = key;
+
+    return result::success;
+}
+
+result job_handle::set_deadline(timeout deadline)
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+    if (!is_mutable())
+    {
+        return result::not_mutable;
+    }
+
+    internal::job_definition& definition = m_scheduler->get_job_definition(m_index);
+    definition.deadline = deadline;
+
+    return result::success;
+}
+
+result job_handle::set_cost_hint(uint64_t cost)
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+    if (!is_mutable())
+    {
+        return result::not_mutable;
+    }
+
+    internal::job_definition& definition = m_scheduler->get_job_definition(m_index);
+    definition.cost_hint = cost;
+
+    return result::success;
+}
+
 result job_handle::set_completion_counter(const counter_handle& counter)
 {
     if (!is_valid())
@@ -340,6 +461,23 @@ result job_handle::set_completion_counter(const counter_handle& counter)
     return result::success;
 }
 
+result job_handle::set_group(const group_handle& group)
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+    if (!is_mutable())
+    {
+        return result::not_mutable;
+    }
+
+    internal::job_definition& definition = m_scheduler->get_job_definition(m_index);
+    definition.group = group;
+
+    return result::success;
+}
+
 result job_handle::clear_dependencies()
 {
     if (!is_valid())
@@ -475,6 +613,39 @@ result job_handle::dispatch()
     return m_scheduler->dispatch_job(m_index);
 }
 
+result job_handle::dispatch(spawn_mode mode)
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+    if (!is_mutable())
+    {
+        return result::not_mutable;
+    }
+
+    if (mode == spawn_mode::child_first)
+    {
+        return m_scheduler->dispatch_job_child_first(m_index);
+    }
+
+    return m_scheduler->dispatch_job(m_index);
+}
+
+result job_handle::dispatch_instances(size_t count, size_t grain)
+{
+    if (!is_valid())
+    {
+        return result::invalid_handle;
+    }
+    if (!is_mutable())
+    {
+        return result::not_mutable;
+    }
+
+    return m_scheduler->dispatch_job_instances(m_index, count, grain);
+}
+
 bool job_handle::operator==(const job_handle& rhs) const
 {
     return (m_scheduler == rhs.m_scheduler && m_index == rhs.m_index);
@@ -24,6 +24,7 @@
 #include "jobs_fiber.h"
 #include "jobs_event.h"
 #include "jobs_counter.h"
+#include "jobs_group.h"
 #include "jobs_utils.h"
 
 #include <stdarg.h>
@@ -76,15 +77,104 @@ public:
 
     /** Thread local cache for allocating profile scopes speedily. */
     internal::fixed_queue<internal::profile_scope_definition*, 32> profile_scope_cache;
+
+    /** Numa node this worker is bound to. */
+    size_t numa_node = 0;
+
+    /** Index of the thread pool this worker belongs to. */
+    size_t pool_index = 0;
+
+    /** Index of this worker within its thread pool. */
+    size_t pool_worker_index = 0;
+
+    /** Index of this worker across all thread pools. */
+    size_t worker_index = 0;
+
+    /** True if this is the state of the thread calling scheduler::pump rather than a worker. */
+    bool is_pump_thread = false;
+
+    /** Condition variable this worker blocks on while idle or parked, so it can be woken on its own. */
+    std::condition_variable wake_cvar;
+
+    /** Position of this worker in the idle worker stack, or SIZE_MAX if it is not waiting for a job. Protected by m_task_available_mutex. */
+    size_t idle_slot = SIZE_MAX;
+
+    /** Queue of jobs that are bound to this thread and cannot be executed by any other. */
+    job_queue affine_job_queue;
+
+    /** Number of jobs waiting in \ref affine_job_queue to be executed. */
+    std::atomic<size_t> affine_available_jobs{ 0 };
+
+    /** Queue of jobs that prefer this worker, other workers can steal from it when they run out of work. */
+    job_queue local_job_queue;
+
+    /** Number of entries in \ref local_job_queue, including ones that have since been claimed elsewhere. */
+    std::atomic<size_t> local_available_jobs{ 0 };
+
+    /** Bitmask of the priorities of jobs pushed to \ref local_job_queue since it was last found empty. */
+    std::atomic<uint64_t> local_priorities{ 0 };
+
+    /** Last global reclamation epoch this worker saw while between jobs, or 0 if it is offline. */
+    std::atomic<uint64_t> ebr_epoch{ 0 };
+
+    /** Objects retired by jobs running on this worker. */
+    internal::retire_list retire_list;
+
+    /** Index of the priority currently being serviced when using weighted fair scheduling. */
+    size_t fair_priority_index = 0;
+
+    /** Number of jobs the current priority can still execute this round when using weighted fair scheduling. */
+    size_t fair_deficit = 0;
+
+    /** Time on the schedulers timer, in microseconds, the current job was last switched to. */
+    uint64_t slice_start_time = 0;
+
+    /** Heap of jobs ordered by deadline or critical path queued on this worker, only allocated if either is in use. */
+    ordered_queue ordered_job_queue;
+
+    /** Job dispatched child-first that this worker should run next, or SIZE_MAX if none. */
+    size_t handoff_job_index = SIZE_MAX;
+
+    /** Jobs that dispatched a child-first job on this worker, most recent last. They are also queued, so may have been stolen. */
+    size_t continuations[max_child_first_depth];
+
+    /** Number of entries in \ref continuations. */
+    size_t continuation_count = 0;
 };
 
+namespace {
+
+/** Number of bits of an ordered queue key used to hold the deadline or critical path, the rest hold the priority index. */
+const uint64_t ordered_key_value_bits = 58;
+
+/** Mixes the bits of an affinity key so sequential keys, or aligned addresses, spread evenly over workers. */
+uint64_t hash_affinity_key(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+}; /* namespace */
+
 scheduler::scheduler()
 {
     m_raw_memory_functions.user_alloc = default_alloc;
     m_raw_memory_functions.user_free = default_free;
+    m_raw_memory_functions.user_alloc_numa = default_alloc_numa;
+    m_raw_memory_functions.user_free_numa = default_free_numa;
 
     m_profile_functions.enter_scope = nullptr;
     m_profile_functions.leave_scope = nullptr;
+
+    // Each priority gets double the weight of the one below it, capped so the lowest levels still get a look in.
+    for (size_t i = 0; i < max_priority_levels; i++)
+    {
+        m_priority_weights[i] = (size_t)1 << (i < 4 ? 4 - i : 0);
+    }
 }
 
 scheduler::~scheduler()
@@ -93,6 +183,10 @@ scheduler::~scheduler()
 
     // Wake up all threads.
     notify_job_available(0xFFFF);
+    {
+        std::unique_lock<std::mutex> lock(m_worker_unparked_mutex);
+        notify_parked_workers();
+    }
 
     // Join all threads.
     for (size_t i = 0; i < m_thread_pool_count; i++)
@@ -104,24 +198,74 @@ scheduler::~scheduler()
         }
     }
 
+    // Nothing can be reading retired objects now the workers are gone.
+    if (m_worker_thread_states != nullptr)
+    {
+        for (size_t i = 0; i < m_worker_count; i++)
+        {
+            if (m_worker_thread_states[i] != nullptr)
+            {
+                reclaim_retired_objects(m_worker_thread_states[i]->retire_list, UINT64_MAX);
+            }
+        }
+    }
+    reclaim_retired_objects(m_shared_retire_list, UINT64_MAX);
+
     // Destroy all fibers
-    // Allocate fibers.
     for (size_t i = 0; i < m_fiber_pool_count; i++)
     {
         fiber_pool& pool = m_fiber_pools[i];
-        for (size_t j = 0; j < pool.pool.capacity(); j++)
+        for (size_t node = 0; node < m_numa_node_count; node++)
         {
-            pool.pool.get_index(j)->destroy();
+            for (size_t j = 0; j < pool.pool[node].capacity(); j++)
+            {
+                pool.pool[node].get_index(j)->destroy();
+            }
         }
     }
 
     // Destroy all worker states.
     if (m_worker_thread_states != nullptr)
     {
+        for (size_t i = 0; i < m_worker_count; i++)
+        {
+            worker_thread_state* state = m_worker_thread_states[i];
+            if (state != nullptr)
+            {
+                size_t numa_node = state->numa_node;
+                if (state->ordered_job_queue.entries != nullptr)
+                {
+                    m_numa_memory_functions[numa_node].user_free(state->ordered_job_queue.entries);
+                }
+
+                state->~worker_thread_state();
+                m_numa_memory_functions[numa_node].user_free(state);
+            }
+        }
+
         m_memory_functions.user_free(m_worker_thread_states);
         m_worker_thread_states = nullptr;
     }
 
+    if (m_idle_workers != nullptr)
+    {
+        m_memory_functions.user_free(m_idle_workers);
+        m_idle_workers = nullptr;
+    }
+
+    if (m_critical_path_stack != nullptr)
+    {
+        m_memory_functions.user_free(m_critical_path_stack);
+        m_critical_path_stack = nullptr;
+    }
+
+    if (m_pump_thread_state != nullptr)
+    {
+        m_pump_thread_state->~worker_thread_state();
+        m_memory_functions.user_free(m_pump_thread_state);
+        m_pump_thread_state = nullptr;
+    }
+
     // Platform destruction.
 #if defined(JOBS_PLATFORM_PS4)
 
@@ -158,6 +302,16 @@ void scheduler::default_free(void* ptr)
 #endif
 }
 
+void* scheduler::default_alloc_numa(size_t size, size_t alignment, size_t numa_node)
+{
+    return internal::numa_alloc(size, alignment, numa_node);
+}
+
+void scheduler::default_free_numa(void* ptr)
+{
+    internal::numa_free(ptr);
+}
+
 result scheduler::set_memory_functions(const memory_functions& functions)
 {
     if (m_initialized)
@@ -244,6 +398,42 @@ result scheduler::set_max_counters(size_t max_counters)
     return result::success;
 }
 
+result scheduler::set_max_groups(size_t max_groups)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_max_groups = max_groups;
+
+    return result::success;
+}
+
+result scheduler::set_max_futures(size_t max_futures)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_max_futures = max_futures;
+
+    return result::success;
+}
+
+result scheduler::set_max_retired_objects(size_t max_retired_objects)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_max_retired_objects = max_retired_objects;
+
+    return result::success;
+}
+
 result scheduler::set_max_callbacks(size_t max_callbacks)
 {
     if (m_initialized)
@@ -256,7 +446,12 @@ result scheduler::set_max_callbacks(size_t max_callbacks)
     return result::success;
 }
 
-result scheduler::add_thread_pool(size_t thread_count, priority job_priorities)
+result scheduler::add_thread_pool(size_t thread_count, priority job_priorities, size_t numa_node, thread_placement placement)
+{
+    return add_elastic_thread_pool(thread_count, thread_count, job_priorities, numa_node, placement);
+}
+
+result scheduler::add_elastic_thread_pool(size_t min_thread_count, size_t max_thread_count, priority job_priorities, size_t numa_node, thread_placement placement)
 {
     if (m_initialized)
     {
@@ -269,10 +464,55 @@ result scheduler::add_thread_pool(size_t thread_count, priority job_priorities)
 
     thread_pool& pool = m_thread_pools[m_thread_pool_count++];
     pool.job_priorities = job_priorities;
-    pool.thread_count = thread_count;
+    pool.thread_count = max_thread_count;
+    pool.min_thread_count = JOBS_MAX(JOBS_MIN(min_thread_count, max_thread_count), (size_t)1);
+    pool.numa_node = numa_node;
+    pool.placement = placement;
+
+    if (pool.min_thread_count < pool.thread_count)
+    {
+        m_has_elastic_pools = true;
+    }
+
+    return result::success;
+}
+
+result scheduler::set_worker_idle_timeout(timeout idle_timeout)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_worker_idle_timeout = idle_timeout;
 
     return result::success;
 }
+
+result scheduler::set_active_worker_limit(size_t max_active_workers)
+{
+    m_active_worker_limit = JOBS_MAX(max_active_workers, (size_t)1);
+
+    if (m_initialized)
+    {
+        update_active_worker_limits();
+    }
+
+    return result::success;
+}
+
+size_t scheduler::get_active_worker_count()
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < m_thread_pool_count; i++)
+    {
+        thread_pool& pool = m_thread_pools[i];
+        count += JOBS_MIN(pool.active_thread_count.load(), pool.active_thread_limit.load());
+    }
+
+    return count;
+}
     
 result scheduler::add_fiber_pool(size_t fiber_count, size_t stack_size)
 {
@@ -292,6 +532,126 @@ result scheduler::add_fiber_pool(size_t fiber_count, size_t stack_size)
     return result::success;
 }
     
+result scheduler::set_track_available_cores(bool track, timeout poll_interval)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_track_available_cores = track;
+    m_available_cores_poll_interval = poll_interval;
+
+    return result::success;
+}
+
+result scheduler::set_scheduling_policy(scheduling_policy policy)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_scheduling_policy = policy;
+
+    return result::success;
+}
+
+result scheduler::set_priority_weight(priority job_priorities, size_t weight)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    for (size_t i = 0; i < max_priority_levels; i++)
+    {
+        if (((uint64_t)job_priorities & ((uint64_t)1 << i)) != 0)
+        {
+            m_priority_weights[i] = JOBS_MAX(weight, (size_t)1);
+        }
+    }
+
+    return result::success;
+}
+
+result scheduler::set_priority_level_count(size_t level_count)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+    if (level_count == 0 || level_count > max_priority_levels)
+    {
+        return result::maximum_exceeded;
+    }
+
+    m_priority_level_count = level_count;
+    m_priority_level_mask = (level_count == max_priority_levels) ? UINT64_MAX : (((uint64_t)1 << level_count) - 1);
+
+    return result::success;
+}
+
+result scheduler::set_priority_aging_threshold(timeout threshold)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_priority_aging_threshold = threshold;
+
+    return result::success;
+}
+
+result scheduler::set_deadline_policy(deadline_policy policy)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_deadline_policy = policy;
+
+    return result::success;
+}
+
+result scheduler::set_priority_inheritance(bool enabled)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_priority_inheritance = enabled;
+
+    return result::success;
+}
+
+result scheduler::set_inline_waits(bool enabled)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_inline_waits = enabled;
+
+    return result::success;
+}
+
+result scheduler::set_critical_path_ordering(bool enabled)
+{
+    if (m_initialized)
+    {
+        return result::already_initialized;
+    }
+
+    m_critical_path_ordering = enabled;
+
+    return result::success;
+}
+
 result scheduler::init()
 {
     if (m_initialized)
@@ -309,6 +669,8 @@ result scheduler::init()
 
     m_initialized = true;
 
+    m_scheduler_timer.start();
+
     // Trampoline the memory functions so we can log allocations.
     m_memory_functions.user_alloc = [=](size_t size, size_t alignment) -> void* {
 
@@ -326,6 +688,48 @@ result scheduler::init()
         return m_raw_memory_functions.user_free(ptr);
     };
 
+    // Numa-local memory functions. There is no point paying for node-local allocation
+    // if there is only a single node, so just use the general memory functions in that case.
+    m_numa_node_count = internal::get_numa_node_count();
+    for (size_t node = 0; node < m_numa_node_count; node++)
+    {
+        if (m_numa_node_count == 1 ||
+            m_raw_memory_functions.user_alloc_numa == nullptr ||
+            m_raw_memory_functions.user_free_numa == nullptr)
+        {
+            m_numa_memory_functions[node] = m_memory_functions;
+            continue;
+        }
+
+        m_numa_arenas[node].init(m_raw_memory_functions.user_alloc_numa, m_raw_memory_functions.user_free_numa, node);
+
+        m_numa_memory_functions[node].user_alloc = [=](size_t size, size_t alignment) -> void* {
+
+            // Node-local blocks are expensive, so small allocations share them.
+            void* ptr = (size <= internal::numa_arena::max_alloc_size) ? 
+                m_numa_arenas[node].alloc(size, alignment) :
+                m_raw_memory_functions.user_alloc_numa(size, alignment, node);
+
+            m_total_memory_allocated += size;
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+            write_log(debug_log_verbosity::verbose, debug_log_group::memory, "allocated memory block, size=%zi ptr=0x%08p node=%zi total=%zi", size, ptr, node, m_total_memory_allocated.load());
+#endif
+
+            return reinterpret_cast<char*>(ptr);
+        };
+        m_numa_memory_functions[node].user_free = [=](void* ptr) {
+
+            // Arena allocations are released with the arena.
+            if (m_numa_arenas[node].owns(ptr))
+            {
+                return;
+            }
+
+            return m_raw_memory_functions.user_free_numa(ptr);
+        };
+    }
+
     // Platform initialization.
 #if defined(JOBS_PLATFORM_PS4)
 
@@ -372,10 +776,10 @@ result scheduler::init()
         return result;
     }
 
-    // Allocate counters.
-    result = m_counter_pool.init(m_memory_functions, m_max_counters, [](internal::counter_definition* instance, size_t index)
+    // Allocate future result slots.
+    result = m_future_result_pool.init(m_memory_functions, m_max_futures, [](internal::future_result* instance, size_t index)
     {
-        new(instance) internal::counter_definition();
+        new(instance) internal::future_result(index);
         return result::success;
     });
 
@@ -384,10 +788,10 @@ result scheduler::init()
         return result;
     }
 
-    // Allocate profile scopes.
-    result = m_profile_scope_pool.init(m_memory_functions, m_max_profile_scopes, [](internal::profile_scope_definition* instance, size_t index)
+    // Allocate retired objects.
+    result = m_retired_object_pool.init(m_memory_functions, m_max_retired_objects, [](internal::retired_object* instance, size_t index)
     {
-        new(instance) internal::profile_scope_definition();
+        new(instance) internal::retired_object(index);
         return result::success;
     });
 
@@ -396,45 +800,227 @@ result scheduler::init()
         return result;
     }
 
-    // Allocate callbacks.
-    result = m_callback_scheduler.init(this, m_max_callbacks, m_memory_functions);
-    if (result != result::success)
-    {
+    // Allocate counters.
+    result = m_counter_pool.init(m_memory_functions, m_max_counters, [](internal::counter_definition* instance, size_t index)
+    {
+        new(instance) internal::counter_definition();
+        return result::success;
+    });
+
+    if (result != result::success)
+    {
         return result;
     }
 
-    // Allocate task queues.
-    for (size_t i = 0; i < (int)priority::count; i++)
+    // Allocate groups.
+    result = m_group_pool.init(m_memory_functions, m_max_groups, [](internal::group_definition* instance, size_t)
     {
-        result = m_pending_job_queues[i].pending_job_indicies.init(m_memory_functions, m_max_jobs);
-        if (result != result::success)
+        new(instance) internal::group_definition();
+        return result::success;
+    });
+
+    if (result != result::success)
+    {
+        return result;
+    }
+
+    // Allocate profile scopes.
+    result = m_profile_scope_pool.init(m_memory_functions, m_max_profile_scopes, [](internal::profile_scope_definition* instance, size_t index)
+    {
+        new(instance) internal::profile_scope_definition();
+        return result::success;
+    });
+
+    if (result != result::success)
+    {
+        return result;
+    }
+
+    // Allocate callbacks.
+    result = m_callback_scheduler.init(this, m_max_callbacks, m_memory_functions);
+    if (result != result::success)
+    {
+        return result;
+    }
+
+    // Allocate stack for walking dependency graphs.
+    if (m_critical_path_ordering)
+    {
+        m_critical_path_stack = (size_t*)m_memory_functions.user_alloc(sizeof(size_t) * m_max_jobs, alignof(size_t));
+        if (m_critical_path_stack == nullptr)
+        {
+            return result::out_of_memory;
+        }
+    }
+
+    // Allocate task queues, each node gets its own set so workers can pull local work without contending with other nodes.
+    for (size_t node = 0; node < m_numa_node_count; node++)
+    {
+        for (size_t i = 0; i < m_priority_level_count; i++)
+        {
+            result = m_pending_job_queues[node][i].pending_job_indicies.init(m_numa_memory_functions[node], m_max_jobs);
+            if (result != result::success)
+            {
+                return result;
+            }
+        }
+    }
+
+    // Work out which nodes we can place workers on.
+    size_t worker_nodes[internal::max_numa_nodes];
+    size_t worker_node_count = 0;
+    for (size_t node = 0; node < m_numa_node_count; node++)
+    {
+        if (internal::get_numa_node_processor_count(node) > 0)
+        {
+            worker_nodes[worker_node_count++] = node;
+        }
+    }
+    if (worker_node_count == 0)
+    {
+        worker_nodes[worker_node_count++] = 0;
+    }
+
+    // Allocate worker states, local to the node each worker will run on.
+    size_t workers_per_node[internal::max_numa_nodes] = {};
+    for (size_t i = 0; i < m_thread_pool_count; i++)
+    {
+        thread_pool& pool = m_thread_pools[i];
+        m_worker_count += pool.thread_count;
+    }
+
+    m_worker_thread_states = (worker_thread_state**)m_memory_functions.user_alloc(sizeof(worker_thread_state*) * m_worker_count, alignof(worker_thread_state*));
+    if (m_worker_thread_states == nullptr)
+    {
+        return result::out_of_memory;
+    }
+    memset(m_worker_thread_states, 0, sizeof(worker_thread_state*) * m_worker_count);
+
+    m_idle_workers = (size_t*)m_memory_functions.user_alloc(sizeof(size_t) * m_worker_count, alignof(size_t));
+    if (m_idle_workers == nullptr)
+    {
+        return result::out_of_memory;
+    }
+
+    size_t worker_index = 0;
+    for (size_t i = 0; i < m_thread_pool_count; i++)
+    {
+        thread_pool& pool = m_thread_pools[i];
+        for (size_t j = 0; j < pool.thread_count; j++, worker_index++)
+        {
+            size_t node = (pool.numa_node == any_numa_node) ? worker_nodes[j % worker_node_count] : (pool.numa_node % m_numa_node_count);
+            workers_per_node[node]++;
+
+            void* state = m_numa_memory_functions[node].user_alloc(sizeof(worker_thread_state), alignof(worker_thread_state));
+            if (state == nullptr)
+            {
+                return result::out_of_memory;
+            }
+
+            m_worker_thread_states[worker_index] = new(state) worker_thread_state();
+            m_worker_thread_states[worker_index]->numa_node = node;
+            m_worker_thread_states[worker_index]->pool_index = i;
+            m_worker_thread_states[worker_index]->pool_worker_index = j;
+            m_worker_thread_states[worker_index]->worker_index = worker_index;
+
+            result = m_worker_thread_states[worker_index]->affine_job_queue.pending_job_indicies.init(m_numa_memory_functions[node], m_max_jobs);
+            if (result != result::success)
+            {
+                return result;
+            }
+
+            result = m_worker_thread_states[worker_index]->local_job_queue.pending_job_indicies.init(m_numa_memory_functions[node], m_max_jobs);
+            if (result != result::success)
+            {
+                return result;
+            }
+
+            if (m_deadline_policy != deadline_policy::ignored || m_critical_path_ordering)
+            {
+                ordered_queue& queue = m_worker_thread_states[worker_index]->ordered_job_queue;
+                queue.entries = (ordered_entry*)m_numa_memory_functions[node].user_alloc(sizeof(ordered_entry) * m_max_jobs, alignof(ordered_entry));
+                if (queue.entries == nullptr)
+                {
+                    return result::out_of_memory;
+                }
+                queue.capacity = m_max_jobs;
+            }
+        }
+
+        pool.active_thread_count = pool.min_thread_count;
+        pool.active_thread_limit = pool.thread_count;
+    }
+
+    // Allocate state for the thread that pumps thread-affine jobs.
+    void* pump_state = m_memory_functions.user_alloc(sizeof(worker_thread_state), alignof(worker_thread_state));
+    if (pump_state == nullptr)
+    {
+        return result::out_of_memory;
+    }
+
+    m_pump_thread_state = new(pump_state) worker_thread_state();
+    m_pump_thread_state->is_pump_thread = true;
+
+    result = m_pump_thread_state->affine_job_queue.pending_job_indicies.init(m_memory_functions, m_max_jobs);
+    if (result != result::success)
+    {
+        return result;
+    }
+
+    // Park any workers beyond the cores currently available to us.
+    if (m_track_available_cores)
+    {
+        m_available_cores_timer.start();
+        m_available_cores_next_poll = m_available_cores_poll_interval.duration;
+        m_available_core_count = get_logical_core_count();
+    }
+    update_active_worker_limits();
+
+    // Allocate fibers. Fibers are split evenly between all nodes that have workers on them.
+    size_t fiber_nodes[internal::max_numa_nodes];
+    size_t fiber_node_count = 0;
+    for (size_t node = 0; node < m_numa_node_count; node++)
+    {
+        if (workers_per_node[node] > 0)
         {
-            return result;
+            fiber_nodes[fiber_node_count++] = node;
         }
     }
 
-    // Allocate fibers.
     for (size_t i = 0; i < m_fiber_pool_count; i++)
     {
         fiber_pool& pool = m_fiber_pools[i];
         m_fiber_pools_sorted_by_stack[i] = &pool;
 
-        result = pool.pool.init(m_memory_functions, pool.fiber_count, [&](internal::fiber* instance, size_t index)
+        for (size_t j = 0; j < fiber_node_count; j++)
         {
-            new(instance) internal::fiber(m_memory_functions);
+            size_t node = fiber_nodes[j];
 
-            char buffer[64];
-            memset(buffer, 0, sizeof(buffer));
-            sprintf(buffer, "Job (Pool=%zi Index=%zi)", i, index);
-            return instance->init(pool.stack_size, [this, i, index]()
+            pool.node_fiber_count[node] = (pool.fiber_count / fiber_node_count) + (j < (pool.fiber_count % fiber_node_count) ? 1 : 0);
+            if (pool.node_fiber_count[node] == 0)
             {
-                worker_fiber_entry_point(i, index);
-            }, buffer);
-        });
+                continue;
+            }
 
-        if (result != result::success)
-        {
-            return result;
+            const memory_functions& node_memory_functions = m_numa_memory_functions[node];
+
+            result = pool.pool[node].init(node_memory_functions, pool.node_fiber_count[node], [&](internal::fiber* instance, size_t index)
+            {
+                new(instance) internal::fiber(node_memory_functions);
+
+                char buffer[64];
+                memset(buffer, 0, sizeof(buffer));
+                sprintf(buffer, "Job (Pool=%zi Node=%zi Index=%zi)", i, node, index);
+                return instance->init(pool.stack_size, [this, i, index]()
+                {
+                    worker_fiber_entry_point(i, index);
+                }, buffer);
+            });
+
+            if (result != result::success)
+            {
+                return result;
+            }
         }
     }
 
@@ -446,27 +1032,27 @@ result scheduler::init()
     };
     std::sort(m_fiber_pools_sorted_by_stack, m_fiber_pools_sorted_by_stack + m_fiber_pool_count, fiber_sort_predicate);
 
-    // Allocate worker states.
-    for (size_t i = 0; i < m_thread_pool_count; i++)
-    {
-        thread_pool& pool = m_thread_pools[i];
-        m_worker_count += pool.thread_count;
-    }
-
-    m_worker_thread_states = (worker_thread_state*)m_memory_functions.user_alloc(sizeof(worker_thread_state) * m_worker_count, alignof(worker_thread_state));
-    if (m_worker_thread_states == nullptr)
+    // Query the processor topology so we can decide which processors each worker is pinned to.
+    internal::logical_processor* processors = (internal::logical_processor*)m_memory_functions.user_alloc(sizeof(internal::logical_processor) * internal::max_logical_processors, alignof(internal::logical_processor));
+    size_t* placement_order = (size_t*)m_memory_functions.user_alloc(sizeof(size_t) * internal::max_logical_processors, alignof(size_t));
+    if (processors == nullptr || placement_order == nullptr)
     {
+        if (processors != nullptr)
+        {
+            m_memory_functions.user_free(processors);
+        }
+        if (placement_order != nullptr)
+        {
+            m_memory_functions.user_free(placement_order);
+        }
         return result::out_of_memory;
     }
 
-    for (size_t i = 0; i < m_worker_count; i++)
-    {
-        new(m_worker_thread_states + i) worker_thread_state();
-    }
+    size_t processor_count = internal::get_logical_processors(m_memory_functions, processors, internal::max_logical_processors);
 
     // Allocate threads.
     size_t thread_index = 0;
-    size_t logical_cores = get_logical_core_count();
+    size_t placement_cursor[internal::max_numa_nodes] = {};
     for (size_t i = 0; i < m_thread_pool_count; i++)
     {
         thread_pool& pool = m_thread_pools[i];
@@ -475,28 +1061,45 @@ result scheduler::init()
         {
             new(instance) internal::thread(m_memory_functions);
 
-            size_t core_affinity = ((size_t)1 << (thread_index % logical_cores));
+            size_t numa_node = m_worker_thread_states[thread_index]->numa_node;
             thread_index++;
 
+            // Pin to the next processor in the pools placement order, restricted to the workers node.
+            internal::cpu_set core_affinity;
+            size_t order_count = internal::get_placement_order(processors, processor_count, pool.placement, m_numa_node_count > 1 ? numa_node : any_numa_node, placement_order);
+            if (order_count > 0)
+            {
+                core_affinity.set(processors[placement_order[placement_cursor[numa_node] % order_count]].index);
+                placement_cursor[numa_node]++;
+            }
+
             char buffer[64];
             memset(buffer, 0, sizeof(buffer));
-            sprintf(buffer, "Worker (Pool=%zi:%zi Affinity=%zi)", i, index, core_affinity);
+            sprintf(buffer, "Worker (Pool=%zi:%zi Cpu=%zi Node=%zi)", i, index, core_affinity.first(), numa_node);
 
             return instance->init([&, i, index, thread_index]()
             {
                 m_worker_thread_scheduler = this;
-                m_worker_thread_state = (m_worker_thread_states + (thread_index  - 1));
+                m_worker_thread_state = m_worker_thread_states[thread_index - 1];
 
                 worker_entry_point(i, index, *instance, pool);
-            }, buffer, core_affinity);
+            }, buffer, core_affinity, m_numa_node_count > 1 ? numa_node : any_numa_node);
         });
 
         if (result != result::success)
         {
-            return result;
+            break;
         }
     }
 
+    m_memory_functions.user_free(processors);
+    m_memory_functions.user_free(placement_order);
+
+    if (result != result::success)
+    {
+        return result;
+    }
+
     // Dump out some general logs describing the scheduler setup.
     write_log(debug_log_verbosity::message, debug_log_group::scheduler, "scheduler initialized");
     write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%zi bytes allocated", m_total_memory_allocated.load());
@@ -504,12 +1107,31 @@ result scheduler::init()
     write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i max dependencies", m_max_dependencies);
     write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i max profile scopes", m_max_profile_scopes);
     write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i max counters", m_max_counters);
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i max groups", m_max_groups);
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i max futures", m_max_futures);
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i max retired objects", m_max_retired_objects);
     write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i max callbacks", m_max_callbacks);
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i numa nodes", m_numa_node_count);
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i logical processors", processor_count);
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i available cores%s", get_logical_core_count(), m_track_available_cores ? " (tracked)" : "");
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i priority levels", m_priority_level_count);
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\tscheduling policy=%i", m_scheduling_policy);
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\tdeadline policy=%i", m_deadline_policy);
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\tpriority inheritance=%s", m_priority_inheritance ? "true" : "false");
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\tcritical path ordering=%s", m_critical_path_ordering ? "true" : "false");
+    write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\tinline waits=%s", m_inline_waits ? "true" : "false");
     write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i thread pools", m_thread_pool_count);
     for (size_t i = 0; i < m_thread_pool_count; i++)
     {
         thread_pool& pool = m_thread_pools[i];
-        write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t\t[%i] workers=%i priorities=0x%08x", i, pool.thread_count, pool.job_priorities);
+        if (pool.numa_node == any_numa_node)
+        {
+            write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t\t[%i] workers=%i-%i priorities=0x%016llx node=any placement=%i", i, pool.min_thread_count, pool.thread_count, (unsigned long long)pool.job_priorities, pool.placement);
+        }
+        else
+        {
+            write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t\t[%i] workers=%i-%i priorities=0x%016llx node=%zi placement=%i", i, pool.min_thread_count, pool.thread_count, (unsigned long long)pool.job_priorities, pool.numa_node % m_numa_node_count, pool.placement);
+        }
     }
     write_log(debug_log_verbosity::message, debug_log_group::scheduler, "\t%i fiber pools", m_fiber_pool_count);
     for (size_t i = 0; i < m_fiber_pool_count; i++)
@@ -543,10 +1165,37 @@ void scheduler::free_job(size_t index)
     internal::job_definition& def = get_job_definition(index);
     if (def.context.has_fiber)
     {
-        free_fiber(def.context.fiber_index, def.context.fiber_pool_index);
+        free_fiber(def.context.fiber_index, def.context.fiber_pool_index, def.context.fiber_numa_node);
         def.context.has_fiber = false;
     }
     clear_job_dependencies(index);
+
+    // Continuations still waiting here belong to a job that was never dispatched, so they will never be released.
+    internal::job_dependency* continuation = def.first_continuation.exchange(nullptr);
+    if (continuation != nullptr && continuation != internal::job_definition::completed_continuations)
+    {
+        write_log(debug_log_verbosity::warning, debug_log_group::job, "job freed without being dispatched, its continuations will never run, index=%zi", index);
+
+        while (continuation != nullptr)
+        {
+            internal::job_dependency* next = continuation->next;
+            size_t pool_index = continuation->pool_index;
+
+            continuation->reset();
+            m_job_dependency_pool.free(pool_index);
+
+            continuation = next;
+        }
+    }
+
+    if (def.result_slot != nullptr)
+    {
+        size_t pool_index = def.result_slot->pool_index;
+
+        def.result_slot->reset();
+        m_future_result_pool.free(pool_index);
+    }
+
     def.reset();
 
     m_job_pool.free(index);
@@ -607,6 +1256,56 @@ void scheduler::decrease_counter_ref_count(size_t index)
     }
 }
 
+result scheduler::create_group(group_handle& instance)
+{
+    size_t index = 0;
+
+    result res = m_group_pool.alloc(index);
+    if (res != result::success)
+    {
+        write_log(debug_log_verbosity::warning, debug_log_group::scheduler, "attempt to create group, but group pool is empty. Try increasing scheduler::set_max_groups.");
+        return res;
+    }
+
+    // Take ownership of the group immediately so its returned to the pool if we fail below.
+    group_handle group(this, index);
+
+    internal::group_definition& def = get_group_definition(index);
+
+    res = create_event(def.idle_event, false);
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    instance = group;
+    return result::success;
+}
+
+void scheduler::free_group(size_t index)
+{
+    internal::group_definition& def = get_group_definition(index);
+    def.reset();
+
+    m_group_pool.free(index);
+}
+
+void scheduler::increase_group_ref_count(size_t index)
+{
+    internal::group_definition& def = get_group_definition(index);
+    ++def.ref_count;
+}
+
+void scheduler::decrease_group_ref_count(size_t index)
+{
+    internal::group_definition& def = get_group_definition(index);
+    size_t new_ref_count = --def.ref_count;
+    if (new_ref_count == 0)
+    {
+        free_group(index);
+    }
+}
+
 void scheduler::leave_context(internal::job_context& context)
 {
     // Remove everything from the profile scope stack.
@@ -619,17 +1318,21 @@ void scheduler::leave_context(internal::job_context& context)
     }
 }
 
-void scheduler::enter_context(internal::job_context& context)
+internal::fiber* scheduler::get_context_fiber(internal::job_context& context)
 {
-    internal::fiber* job_fiber = nullptr;
     if (context.is_fiber_raw)
     {
-        job_fiber = &context.raw_fiber;
+        return &context.raw_fiber;
     }	
     else
     {
-        job_fiber = m_fiber_pools_sorted_by_stack[context.fiber_pool_index]->pool.get_index(context.fiber_index);
+        return m_fiber_pools_sorted_by_stack[context.fiber_pool_index]->pool[context.fiber_numa_node].get_index(context.fiber_index);
     }
+}
+
+void scheduler::enter_context(internal::job_context& context)
+{
+    internal::fiber* job_fiber = get_context_fiber(context);
 
     // Recreate the profile scope stack.
     if (m_profile_functions.enter_scope != nullptr && !m_platform_fiber_aware)
@@ -681,6 +1384,8 @@ void scheduler::clear_job_dependencies(size_t job_index)
 
     // Clear up predecessors.
     {
+        std::lock_guard<internal::spinwait_mutex> lock(def.dependency_lock);
+
         internal::job_dependency* dep = def.first_predecessor;
         while (dep != nullptr)
         {
@@ -737,9 +1442,13 @@ result scheduler::add_job_dependency(size_t successor, size_t predecessor)
 
     internal::job_dependency* predecessor_dep = m_job_dependency_pool.get_index(predecessor_dep_index);
     predecessor_dep->job = job_handle(this, predecessor);
-    predecessor_dep->next = successor_def.first_predecessor;
+    {
+        std::lock_guard<internal::spinwait_mutex> lock(successor_def.dependency_lock);
+
+        predecessor_dep->next = successor_def.first_predecessor;
+        successor_def.first_predecessor = predecessor_dep;
+    }
 
-    successor_def.first_predecessor = predecessor_dep;
     predecessor_def.first_successor = successor_dep;
 
     successor_def.pending_predecessors++;
@@ -747,50 +1456,325 @@ result scheduler::add_job_dependency(size_t successor, size_t predecessor)
     return result::success;
 }
 
-void scheduler::write_log(debug_log_verbosity level, debug_log_group group, const char* message, ...)
+result scheduler::alloc_job_result(size_t job_index)
 {
-    if (m_debug_output_function == nullptr)
+    internal::job_definition& def = get_job_definition(job_index);
+    if (def.result_slot != nullptr)
     {
-        return;
+        return result::success;
     }
-    if ((int)level > (int)m_debug_output_max_verbosity)
+
+    size_t index;
+    result res = m_future_result_pool.alloc(index);
+    if (res != result::success)
     {
-        return;
+        write_log(debug_log_verbosity::warning, debug_log_group::job, "attempt to create future, but future pool is empty. Try increasing scheduler::set_max_futures.");
+        return res;
     }
 
-    std::lock_guard<std::mutex> lock(m_log_mutex);
+    def.result_slot = m_future_result_pool.get_index(index);
+    return result::success;
+}
 
-    // Format message.
-    va_list list;
-    va_start(list, message);
-    vsnprintf(m_log_buffer, max_log_size, message, list);
-    va_end(list);
+result scheduler::retire_object(void* object, ebr::reclaim_function reclaim)
+{
+    size_t index;
+    result res = m_retired_object_pool.alloc(index);
+    if (res != result::success)
+    {
+        write_log(debug_log_verbosity::warning, debug_log_group::memory, "attempt to retire object, but retired object pool is empty. Try increasing scheduler::set_max_retired_objects.");
+        return res;
+    }
 
-    // Format log in format:
-    //	[verbose] warning: message
+    internal::retired_object* retired = m_retired_object_pool.get_index(index);
+    retired->object = object;
+    retired->reclaim = reclaim;
+    retired->next = nullptr;
 
-#if defined(JOBS_USE_VERBOSE_LOGGING)
+    // The object is already unreachable, so any job that reads the epoch after this point can't see it.
+    retired->epoch = m_ebr_epoch.load();
 
-    snprintf(m_log_format_buffer, max_log_size, "[%08x][%p][%s] %s: %s\n", 
-        *reinterpret_cast<unsigned int*>(&std::this_thread::get_id()),
-        m_worker_thread_state,
-        internal::debug_log_group_strings[(int)group], 
-        internal::debug_log_verbosity_strings[(int)level], 
-        m_log_buffer);
+    // Each worker owns its own list, so no locking is needed. Jobs that resume on a different worker just use that workers list.
+    bool on_worker = (m_worker_thread_scheduler == this && !WorkerThreadState.is_pump_thread);
 
-#else
+    internal::retire_list& list = on_worker ? WorkerThreadState.retire_list : m_shared_retire_list;
 
-    snprintf(m_log_format_buffer, max_log_size, "[%s] %s: %s\n",
-        internal::debug_log_group_strings[(int)group],
-        internal::debug_log_verbosity_strings[(int)level],
-        m_log_buffer);
+    std::unique_lock<internal::spinwait_mutex> lock(m_shared_retire_lock, std::defer_lock);
+    if (!on_worker)
+    {
+        lock.lock();
+        m_shared_retired_count++;
+    }
 
-#endif
+    if (list.tail != nullptr)
+    {
+        list.tail->next = retired;
+    }
+    else
+    {
+        list.head = retired;
+    }
+    list.tail = retired;
 
-    m_debug_output_function(level, group, m_log_format_buffer);
+    return result::success;
 }
 
-void scheduler::worker_entry_point(size_t pool_index, size_t worker_index, const internal::thread& this_thread, const thread_pool& thread_pool)
+void scheduler::enter_quiescent_state()
+{
+    worker_thread_state& thread_state = WorkerThreadState;
+
+    uint64_t epoch = m_ebr_epoch.load();
+    thread_state.ebr_epoch.store(epoch);
+
+    // Nobody needs the epoch to move unless there is something to reclaim.
+    bool has_shared = (m_shared_retired_count.load() > 0);
+    if (thread_state.retire_list.head == nullptr && !has_shared)
+    {
+        return;
+    }
+
+    if (try_advance_epoch())
+    {
+        epoch++;
+        thread_state.ebr_epoch.store(epoch);
+    }
+
+    reclaim_retired_objects(thread_state.retire_list, epoch);
+
+    if (has_shared)
+    {
+        std::lock_guard<internal::spinwait_mutex> lock(m_shared_retire_lock);
+        reclaim_retired_objects(m_shared_retire_list, epoch);
+    }
+}
+
+void scheduler::enter_offline_state()
+{
+    worker_thread_state& thread_state = WorkerThreadState;
+    thread_state.ebr_epoch.store(0);
+
+    // Only this worker reclaims its own list, and it may not run again for a long time, so hand anything 
+    // still waiting over to the shared list where any worker that is still running can reclaim it.
+    internal::retire_list& list = thread_state.retire_list;
+    if (list.head == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard<internal::spinwait_mutex> lock(m_shared_retire_lock);
+
+    // Both lists are in retirement order, merge them so the shared list stays that way.
+    internal::retired_object* shared = m_shared_retire_list.head;
+    internal::retired_object* local = list.head;
+    internal::retired_object* head = nullptr;
+    internal::retired_object** link = &head;
+
+    while (shared != nullptr && local != nullptr)
+    {
+        if (local->epoch < shared->epoch)
+        {
+            *link = local;
+            local = local->next;
+            m_shared_retired_count++;
+        }
+        else
+        {
+            *link = shared;
+            shared = shared->next;
+        }
+        link = &(*link)->next;
+    }
+
+    if (local != nullptr)
+    {
+        *link = local;
+        m_shared_retire_list.tail = list.tail;
+
+        for (; local != nullptr; local = local->next)
+        {
+            m_shared_retired_count++;
+        }
+    }
+    else
+    {
+        *link = shared;
+    }
+
+    m_shared_retire_list.head = head;
+
+    list.head = nullptr;
+    list.tail = nullptr;
+}
+
+bool scheduler::try_advance_epoch()
+{
+    uint64_t epoch = m_ebr_epoch.load();
+
+    for (size_t i = 0; i < m_worker_count; i++)
+    {
+        uint64_t worker_epoch = m_worker_thread_states[i]->ebr_epoch.load();
+        if (worker_epoch != 0 && worker_epoch != epoch)
+        {
+            return false;
+        }
+    }
+
+    uint64_t pump_epoch = m_pump_thread_state->ebr_epoch.load();
+    if (pump_epoch != 0 && pump_epoch != epoch)
+    {
+        return false;
+    }
+
+    return m_ebr_epoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+void scheduler::reclaim_retired_objects(internal::retire_list& list, uint64_t epoch)
+{
+    // Lists are in retirement order, so stop at the first object that might still be read. An object retired 
+    // in epoch e is safe once the epoch has advanced twice, as the second advance needs every worker to have 
+    // been between jobs after the first, which was after the object was retired.
+    while (list.head != nullptr && list.head->epoch + 2 <= epoch)
+    {
+        internal::retired_object* retired = list.head;
+
+        list.head = retired->next;
+        if (list.head == nullptr)
+        {
+            list.tail = nullptr;
+        }
+
+        if (&list == &m_shared_retire_list)
+        {
+            m_shared_retired_count--;
+        }
+
+        retired->reclaim(retired->object);
+        retired->object = nullptr;
+        retired->reclaim = nullptr;
+        retired->next = nullptr;
+
+        m_retired_object_pool.free(retired->pool_index);
+    }
+}
+
+result scheduler::add_job_continuation(size_t job_index, size_t continuation_index)
+{
+    internal::job_definition& def = get_job_definition(job_index);
+
+    size_t dep_index;
+    result res = m_job_dependency_pool.alloc(dep_index);
+    if (res != result::success)
+    {
+        write_log(debug_log_verbosity::warning, debug_log_group::job, "attempt to add job continuation, but dependency pool is empty. Try increasing scheduler::set_max_dependencies.");
+        return res;
+    }
+
+    internal::job_dependency* dep = m_job_dependency_pool.get_index(dep_index);
+    dep->job = job_handle(this, continuation_index);
+
+    // Push onto the list unless the job has already completed, in which case nobody else will release the continuation.
+    internal::job_dependency* head = def.first_continuation.load();
+    while (head != internal::job_definition::completed_continuations)
+    {
+        dep->next = head;
+        if (def.first_continuation.compare_exchange_weak(head, dep))
+        {
+            return result::success;
+        }
+    }
+
+    dep->reset();
+    m_job_dependency_pool.free(dep_index);
+
+    release_continuation(continuation_index);
+    return result::success;
+}
+
+void scheduler::release_job_continuations(size_t job_index)
+{
+    internal::job_definition& def = get_job_definition(job_index);
+
+    internal::job_dependency* dep = def.first_continuation.exchange(internal::job_definition::completed_continuations);
+    while (dep != nullptr)
+    {
+        internal::job_dependency* next = dep->next;
+        size_t pool_index = dep->pool_index;
+
+        release_continuation(dep->job.m_index);
+
+        dep->reset();
+        m_job_dependency_pool.free(pool_index);
+
+        dep = next;
+    }
+}
+
+void scheduler::release_continuation(size_t continuation_index)
+{
+    internal::job_definition& def = get_job_definition(continuation_index);
+
+    // Jobs released on any predecessor are queued by whichever releases them first, the rest do nothing.
+    bool ready = false;
+    if (def.release_on_any)
+    {
+        size_t expected = 1;
+        ready = def.pending_predecessors.compare_exchange_strong(expected, 0);
+    }
+    else
+    {
+        ready = (--def.pending_predecessors == 0);
+    }
+
+    if (ready)
+    {
+        requeue_job(continuation_index);
+    }
+}
+
+void scheduler::write_log(debug_log_verbosity level, debug_log_group group, const char* message, ...)
+{
+    if (m_debug_output_function == nullptr)
+    {
+        return;
+    }
+    if ((int)level > (int)m_debug_output_max_verbosity)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_log_mutex);
+
+    // Format message.
+    va_list list;
+    va_start(list, message);
+    vsnprintf(m_log_buffer, max_log_size, message, list);
+    va_end(list);
+
+    // Format log in format:
+    //	[verbose] warning: message
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+
+    snprintf(m_log_format_buffer, max_log_size, "[%08x][%p][%s] %s: %s\n", 
+        *reinterpret_cast<unsigned int*>(&std::this_thread::get_id()),
+        m_worker_thread_state,
+        internal::debug_log_group_strings[(int)group], 
+        internal::debug_log_verbosity_strings[(int)level], 
+        m_log_buffer);
+
+#else
+
+    snprintf(m_log_format_buffer, max_log_size, "[%s] %s: %s\n",
+        internal::debug_log_group_strings[(int)group],
+        internal::debug_log_verbosity_strings[(int)level],
+        m_log_buffer);
+
+#endif
+
+    m_debug_output_function(level, group, m_log_format_buffer);
+}
+
+void scheduler::worker_entry_point(size_t pool_index, size_t worker_index, const internal::thread& this_thread, const thread_pool& thread_pool)
 {
     auto& thread_state = WorkerThreadState;
 
@@ -805,15 +1789,20 @@ void scheduler::worker_entry_point(size_t pool_index, size_t worker_index, const
     thread_state.job_context.job_def = nullptr;
     thread_state.active_job_context = &thread_state.job_context;
 
-    write_log(debug_log_verbosity::verbose, debug_log_group::worker, "worker started, pool=%zi worker=%zi priorities=0x%08x", pool_index, worker_index, thread_pool.job_priorities);
+    write_log(debug_log_verbosity::verbose, debug_log_group::worker, "worker started, pool=%zi worker=%zi priorities=0x%016llx", pool_index, worker_index, (unsigned long long)thread_pool.job_priorities);
 
     thread_state.active_job_context->enter_scope(profile_scope_type::worker, false, "Worker (pool=%zi, index=%zi)", pool_index, worker_index);
 
     while (!m_destroying)
     {
+        // No job is running on this worker here, so it can't hold any pointers to retired objects.
+        enter_quiescent_state();
+
         execute_next_job(thread_pool.job_priorities, true);
     }
 
+    enter_offline_state();
+
     thread_state.active_job_context->leave_scope();
 
     write_log(debug_log_verbosity::verbose, debug_log_group::worker, "worker terminated, pool=%zi worker=%zi", pool_index, worker_index);
@@ -837,281 +1826,1566 @@ void scheduler::worker_fiber_entry_point(size_t pool_index, size_t worker_index)
     write_log(debug_log_verbosity::verbose, debug_log_group::worker, "fiber terminated, pool=%zi worker=%zi", pool_index, worker_index);
 }
 
-void scheduler::execute_fiber_job()
+void scheduler::execute_fiber_job()
+{
+    worker_thread_state& state = WorkerThreadState;
+
+    internal::job_definition& def = get_job_definition(state.job_index);
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+    // Execute the job assigned to this thread.
+    write_log(debug_log_verbosity::verbose, debug_log_group::job, "executing job, state=%p index=%zi/%zi", &state, state.job_index, state.cloned_job_index.load());
+#endif
+
+    state.active_job_context->enter_scope(profile_scope_type::fiber, true, def.tag);
+
+    // Jobs in a cancelled group still complete so anything depending on them is released, they just skip their work.
+    if (!def.group.is_valid() || !def.group.is_cancelled())
+    {
+        if (def.instance_grain > 0)
+        {
+            execute_job_instances(def);
+        }
+        else
+        {
+            def.work();
+        }
+    }
+
+    // If the job waited or yielded it may have been resumed by a different worker, so fetch the state again.
+    worker_thread_state& completed_state = WorkerThreadState;
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+    // Execute the job assigned to this thread.
+    write_log(debug_log_verbosity::verbose, debug_log_group::job, "finished executing job, state=%p index=%zi/%zi", &completed_state, completed_state.job_index, completed_state.cloned_job_index.load());
+#endif
+
+    completed_state.job_completed = true;
+
+    completed_state.active_job_context->leave_scope();
+}
+
+result scheduler::dispatch_job(size_t index, bool enqueue)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::dispatch_job", this);
+
+    internal::job_definition& def = get_job_definition(index);
+
+    internal::job_status status = def.status.load(std::memory_order_relaxed);
+    if (status != internal::job_status::initialized &&
+        status != internal::job_status::completed)
+    {
+        write_log(debug_log_verbosity::warning, debug_log_group::job, "attempt to dispatch job that is still running, index=%zi", index);
+        return result::already_dispatched;
+    }
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+    write_log(debug_log_verbosity::verbose, debug_log_group::job, "dispatching job, index=%zi", index);
+#endif
+
+    prepare_job_dispatch(def, m_scheduler_timer.get_elapsed_us());
+
+    // Keep track of number of active jobs for idle monitoring. 
+    m_active_jobs.start();
+
+    // If not dependent on anything, enqueue into queues right now.
+    // Put job into a job queue for each priority it holds (not sure why you would want multiple priorities, but might as well support it ...).
+    if (def.pending_predecessors == 0 && enqueue)
+    {
+        requeue_job(index);
+    }
+
+    return result::success;
+}
+
+void scheduler::prepare_job_dispatch(internal::job_definition& def, uint64_t dispatch_time)
+{
+    // Jobs always get an extra ref count until they are complete so they don't get freed while running.
+    increase_job_ref_count(def.index);
+    def.status.store(internal::job_status::pending, std::memory_order_relaxed);
+    def.context.queues_contained_in = 0;
+    def.context.queue_mask = get_job_queue_mask(def);
+    def.context.deadline_time = def.deadline.is_infinite() ? UINT64_MAX : dispatch_time + (def.deadline.duration * 1000);
+    def.context.execution_time = 0;
+    def.context.job_def = &def;
+
+    // Continuations can be added before the job is dispatched, so only clear the list if it was completed by a previous dispatch.
+    internal::job_dependency* completed = internal::job_definition::completed_continuations;
+    def.first_continuation.compare_exchange_strong(completed, nullptr);
+
+    // Discard the value from any previous dispatch, so a future whose work gets skipped this time has no value.
+    if (def.result_slot != nullptr)
+    {
+        def.result_slot->reset();
+    }
+
+    if (def.group.is_valid())
+    {
+        get_group_definition(def.group.m_index).active_jobs.start();
+    }
+}
+
+bool scheduler::can_spawn_child_first(const internal::job_definition& parent, const internal::job_definition& child)
+{
+    // Both jobs need to be ones any worker could pick up from the shared queues, so the parent can be stolen 
+    // and resumed like any other queued job.
+    if (child.pending_predecessors != 0 ||
+        child.thread_affinity != any_worker ||
+        parent.thread_affinity != any_worker ||
+        is_ordered_queued(child) ||
+        is_ordered_queued(parent) ||
+        is_concurrency_limited(child) ||
+        is_concurrency_limited(parent))
+    {
+        return false;
+    }
+
+    // And the child needs to be one this worker would have picked up itself.
+    if (child.numa_node != any_numa_node && (child.numa_node % m_numa_node_count) != get_current_numa_node())
+    {
+        return false;
+    }
+
+    return (get_job_queue_mask(child) & parent.context.queue_mask) != 0;
+}
+
+result scheduler::dispatch_job_child_first(size_t index)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::dispatch_job_child_first", this);
+
+    internal::job_context* context = get_active_job_context();
+    internal::job_definition& def = get_job_definition(index);
+
+    if (context == nullptr || context->job_def == nullptr || !can_spawn_child_first(*context->job_def, def))
+    {
+        return dispatch_job(index);
+    }
+
+    result res = dispatch_job(index, false);
+    if (res != result::success)
+    {
+        return res;
+    }
+
+    // Nobody else can see the child yet, so we can claim it directly.
+    internal::job_status expected = internal::job_status::pending;
+    if (!def.status.compare_exchange_strong(expected, internal::job_status::running))
+    {
+        return requeue_job(index);
+    }
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+    write_log(debug_log_verbosity::verbose, debug_log_group::job, "dispatching child first, index=%zi parent=%zi", index, context->job_def->index);
+#endif
+
+    worker_thread_state& thread_state = WorkerThreadState;
+    thread_state.handoff_job_index = index;
+
+    // Remember the parent so we can resume it ourselves if nobody steals it, if we are already nested too deep 
+    // it will just be picked up from the queues.
+    if (thread_state.continuation_count < max_child_first_depth)
+    {
+        thread_state.continuations[thread_state.continuation_count++] = context->job_def->index;
+    }
+
+    // Switch back to the worker, which queues us once we are off the fiber and then runs the child.
+    thread_state.job_supress_requeue = false;
+    switch_context(thread_state.job_context);
+
+    return result::success;
+}
+
+result scheduler::dispatch_job_instances(size_t index, size_t count, size_t grain)
+{
+    internal::job_definition& def = get_job_definition(index);
+
+    // Don't touch the instance state of a job that is still running, dispatch_job will report the error.
+    internal::job_status status = def.status.load(std::memory_order_relaxed);
+    if (status != internal::job_status::initialized &&
+        status != internal::job_status::completed)
+    {
+        return dispatch_job(index);
+    }
+
+    def.instance_count = count;
+    def.instance_grain = JOBS_MAX(grain, (size_t)1);
+    def.instance_cursor = 0;
+
+    return dispatch_job(index);
+}
+
+void scheduler::execute_job_instances(internal::job_definition& definition)
+{
+    size_t chunk_count = (definition.instance_count + definition.instance_grain - 1) / definition.instance_grain;
+    size_t dispatched_count = 0;
+
+    // Only workers allowed to run this job's priority can help, so don't create more helpers than that.
+    size_t helper_workers = 0;
+    for (size_t i = 0; i < m_thread_pool_count; i++)
+    {
+        thread_pool& pool = m_thread_pools[i];
+        if (((uint64_t)pool.job_priorities & definition.context.queue_mask) != 0)
+        {
+            helper_workers += JOBS_MIN(pool.thread_count, pool.active_thread_limit.load());
+        }
+    }
+
+    size_t helper_count = JOBS_MIN(chunk_count, helper_workers);
+    helper_count = (helper_count > 1) ? helper_count - 1 : 0;
+
+    // Spread the instances out by letting idle workers help. Each worker running instances at the same time 
+    // needs its own fiber and context, so every helper is a job of its own rather than sharing one slot. They 
+    // all claim chunks from the same cursor, so a helper that starts late just finds nothing left and returns. 
+    // If we can't get the resources for helpers we just execute the instances ourselves.
+    counter_handle helpers_complete;
+    if (helper_count > 0 && create_counter(helpers_complete) == result::success)
+    {
+        size_t definition_index = definition.index;
+
+        for (size_t i = 0; i < helper_count; i++)
+        {
+            job_handle helper;
+            if (create_job(helper) != result::success)
+            {
+                break;
+            }
+
+            helper.set_work([this, definition_index]() {
+                run_job_instances(get_job_definition(definition_index));
+            });
+            helper.set_tag(definition.tag);
+            helper.set_stack_size(definition.stack_size);
+            helper.set_priority(definition.job_priority);
+            helper.set_numa_node(definition.numa_node);
+            helper.set_completion_counter(helpers_complete);
+
+            if (helper.dispatch() != result::success)
+            {
+                break;
+            }
+
+            dispatched_count++;
+        }
+    }
+
+    run_job_instances(definition);
+
+    // Helpers reference our definition so we can't complete until they are done with it.
+    if (dispatched_count > 0)
+    {
+        helpers_complete.wait_for(dispatched_count);
+    }
+}
+
+void scheduler::run_job_instances(internal::job_definition& definition)
+{
+    internal::job_definition* runner = get_active_job_definition();
+    assert(runner != nullptr);
+
+    while (!definition.group.is_valid() || !definition.group.is_cancelled())
+    {
+        size_t start = definition.instance_cursor.fetch_add(definition.instance_grain);
+        if (start >= definition.instance_count)
+        {
+            break;
+        }
+
+        size_t end = JOBS_MIN(start + definition.instance_grain, definition.instance_count);
+        for (size_t i = start; i < end; i++)
+        {
+            runner->instance_index = i;
+            definition.work();
+        }
+    }
+
+    runner->instance_index = 0;
+}
+
+result scheduler::dispatch_batch(job_handle* job_array, size_t count)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::dispatch_batch", this);
+
+    uint64_t job_queues = 0;
+    uint64_t dispatch_time = m_scheduler_timer.get_elapsed_us();
+
+    // Set every job up exactly as dispatch_job would, but hold off queueing them so they can go in together.
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t index = job_array[i].m_index;
+        internal::job_definition& def = get_job_definition(index);
+
+        internal::job_status status = def.status.load(std::memory_order_relaxed);
+        if (status != internal::job_status::initialized &&
+            status != internal::job_status::completed)
+        {
+            write_log(debug_log_verbosity::warning, debug_log_group::job, "attempt to dispatch job that is still running, index=%zi", index);
+            return result::already_dispatched;
+        }
+
+        prepare_job_dispatch(def, dispatch_time);
+
+        job_queues |= def.context.queue_mask;
+    }
+
+    // Keep track of number of active jobs for idle monitoring. 
+    m_active_jobs.start(count);
+
+    // Work out which jobs are on the longest paths through the graph so they can be started first.
+    if (m_critical_path_ordering)
+    {
+        calculate_critical_paths(job_array, count);
+    }
+
+    // Dispatch valid jobs.
+    requeue_job_batch(job_array, count, job_queues);
+
+    return result::success;
+}
+
+result scheduler::requeue_job_batch(job_handle* job_array, size_t count, uint64_t job_queues)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::requeue_job_batch", this);
+
+    size_t queued_job_count = 0;
+    uint64_t queued_mask = 0;
+    bool first_iteration = true;
+
+    // The batch goes into the queues of the dispatching threads node, jobs that have
+    // requested a specific different node or thread, or are ordered, get queued individually.
+    size_t batch_node = get_current_numa_node();
+    job_queue* queues = m_pending_job_queues[batch_node];
+
+    for (size_t j = 0; j < count; j++)
+    {
+        internal::job_definition& def = get_job_definition(job_array[j].m_index);
+        if (def.pending_predecessors == 0 && (get_job_numa_node(def) != batch_node || def.thread_affinity != any_worker || is_ordered_queued(def) || is_concurrency_limited(def) || def.affinity_key != no_affinity_key))
+        {
+            requeue_job(def.index);
+        }
+    }
+
+    // Generate a list of jobs for each priority and queue them at once.
+    for (uint64_t remaining_queues = job_queues; remaining_queues != 0; remaining_queues &= remaining_queues - 1)
+    {
+        size_t i = internal::count_trailing_zeros(remaining_queues);
+        uint64_t mask = (uint64_t)1 << i;
+
+        jobs_profile_scope(profile_scope_type::worker, "sort by priority", this);
+
+        // Do an in-place sort.
+        size_t number_with_priority = 0;
+        size_t write_index = 0;
+
+        for (size_t j = 0; j < count; j++)
+        {
+            size_t index = job_array[j].m_index;
+
+            internal::job_definition& def = get_job_definition(index);
+            if (def.pending_predecessors != 0 || get_job_numa_node(def) != batch_node || def.thread_affinity != any_worker || is_ordered_queued(def) || is_concurrency_limited(def) || def.affinity_key != no_affinity_key)
+            {
+                continue;
+            }
+
+            // Store number of valid jobs and a mask of all queues jobs exist in.
+            if (first_iteration)
+            {
+                queued_job_count++;
+            }
+
+            if ((def.context.queue_mask & mask) != 0 && (def.context.queues_contained_in.fetch_or(mask) & mask) == 0)
+            {
+                number_with_priority++;
+
+                if (j != write_index)
+                {
+                    size_t tmp = job_array[write_index].m_index;
+                    job_array[write_index].m_index = job_array[j].m_index;
+                    job_array[j].m_index = tmp;
+                }
+
+                write_index++;
+            }
+        }
+
+        if (number_with_priority > 0)
+        {
+            jobs_profile_scope(profile_scope_type::worker, "batch enqueue", this);
+
+            on_queue_push(queues[i]);
+
+            result res = queues[i].pending_job_indicies.push_batch(
+                &job_array[0].m_index, 
+                reinterpret_cast<size_t>(&job_array[1].m_index) - reinterpret_cast<size_t>(&job_array[0].m_index), 
+                number_with_priority);
+
+            assert(res == result::success);
+
+            m_ready_priorities[batch_node].fetch_or(mask);
+            queued_mask |= mask;
+        }
+
+        first_iteration = false;
+    }
+
+    notify_job_available(queued_job_count, queued_mask);
+
+    return result::success;
+}
+
+result scheduler::requeue_job(size_t index)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::requeue_job", this);
+
+    internal::job_definition& def = get_job_definition(index);
+
+    // Reset the status to pending if its anything else.
+    // @todo: is this neccessary? Most requeues will set the status themselves.
+    internal::job_status status = def.status.load(std::memory_order_relaxed);
+    if (status != internal::job_status::sleeping &&
+        status != internal::job_status::waiting_on_job &&
+        status != internal::job_status::waiting_on_counter)
+    {
+        def.status.store(internal::job_status::pending, std::memory_order_relaxed);
+    }
+
+    // Jobs in a throttled group are held back until the group has room for them.
+    if (!def.context.concurrency_admitted && is_concurrency_limited(def) && !admit_concurrency_limited_job(def))
+    {
+        return result::success;
+    }
+
+    // Thread-affine jobs bypass the shared queues entirely.
+    if (def.thread_affinity != any_worker)
+    {
+        return requeue_affine_job(index);
+    }
+
+    // As are jobs ordered by deadline or critical path.
+    if (is_ordered_queued(def))
+    {
+        return requeue_ordered_job(index);
+    }
+
+    // Jobs with an affinity key, or resuming on a fiber, go to the worker whose caches hold their data.
+    size_t preferred_worker = get_preferred_worker(def);
+    if (preferred_worker != SIZE_MAX)
+    {
+        return requeue_local_job(index, preferred_worker);
+    }
+
+    size_t numa_node = get_job_numa_node(def);
+
+    // Put job into the queues decided on dispatch, this is generally a single queue even for jobs with multiple priorities.
+    for (uint64_t remaining_queues = def.context.queue_mask & ~def.context.queues_contained_in; remaining_queues != 0; remaining_queues &= remaining_queues - 1)
+    {
+        size_t i = internal::count_trailing_zeros(remaining_queues);
+        uint64_t mask = (uint64_t)1 << i;
+
+        // Priority inheritance may have put the job in this queue since we looked.
+        if ((def.context.queues_contained_in.fetch_or(mask) & mask) == 0)
+        {
+            push_to_queue(index, numa_node, i);
+        }
+    }
+
+    notify_job_available(1, def.context.queue_mask);
+
+    return result::success;
+}
+
+size_t scheduler::get_preferred_worker(const internal::job_definition& definition)
+{
+    if (m_worker_count == 0)
+    {
+        return SIZE_MAX;
+    }
+
+    size_t first_worker;
+    if (definition.affinity_key != no_affinity_key)
+    {
+        first_worker = (size_t)(hash_affinity_key(definition.affinity_key) % m_worker_count);
+    }
+    else if (definition.context.has_fiber && definition.context.last_worker != SIZE_MAX)
+    {
+        first_worker = definition.context.last_worker;
+    }
+    else
+    {
+        return SIZE_MAX;
+    }
+
+    // Walk forward from the preferred worker to the first one that will actually execute the job, so the 
+    // same key keeps mapping to the same worker.
+    for (size_t i = 0; i < m_worker_count; i++)
+    {
+        worker_thread_state* state = m_worker_thread_states[(first_worker + i) % m_worker_count];
+        thread_pool& pool = m_thread_pools[state->pool_index];
+
+        if (((uint64_t)pool.job_priorities & definition.context.queue_mask) == 0)
+        {
+            continue;
+        }
+        if (definition.numa_node != any_numa_node && (definition.numa_node % m_numa_node_count) != state->numa_node)
+        {
+            continue;
+        }
+        if (state->pool_worker_index >= JOBS_MIN(pool.active_thread_count.load(), pool.active_thread_limit.load()))
+        {
+            continue;
+        }
+
+        return state->worker_index;
+    }
+
+    return SIZE_MAX;
+}
+
+result scheduler::requeue_local_job(size_t index, size_t worker_index)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::requeue_local_job", this);
+
+    internal::job_definition& def = get_job_definition(index);
+    worker_thread_state* state = m_worker_thread_states[worker_index];
+
+    // A job claimed out of band keeps its old entry, which serves just as well now it's pending again.
+    if (!def.context.in_local_queue.exchange(true))
+    {
+        result res = state->local_job_queue.pending_job_indicies.push(index);
+        assert(res == result::success);
+
+        state->local_available_jobs++;
+        state->local_priorities.fetch_or(def.context.queue_mask);
+        m_local_job_count++;
+    }
+
+    notify_job_available(1, def.context.queue_mask);
+
+    return result::success;
+}
+
+result scheduler::requeue_affine_job(size_t index)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::requeue_affine_job", this);
+
+    internal::job_definition& def = get_job_definition(index);
+
+    worker_thread_state* state = (def.thread_affinity == pump_thread) ? m_pump_thread_state : m_worker_thread_states[def.thread_affinity % m_worker_count];
+
+    if (!def.context.in_affine_queue)
+    {
+        def.context.in_affine_queue = true;
+
+        result res = state->affine_job_queue.pending_job_indicies.push(index);
+        assert(res == result::success);
+
+        state->affine_available_jobs++;
+    }
+
+    // The pump thread picks the job up next time it pumps, but workers need waking up. Only the 
+    // target worker can run the job, and it services its own queue even if it is parked.
+    if (!state->is_pump_thread)
+    {
+        wake_worker(state->worker_index);
+    }
+
+    return result::success;
+}
+
+result scheduler::requeue_ordered_job(size_t index)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::requeue_ordered_job", this);
+
+    internal::job_definition& def = get_job_definition(index);
+
+    if (def.context.in_ordered_queue)
+    {
+        return result::success;
+    }
+
+    def.context.in_ordered_queue = true;
+
+    // Prefer the calling worker, otherwise spread between workers that can execute the job.
+    worker_thread_state* state = nullptr;
+    if (m_worker_thread_state != nullptr && !m_worker_thread_state->is_pump_thread && 
+        ((uint64_t)m_thread_pools[m_worker_thread_state->pool_index].job_priorities & def.context.queue_mask) != 0)
+    {
+        state = m_worker_thread_state;
+    }
+    else
+    {
+        state = m_worker_thread_states[0];
+
+        for (size_t i = 0; i < m_worker_count; i++)
+        {
+            worker_thread_state* candidate = m_worker_thread_states[m_ordered_queue_cursor++ % m_worker_count];
+            if (((uint64_t)m_thread_pools[candidate->pool_index].job_priorities & def.context.queue_mask) != 0)
+            {
+                state = candidate;
+                break;
+            }
+        }
+    }
+
+    // Jobs are ordered by priority first, then deadline, then longest critical path. Deadlines across 
+    // priorities ignore the priority so they come before everything.
+    const uint64_t value_mask = ((uint64_t)1 << ordered_key_value_bits) - 1;
+    uint64_t key = 0;
+
+    if (m_deadline_policy != deadline_policy::ignored && !def.deadline.is_infinite())
+    {
+        key = JOBS_MIN(def.context.deadline_time, value_mask);
+    }
+    else
+    {
+        key = value_mask - JOBS_MIN(def.context.critical_path, value_mask);
+    }
+
+    if (m_deadline_policy != deadline_policy::across_priorities || def.deadline.is_infinite())
+    {
+        uint64_t priority_index = internal::count_trailing_zeros(def.context.queue_mask);
+        key |= (priority_index << ordered_key_value_bits);
+    }
+
+    {
+        ordered_queue& queue = state->ordered_job_queue;
+        std::lock_guard<internal::spinwait_mutex> lock(queue.lock);
+
+        assert(queue.count < queue.capacity);
+
+        queue.entries[queue.count++] = { key, def.context.queue_mask, index };
+        std::push_heap(queue.entries, queue.entries + queue.count, std::greater<ordered_entry>());
+
+        queue.top_key = queue.entries[0].key;
+        queue.top_queue_mask = queue.entries[0].queue_mask;
+    }
+
+    m_ordered_job_count++;
+
+    notify_job_available(1, def.context.queue_mask);
+
+    return result::success;
+}
+
+bool scheduler::pop_ordered_entry(ordered_queue& queue, priority priorities, uint64_t key_limit, ordered_entry& entry)
+{
+    if (queue.count == 0 || queue.entries[0].key >= key_limit)
+    {
+        return false;
+    }
+
+    if ((queue.entries[0].queue_mask & (uint64_t)priorities) != 0)
+    {
+        std::pop_heap(queue.entries, queue.entries + queue.count, std::greater<ordered_entry>());
+        entry = queue.entries[--queue.count];
+    }
+    else
+    {
+        // The top is for another pool, find the lowest key below it that we can execute.
+        size_t best_index = queue.count;
+        for (size_t i = 1; i < queue.count; i++)
+        {
+            if (queue.entries[i].key < key_limit && 
+                (queue.entries[i].queue_mask & (uint64_t)priorities) != 0 &&
+                (best_index == queue.count || queue.entries[i].key < queue.entries[best_index].key))
+            {
+                best_index = i;
+            }
+        }
+
+        if (best_index == queue.count)
+        {
+            return false;
+        }
+
+        entry = queue.entries[best_index];
+        queue.entries[best_index] = queue.entries[--queue.count];
+        std::make_heap(queue.entries, queue.entries + queue.count, std::greater<ordered_entry>());
+    }
+
+    queue.top_key = (queue.count > 0) ? queue.entries[0].key : UINT64_MAX;
+    queue.top_queue_mask = (queue.count > 0) ? queue.entries[0].queue_mask : 0;
+
+    return true;
+}
+
+bool scheduler::get_next_ordered_job(size_t& job_index, priority priorities)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::get_next_ordered_job", this);
+
+    // Jobs may only be taken ahead of priorities lower than the highest with queued work.
+    uint64_t key_limit = UINT64_MAX;
+    uint64_t ready = get_ready_priorities() & (uint64_t)priorities;
+
+    // The top priority level shifts the key out of range, in which case there is no limit.
+    if (ready != 0)
+    {
+        uint64_t highest_ready = internal::count_trailing_zeros(ready);
+        if (highest_ready + 1 < ((uint64_t)1 << (64 - ordered_key_value_bits)))
+        {
+            key_limit = (highest_ready + 1) << ordered_key_value_bits;
+        }
+    }
+
+    // Find the lowest key out of every workers queue, taking our own on a tie.
+    worker_thread_state* own_state = m_worker_thread_state;
+    worker_thread_state* best_state = nullptr;
+    uint64_t best_key = key_limit;
+
+    if (own_state != nullptr && 
+        own_state->ordered_job_queue.top_key.load() < best_key && 
+        (own_state->ordered_job_queue.top_queue_mask.load() & (uint64_t)priorities) != 0)
+    {
+        best_state = own_state;
+        best_key = own_state->ordered_job_queue.top_key.load();
+    }
+
+    for (size_t i = 0; i < m_worker_count; i++)
+    {
+        worker_thread_state* state = m_worker_thread_states[i];
+        uint64_t key = state->ordered_job_queue.top_key.load();
+
+        if (key < best_key && (state->ordered_job_queue.top_queue_mask.load() & (uint64_t)priorities) != 0)
+        {
+            best_state = state;
+            best_key = key;
+        }
+    }
+
+    ordered_entry entry;
+    bool found = false;
+
+    if (best_state != nullptr)
+    {
+        ordered_queue& queue = best_state->ordered_job_queue;
+        std::lock_guard<internal::spinwait_mutex> lock(queue.lock);
+
+        found = pop_ordered_entry(queue, priorities, key_limit, entry);
+    }
+    else
+    {
+        // Every top we could execute is out of range, but a top we can't execute may be hiding 
+        // entries we can underneath it, so look through those queues.
+        for (size_t i = 0; i < m_worker_count && !found; i++)
+        {
+            ordered_queue& queue = m_worker_thread_states[i]->ordered_job_queue;
+            if (queue.top_key.load() >= key_limit)
+            {
+                continue;
+            }
+
+            std::lock_guard<internal::spinwait_mutex> lock(queue.lock);
+            found = pop_ordered_entry(queue, priorities, key_limit, entry);
+        }
+    }
+
+    // Someone may have beaten us to it.
+    if (!found)
+    {
+        return false;
+    }
+
+    m_ordered_job_count--;
+
+    internal::job_definition& def = get_job_definition(entry.job_index);
+    def.context.in_ordered_queue = false;
+
+    internal::job_status expected = internal::job_status::pending;
+    if (!def.status.compare_exchange_strong(expected, internal::job_status::running))
+    {
+        return false;
+    }
+
+    assert(def.pending_predecessors == 0);
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+    write_log(debug_log_verbosity::verbose, debug_log_group::worker, "Picked up %zi from ordered queue", entry.job_index);
+#endif
+
+    m_available_jobs.finish();
+
+    job_index = entry.job_index;
+    return true;
+}
+
+bool scheduler::is_ordered_queued(const internal::job_definition& definition)
+{
+    return (m_deadline_policy != deadline_policy::ignored && !definition.deadline.is_infinite()) ||
+           (m_critical_path_ordering && definition.context.critical_path != 0);
+}
+
+bool scheduler::is_concurrency_limited(const internal::job_definition& definition)
+{
+    return definition.group.is_valid() && get_group_definition(definition.group.m_index).concurrency_limit.load() != 0;
+}
+
+bool scheduler::admit_concurrency_limited_job(internal::job_definition& definition)
+{
+    internal::group_definition& group_def = get_group_definition(definition.group.m_index);
+
+    internal::optional_lock<internal::spinwait_mutex> lock(group_def.throttle_mutex);
+
+    if (group_def.admitted_jobs < group_def.concurrency_limit.load())
+    {
+        group_def.admitted_jobs++;
+        definition.context.concurrency_admitted = true;
+        return true;
+    }
+
+    definition.context.next_throttled = nullptr;
+    if (group_def.throttled_tail != nullptr)
+    {
+        group_def.throttled_tail->context.next_throttled = &definition;
+    }
+    else
+    {
+        group_def.throttled_head = &definition;
+    }
+    group_def.throttled_tail = &definition;
+
+    return false;
+}
+
+void scheduler::release_concurrency_limit(internal::job_definition& definition)
+{
+    internal::group_definition& group_def = get_group_definition(definition.group.m_index);
+
+    internal::job_definition* next = nullptr;
+    {
+        internal::optional_lock<internal::spinwait_mutex> lock(group_def.throttle_mutex);
+
+        definition.context.concurrency_admitted = false;
+        group_def.admitted_jobs--;
+
+        if (group_def.throttled_head != nullptr && group_def.admitted_jobs < group_def.concurrency_limit.load())
+        {
+            next = group_def.throttled_head;
+
+            group_def.throttled_head = next->context.next_throttled;
+            if (group_def.throttled_head == nullptr)
+            {
+                group_def.throttled_tail = nullptr;
+            }
+
+            next->context.next_throttled = nullptr;
+            next->context.concurrency_admitted = true;
+            group_def.admitted_jobs++;
+        }
+    }
+
+    if (next != nullptr)
+    {
+        requeue_job(next->index);
+    }
+}
+
+void scheduler::record_deadline_completion(const internal::job_definition& definition)
+{
+    m_stat_deadline_jobs_completed++;
+
+    uint64_t now = m_scheduler_timer.get_elapsed_us();
+    if (now <= definition.context.deadline_time)
+    {
+        return;
+    }
+
+    m_stat_deadline_misses++;
+
+    uint64_t overrun = now - definition.context.deadline_time;
+    uint64_t max_overrun = m_stat_max_deadline_overrun_us.load();
+    while (overrun > max_overrun && !m_stat_max_deadline_overrun_us.compare_exchange_weak(max_overrun, overrun))
+    {
+    }
+}
+
+result scheduler::get_stats(scheduler_stats& stats)
+{
+    stats.deadline_jobs_completed = m_stat_deadline_jobs_completed.load();
+    stats.deadline_misses = m_stat_deadline_misses.load();
+    stats.max_deadline_overrun_us = m_stat_max_deadline_overrun_us.load();
+    stats.priority_inversions = m_stat_priority_inversions.load();
+    stats.priority_boosts = m_stat_priority_boosts.load();
+    stats.inline_waits = m_stat_inline_waits.load();
+    stats.local_steals = m_stat_local_steals.load();
+
+    return result::success;
+}
+
+result scheduler::reset_stats()
+{
+    m_stat_deadline_jobs_completed = 0;
+    m_stat_deadline_misses = 0;
+    m_stat_max_deadline_overrun_us = 0;
+    m_stat_priority_inversions = 0;
+    m_stat_priority_boosts = 0;
+    m_stat_inline_waits = 0;
+    m_stat_local_steals = 0;
+
+    return result::success;
+}
+
+void* scheduler::alloc_memory(size_t size, size_t alignment)
+{
+    // Memory functions are only trampolined once initialized.
+    if (!m_initialized)
+    {
+        return nullptr;
+    }
+
+    return m_memory_functions.user_alloc(size, alignment);
+}
+
+void scheduler::free_memory(void* ptr)
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+
+    m_memory_functions.user_free(ptr);
+}
+
+size_t scheduler::inherit_priority(size_t job_index, uint64_t queue_mask, size_t depth)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::inherit_priority", this);
+
+    internal::job_definition& def = get_job_definition(job_index);
+
+    internal::job_status status = def.status.load();
+    if (status == internal::job_status::initialized || status == internal::job_status::completed)
+    {
+        return 0;
+    }
+
+    uint64_t job_queue_mask = def.context.queue_mask.load();
+    uint64_t boost_mask = queue_mask & (~queue_mask + 1);
+    uint64_t job_mask = job_queue_mask & (~job_queue_mask + 1);
+    size_t boosted_count = 0;
+
+    // Lower bits are higher priorities, so only boost if the waiter is in a lower bit than the job. Another 
+    // worker may be boosting the same job, the atomic or decides which of us queues it.
+    if (boost_mask != 0 && job_mask > boost_mask && def.thread_affinity == any_worker && !is_ordered_queued(def) &&
+        (def.context.queue_mask.fetch_or(boost_mask) & boost_mask) == 0)
+    {
+        boosted_count++;
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+        write_log(debug_log_verbosity::verbose, debug_log_group::job, "boosting job priority, index=%zi queue_mask=0x%016llx", job_index, (unsigned long long)def.context.queue_mask.load());
+#endif
+
+        // If the job is already queued, put it in the boosted queue as well. Whichever copy 
+        // gets picked up first executes it. Otherwise it will go in when next requeued.
+        if (status == internal::job_status::pending && 
+            def.pending_predecessors == 0 && 
+            def.context.queues_contained_in.load() != 0 && 
+            (def.context.queues_contained_in.fetch_or(boost_mask) & boost_mask) == 0)
+        {
+            push_to_queue(job_index, get_job_numa_node(def), internal::count_trailing_zeros(boost_mask));
+
+            // The job is already counted as available, but workers that can execute the boosted priority may be asleep.
+            wake_idle_workers(1, boost_mask);
+        }
+    }
+
+    if (depth >= max_priority_inheritance_depth)
+    {
+        return boosted_count;
+    }
+
+    // Boost anything this job is still waiting on before it can run. The lock stops the lists being 
+    // cleared under us, and the handles in them hold a reference to each job while we follow them.
+    std::lock_guard<internal::spinwait_mutex> lock(def.dependency_lock);
+
+    if (def.pending_predecessors > 0)
+    {
+        for (internal::job_dependency* dep = def.first_predecessor; dep != nullptr; dep = dep->next)
+        {
+            boosted_count += inherit_priority(dep->job.m_index, queue_mask, depth + 1);
+        }
+    }
+    else if (status == internal::job_status::waiting_on_job && def.wait_job.is_valid())
+    {
+        boosted_count += inherit_priority(def.wait_job.m_index, queue_mask, depth + 1);
+    }
+
+    return boosted_count;
+}
+
+void scheduler::calculate_critical_paths(job_handle* job_array, size_t count)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::calculate_critical_paths", this);
+
+    std::lock_guard<std::mutex> lock(m_critical_path_mutex);
+
+    size_t batch_pass = ++m_critical_path_pass;
+    size_t pass = ++m_critical_path_pass;
+
+    // Mark the jobs being dispatched, these and jobs that have not been dispatched yet are the only ones
+    // whose paths can be changed. Anything else may already be queued by its current path.
+    for (size_t i = 0; i < count; i++)
+    {
+        get_job_definition(job_array[i].m_index).context.critical_path_pass = batch_pass;
+    }
+
+    // Depth-first walk of the successors of each job, calculating path lengths on the way back up. Each job
+    // is only visited once per pass, so the stack can never hold more than the total number of jobs.
+    for (size_t i = 0; i < count; i++)
+    {
+        internal::job_definition& root = get_job_definition(job_array[i].m_index);
+        if (root.context.critical_path_pass == pass)
+        {
+            continue;
+        }
+
+        size_t depth = 0;
+
+        root.context.critical_path_pass = pass;
+        root.context.critical_path_cursor = root.first_successor;
+        root.context.critical_path = 0;
+        m_critical_path_stack[depth++] = root.index;
+
+        while (depth > 0)
+        {
+            internal::job_definition& def = get_job_definition(m_critical_path_stack[depth - 1]);
+
+            if (def.context.critical_path_cursor != nullptr)
+            {
+                internal::job_definition& successor = get_job_definition(def.context.critical_path_cursor->job.m_index);
+                def.context.critical_path_cursor = def.context.critical_path_cursor->next;
+
+                if (successor.context.critical_path_pass != pass && 
+                    successor.context.critical_path_pass != batch_pass &&
+                    successor.status.load() != internal::job_status::initialized)
+                {
+                    // Dispatched by an earlier call, use the path it was queued with.
+                    def.context.critical_path = JOBS_MAX(def.context.critical_path, successor.context.critical_path);
+                }
+                else if (successor.context.critical_path_pass != pass)
+                {
+                    assert(depth < m_max_jobs);
+
+                    successor.context.critical_path_pass = pass;
+                    successor.context.critical_path_cursor = successor.first_successor;
+                    successor.context.critical_path = 0;
+                    m_critical_path_stack[depth++] = successor.index;
+                }
+                else
+                {
+                    // Already visited this pass, its path is final unless there is a cycle.
+                    def.context.critical_path = JOBS_MAX(def.context.critical_path, successor.context.critical_path);
+                }
+            }
+            else
+            {
+                // All successors visited, critical_path currently holds the longest of theirs.
+                def.context.critical_path += get_job_cost(def);
+                depth--;
+
+                if (depth > 0)
+                {
+                    internal::job_definition& parent = get_job_definition(m_critical_path_stack[depth - 1]);
+                    parent.context.critical_path = JOBS_MAX(parent.context.critical_path, def.context.critical_path);
+                }
+            }
+        }
+    }
+}
+
+uint64_t scheduler::get_job_cost(const internal::job_definition& definition)
+{
+    if (definition.cost_hint != 0)
+    {
+        return definition.cost_hint;
+    }
+
+    if (definition.tag[0] != '\0')
+    {
+        cost_history_entry* entry = get_cost_history_entry(definition.tag, false);
+        if (entry != nullptr)
+        {
+            uint64_t cost = entry->average_cost.load();
+            if (cost != 0)
+            {
+                return cost;
+            }
+        }
+    }
+
+    return default_job_cost;
+}
+
+void scheduler::record_job_cost(const internal::job_definition& definition)
+{
+    if (definition.tag[0] == '\0')
+    {
+        return;
+    }
+
+    cost_history_entry* entry = get_cost_history_entry(definition.tag, true);
+    if (entry == nullptr)
+    {
+        return;
+    }
+
+    // Exponential moving average, weighted 1/8th towards the new sample.
+    uint64_t sample = JOBS_MAX(definition.context.execution_time, (uint64_t)1);
+    uint64_t average = entry->average_cost.load();
+
+    entry->average_cost = (average == 0) ? sample : (average - (average / 8) + (sample / 8));
+}
+
+scheduler::cost_history_entry* scheduler::get_cost_history_entry(const char* tag, bool create)
+{
+    // FNV-1a, 0 is reserved for unused entries.
+    uint64_t hash = 14695981039346656037ull;
+    for (const char* c = tag; *c != '\0'; c++)
+    {
+        hash = (hash ^ (uint8_t)*c) * 1099511628211ull;
+    }
+    if (hash == 0)
+    {
+        hash = 1;
+    }
+
+    for (size_t i = 0; i < max_cost_history_entries; i++)
+    {
+        cost_history_entry& entry = m_cost_history[(hash + i) % max_cost_history_entries];
+
+        uint64_t entry_hash = entry.tag_hash.load();
+        if (entry_hash == hash)
+        {
+            return &entry;
+        }
+        else if (entry_hash == 0)
+        {
+            if (!create)
+            {
+                return nullptr;
+            }
+
+            if (entry.tag_hash.compare_exchange_strong(entry_hash, hash) || entry_hash == hash)
+            {
+                return &entry;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+bool scheduler::get_next_job_from_queue(size_t& output_job_index, job_queue& queue, uint64_t queue_mask)
+{
+    bool shifted_last_iteration = false;
+
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::get_next_job_from_queue", this);
+
+    size_t count = queue.pending_job_indicies.count();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t job_index;
+
+        result res = queue.pending_job_indicies.pop(job_index);
+        if (res == result::empty)
+        {
+            break;
+        }
+
+        internal::job_definition& def = get_job_definition(job_index);
+
+        // If job hasn't already started running (because its been picked up from another queue),
+        // the mark it as running and return it.
+        internal::job_status expected = internal::job_status::pending;
+        if (def.status.compare_exchange_strong(expected, internal::job_status::running))
+        {
+            if (queue_mask == 0)
+            {
+                def.context.in_affine_queue = false;
+            }
+            else
+            {
+                def.context.queues_contained_in &= ~queue_mask;
+            }
+            assert(def.pending_predecessors == 0);
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+            write_log(debug_log_verbosity::verbose, debug_log_group::worker, "Picked up %zi from queue 0x%016llx", job_index, (unsigned long long)queue_mask);
+#endif
+
+            if (m_scheduling_policy == scheduling_policy::aging)
+            {
+                queue.last_service_time = m_scheduler_timer.get_elapsed_ms();
+            }
+
+            output_job_index = job_index;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool scheduler::get_next_job_from_local_queue(size_t& job_index, size_t worker_index)
 {
-    worker_thread_state& state = WorkerThreadState;
+    worker_thread_state& state = *m_worker_thread_states[worker_index];
 
-    internal::job_definition& def = get_job_definition(state.job_index);
+    size_t index;
+    while (state.local_job_queue.pending_job_indicies.pop(index) == result::success)
+    {
+        state.local_available_jobs--;
+        m_local_job_count--;
+
+        // Entries can be left behind by jobs that were claimed some other way, those are just skipped. The 
+        // flag is cleared first so a requeue racing with us pushes a fresh entry rather than relying on this one.
+        internal::job_definition& def = get_job_definition(index);
+        def.context.in_local_queue = false;
 
+        internal::job_status expected = internal::job_status::pending;
+        if (def.status.compare_exchange_strong(expected, internal::job_status::running))
+        {
 #if defined(JOBS_USE_VERBOSE_LOGGING)
-    // Execute the job assigned to this thread.
-    write_log(debug_log_verbosity::verbose, debug_log_group::job, "executing job, state=%p index=%zi/%zi", &state, state.job_index, state.cloned_job_index.load());
+            write_log(debug_log_verbosity::verbose, debug_log_group::worker, "Picked up %zi from local queue of worker %zi", index, worker_index);
 #endif
 
-    state.active_job_context->enter_scope(profile_scope_type::fiber, true, def.tag);
-
-    def.work();
+            m_available_jobs.finish();
 
-#if defined(JOBS_USE_VERBOSE_LOGGING)
-    // Execute the job assigned to this thread.
-    write_log(debug_log_verbosity::verbose, debug_log_group::job, "finished executing job, state=%p index=%zi/%zi", &state, state.job_index, state.cloned_job_index.load());
-#endif
+            job_index = index;
+            return true;
+        }
+    }
 
-    state.job_completed = true;
+    state.local_priorities = 0;
 
-    state.active_job_context->leave_scope();
+    return false;
 }
 
-result scheduler::dispatch_job(size_t index)
+bool scheduler::steal_local_job(size_t& job_index, priority priorities)
 {
-    jobs_profile_scope(profile_scope_type::worker, "scheduler::dispatch_job", this);
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::steal_local_job", this);
 
-    internal::job_definition& def = get_job_definition(index);
+    size_t own_index = WorkerThreadState.worker_index;
 
-    internal::job_status status = def.status.load(std::memory_order_relaxed);
-    if (status != internal::job_status::initialized &&
-        status != internal::job_status::completed)
+    for (size_t i = 0; i < m_worker_count; i++)
     {
-        write_log(debug_log_verbosity::warning, debug_log_group::job, "attempt to dispatch job that is still running, index=%zi", index);
-        return result::already_dispatched;
-    }
-
-#if defined(JOBS_USE_VERBOSE_LOGGING)
-    write_log(debug_log_verbosity::verbose, debug_log_group::job, "dispatching job, index=%zi", index);
-#endif
+        size_t victim_index = (own_index + i) % m_worker_count;
+        worker_thread_state& victim = *m_worker_thread_states[victim_index];
 
-    // Jobs always get an extra ref count until they are complete so they don't get freed while running.
-    increase_job_ref_count(index);
-    def.status.store(internal::job_status::pending, std::memory_order_relaxed);
-    def.context.queues_contained_in = 0;
-    def.context.job_def = &def;
+        // Jobs are only queued on workers that execute their priority, so anything we can't execute
+        // ourselves could be in the queue of a worker whose priorities aren't a subset of ours.
+        if (victim.local_available_jobs.load() == 0 ||
+            ((uint64_t)m_thread_pools[victim.pool_index].job_priorities & ~(uint64_t)priorities) != 0)
+        {
+            continue;
+        }
 
-    // Keep track of number of active jobs for idle monitoring. 
-    m_active_job_count++;
+        if (get_next_job_from_local_queue(job_index, victim_index))
+        {
+            if (victim_index != own_index)
+            {
+                m_stat_local_steals++;
+            }
 
-    // If not dependent on anything, enqueue into queues right now.
-    // Put job into a job queue for each priority it holds (not sure why you would want multiple priorities, but might as well support it ...).
-    if (def.pending_predecessors == 0)
-    {
-        requeue_job(index);
+            return true;
+        }
     }
 
-    return result::success;
+    return false;
 }
 
-result scheduler::dispatch_batch(job_handle* job_array, size_t count)
+bool scheduler::get_next_job_from_priority(size_t& job_index, size_t priority_index)
 {
-    jobs_profile_scope(profile_scope_type::worker, "scheduler::dispatch_batch", this);
-
-    size_t job_queues = 0;
+    size_t local_node = get_current_numa_node();
+    uint64_t mask = (uint64_t)1 << priority_index;
 
-    // Jobs always get an extra ref count until they are complete so they don't get freed while running.
-    for (size_t i = 0; i < count; i++)
+    for (size_t j = 0; j < m_numa_node_count; j++)
     {
-        size_t index = job_array[i].m_index;
-        internal::job_definition& def = get_job_definition(index);
-
-        internal::job_status status = def.status.load(std::memory_order_relaxed);
-        if (status != internal::job_status::initialized &&
-            status != internal::job_status::completed)
+        size_t node = (local_node + j) % m_numa_node_count;
+        if ((m_ready_priorities[node].load() & mask) != 0 && get_next_job_from_node(job_index, node, priority_index))
         {
-            write_log(debug_log_verbosity::warning, debug_log_group::job, "attempt to dispatch job that is still running, index=%zi", index);
-            return result::already_dispatched;
+            return true;
         }
+    }
 
-        increase_job_ref_count(index);
-        def.status.store(internal::job_status::pending, std::memory_order_relaxed);
-        def.context.queues_contained_in = 0;
-        def.context.job_def = &def;
+    return false;
+}
 
-        job_queues |= (size_t)def.job_priority;
-    }
+bool scheduler::get_next_job_from_node(size_t& job_index, size_t numa_node, size_t priority_index)
+{
+    job_queue& queue = m_pending_job_queues[numa_node][priority_index];
+    uint64_t mask = (uint64_t)1 << priority_index;
 
-    // Keep track of number of active jobs for idle monitoring. 
-    m_active_job_count.fetch_add(count);
+    if (get_next_job_from_queue(job_index, queue, mask))
+    {
+        m_available_jobs.finish();
+        return true;
+    }
 
-    // Dispatch valid jobs.
-    requeue_job_batch(job_array, count, job_queues);
+    // Queue is empty so take it out of the ready bitmap. Something may have been pushed 
+    // since we looked, so check again once the bit is cleared.
+    m_ready_priorities[numa_node].fetch_and(~mask);
+    if (queue.pending_job_indicies.count() > 0)
+    {
+        m_ready_priorities[numa_node].fetch_or(mask);
+    }
 
-    return result::success;
+    return false;
 }
 
-result scheduler::requeue_job_batch(job_handle* job_array, size_t count, size_t job_queues)
+void scheduler::push_to_queue(size_t job_index, size_t numa_node, size_t priority_index)
 {
-    jobs_profile_scope(profile_scope_type::worker, "scheduler::requeue_job_batch", this);
+    job_queue& queue = m_pending_job_queues[numa_node][priority_index];
 
-    size_t queued_job_count = 0;
-    bool first_iteration = true;
+    on_queue_push(queue);
 
-    // Generate a list of jobs for each priority and queue them at once.
-    for (size_t i = 0; i < (int)priority::count; i++)
-    {
-        int mask = 1 << i;
+    result res = queue.pending_job_indicies.push(job_index);
+    assert(res == result::success);
 
-        // After first iteration we know what queues jobs exists for
-        // any we don't care about.
-        if (((size_t)job_queues & mask) == 0)
-        {
-            continue;
-        }
+    m_ready_priorities[numa_node].fetch_or((uint64_t)1 << priority_index);
+}
 
-        jobs_profile_scope(profile_scope_type::worker, "sort by priority", this);
+bool scheduler::get_next_weighted_fair_job(size_t& job_index, priority priorities)
+{
+    worker_thread_state& state = WorkerThreadState;
 
-        // Do an in-place sort.
-        size_t number_with_priority = 0;
-        size_t write_index = 0;
+    uint64_t ready = 0;
+    for (size_t j = 0; j < m_numa_node_count; j++)
+    {
+        ready |= m_ready_priorities[j].load();
+    }
+    ready &= (uint64_t)priorities;
 
-        for (size_t j = 0; j < count; j++)
-        {
-            size_t index = job_array[j].m_index;
+    // Deficit round-robin, each priority gets to execute up to its weight in jobs before we move onto 
+    // the next ready one. Empty priorities are dropped from the ready set and forfeit their turn.
+    while (ready != 0)
+    {
+        size_t priority_index = state.fair_priority_index;
+        uint64_t mask = (uint64_t)1 << priority_index;
 
-            internal::job_definition& def = get_job_definition(index);
-            if (def.pending_predecessors != 0)
+        if ((ready & mask) != 0 && state.fair_deficit > 0)
+        {
+            if (get_next_job_from_priority(job_index, priority_index))
             {
-                continue;
+                state.fair_deficit--;
+                return true;
             }
 
-            // Store number of valid jobs and a mask of all queues jobs exist in.
-            if (first_iteration)
+            ready &= ~mask;
+            if (ready == 0)
             {
-                queued_job_count++;
+                break;
             }
+        }
 
-            if (((size_t)def.job_priority & mask) != 0 && (def.context.queues_contained_in & mask) == 0)
-            {
-                def.context.queues_contained_in |= mask;
-                number_with_priority++;
+        // Move onto the next ready priority, wrapping around to the highest.
+        uint64_t later = ready & ~((mask << 1) - 1);
+        state.fair_priority_index = internal::count_trailing_zeros(later != 0 ? later : ready);
+        state.fair_deficit = m_priority_weights[state.fair_priority_index];
+    }
 
-                if (i != write_index)
-                {
-                    size_t tmp = job_array[write_index].m_index;
-                    job_array[write_index].m_index = job_array[j].m_index;
-                    job_array[j].m_index = tmp;
-                }
+    return false;
+}
 
-                write_index++;
-            }
-        }
+bool scheduler::get_next_aged_job(size_t& job_index, priority priorities)
+{
+    uint64_t now = m_scheduler_timer.get_elapsed_ms();
+    if (now < m_priority_aging_threshold.duration)
+    {
+        return false;
+    }
 
-        if (number_with_priority > 0)
-        {
-            jobs_profile_scope(profile_scope_type::worker, "batch enqueue", this);
+    // Find whichever queue has gone without being serviced the longest.
+    uint64_t oldest_time = now - m_priority_aging_threshold.duration;
+    size_t oldest_node = 0;
+    size_t oldest_priority_index = 0;
+    bool found = false;
 
-            result res = m_pending_job_queues[i].pending_job_indicies.push_batch(
-                &job_array[0].m_index, 
-                reinterpret_cast<size_t>(&job_array[1].m_index) - reinterpret_cast<size_t>(&job_array[0].m_index), 
-                number_with_priority);
+    for (size_t j = 0; j < m_numa_node_count; j++)
+    {
+        for (uint64_t ready = m_ready_priorities[j].load() & (uint64_t)priorities; ready != 0; ready &= ready - 1)
+        {
+            size_t i = internal::count_trailing_zeros(ready);
 
-            assert(res == result::success);
+            job_queue& queue = m_pending_job_queues[j][i];
+            uint64_t service_time = queue.last_service_time.load();
+            if (service_time <= oldest_time && queue.pending_job_indicies.count() > 0)
+            {
+                oldest_time = service_time;
+                oldest_node = j;
+                oldest_priority_index = i;
+                found = true;
+            }
         }
-
-        first_iteration = false;
     }
 
-    notify_job_available(queued_job_count);
+    if (!found)
+    {
+        return false;
+    }
 
-    return result::success;
+    return get_next_job_from_node(job_index, oldest_node, oldest_priority_index);
 }
 
-result scheduler::requeue_job(size_t index)
+void scheduler::on_queue_push(job_queue& queue)
 {
-    jobs_profile_scope(profile_scope_type::worker, "scheduler::requeue_job", this);
+    // Queues only start aging once they have something in them.
+    if (m_scheduling_policy == scheduling_policy::aging && queue.pending_job_indicies.count() == 0)
+    {
+        queue.last_service_time = m_scheduler_timer.get_elapsed_ms();
+    }
+}
 
-    internal::job_definition& def = get_job_definition(index);
+uint64_t scheduler::get_job_queue_mask(const internal::job_definition& definition)
+{
+    uint64_t job_mask = (uint64_t)definition.job_priority & m_priority_level_mask;
 
-    // Reset the status to pending if its anything else.
-    // @todo: is this neccessary? Most requeues will set the status themselves.
-    internal::job_status status = def.status.load(std::memory_order_relaxed);
-    if (status != internal::job_status::sleeping &&
-        status != internal::job_status::waiting_on_job &&
-        status != internal::job_status::waiting_on_counter)
+    // Jobs outside of the configured levels go in the lowest one.
+    if (job_mask == 0)
     {
-        def.status.store(internal::job_status::pending, std::memory_order_relaxed);
+        job_mask = (uint64_t)1 << (m_priority_level_count - 1);
     }
 
-    // Put job into a job queue for each priority it holds (not sure why you would want multiple priorities, but might as well support it ...).
-    for (size_t i = 0; i < (int)priority::count; i++)
+    // Find the priorities that every pool able to execute this job looks in.
+    uint64_t shared_mask = job_mask;
+    for (size_t i = 0; i < m_thread_pool_count; i++)
     {
-        int mask = 1 << i;
-
-        if (((size_t)def.job_priority & mask) != 0 && (def.context.queues_contained_in & mask) == 0)
+        uint64_t pool_mask = (uint64_t)m_thread_pools[i].job_priorities;
+        if ((pool_mask & job_mask) != 0)
         {
-            def.context.queues_contained_in |= mask;
-
-            result res = m_pending_job_queues[i].pending_job_indicies.push(index);
-            assert(res == result::success);
+            shared_mask &= pool_mask;
         }
     }
 
-    notify_job_available(1);
+    // Use the highest of those, or if the pools are disjoint fall back to queueing in every priority.
+    if (shared_mask != 0)
+    {
+        return shared_mask & (~shared_mask + 1);
+    }
 
-    return result::success;
+    return job_mask;
 }
 
-bool scheduler::get_next_job_from_queue(size_t& output_job_index, job_queue& queue, size_t queue_mask)
+bool scheduler::get_next_job(size_t& job_index, priority priorities, bool can_block)
 {
-    bool shifted_last_iteration = false;
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::get_next_job", this);
 
-    jobs_profile_scope(profile_scope_type::worker, "scheduler::get_next_job_from_queue", this);
+    size_t local_node = get_current_numa_node();
 
-    size_t count = queue.pending_job_indicies.count();
+    internal::stopwatch idle_timer;
+    bool idle_timer_started = false;
 
-    for (size_t i = 0; i < count; i++)
+    while (!m_destroying)
     {
-        size_t job_index;
+        if (m_track_available_cores)
+        {
+            poll_available_cores();
+        }
 
-        result res = queue.pending_job_indicies.pop(job_index);
-        if (res == result::empty)
+        // Jobs bound to this worker can't be run by anyone else, so service them first, even if we are parked.
+        if (WorkerThreadState.affine_available_jobs > 0 && 
+            get_next_job_from_queue(job_index, WorkerThreadState.affine_job_queue, 0))
         {
-            break;
+            WorkerThreadState.affine_available_jobs--;
+            return true;
         }
 
-        internal::job_definition& def = get_job_definition(job_index);
+        // Workers beyond the active limit, or retired due to low load, sit out until they are needed again.
+        if (is_worker_parked())
+        {
+            if (!can_block)
+            {
+                break;
+            }
+
+            park_worker();
+            idle_timer_started = false;
+            continue;
+        }
 
-        // If job hasn't already started running (because its been picked up from another queue),
-        // the mark it as running and return it.
-        internal::job_status expected = internal::job_status::pending;
-        if (def.status.compare_exchange_strong(expected, internal::job_status::running))
         {
-            def.context.queues_contained_in &= ~queue_mask;
-            assert(def.pending_predecessors == 0);
+            jobs_profile_scope(profile_scope_type::worker, "dequeue job", this);
 
-#if defined(JOBS_USE_VERBOSE_LOGGING)
-            write_log(debug_log_verbosity::verbose, debug_log_group::worker, "Picked up %zi from queue %i", job_index, queue_mask);
-#endif
+            // Jobs that prefer this worker come first, but only when they are strictly higher priority than the 
+            // shared queues, and no ordered work is waiting. Otherwise a job requeued here would keep jumping 
+            // ahead of work that has been waiting at the same priority. They are still picked up by 
+            // steal_local_job below once the shared queues are empty.
+            worker_thread_state& thread_state = WorkerThreadState;
+            if (!thread_state.is_pump_thread && thread_state.local_available_jobs.load() > 0 && m_ordered_job_count.load() == 0)
+            {
+                uint64_t ready = get_ready_priorities() & (uint64_t)priorities;
 
-            size_t result = --m_available_jobs;
+                uint64_t local = thread_state.local_priorities.load() & (uint64_t)priorities;
 
-            output_job_index = job_index;
-            return true;
-        }
-    }
+                if ((ready == 0 || (local != 0 && internal::count_trailing_zeros(local) < internal::count_trailing_zeros(ready))) &&
+                    get_next_job_from_local_queue(job_index, thread_state.worker_index))
+                {
+                    return true;
+                }
+            }
 
-    return false;
-}
+            // Jobs with deadlines or on critical paths get picked before anything else of the same priority.
+            if (m_ordered_job_count > 0 && get_next_ordered_job(job_index, priorities))
+            {
+                // Ordered jobs aren't in the ready bitmaps, so assume more work like the job we took is waiting.
+                if (m_has_elastic_pools)
+                {
+                    grow_active_workers(get_ready_priorities() | get_job_definition(job_index).context.queue_mask);
+                }
 
-bool scheduler::get_next_job(size_t& job_index, priority priorities, bool can_block)
-{
-    jobs_profile_scope(profile_scope_type::worker, "scheduler::get_next_job", this);
+                return true;
+            }
 
-    while (!m_destroying)
-    {
-        {
-            jobs_profile_scope(profile_scope_type::worker, "dequeue job", this);
+            // Give the scheduling policy first pick, if it finds nothing fall back to strict priority order.
+            bool found_job = false;
+            switch (m_scheduling_policy)
+            {
+            case scheduling_policy::weighted_fair:
+                found_job = get_next_weighted_fair_job(job_index, priorities);
+                break;
+            case scheduling_policy::aging:
+                found_job = get_next_aged_job(job_index, priorities);
+                break;
+            default:
+                break;
+            }
 
-            // Look for work in each priority queue we can execute.
-            for (size_t i = 0; i < (int)priority::count; i++)
+            if (found_job)
             {
-                int mask = 1 << i;
+                if (m_has_elastic_pools)
+                {
+                    grow_active_workers(get_ready_priorities());
+                }
+
+                return true;
+            }
+
+            // Look for work in each priority queue we can execute, local node first then 
+            // steal from the other nodes, closest index first. Only levels in the nodes ready
+            // bitmap are looked at, so the highest is found with a single bit scan.
+            for (size_t j = 0; j < m_numa_node_count; j++)
+            {
+                size_t node = (local_node + j) % m_numa_node_count;
 
-                if (((size_t)priorities & mask) != 0)
+                for (uint64_t ready = m_ready_priorities[node].load() & (uint64_t)priorities; ready != 0; ready &= ready - 1)
                 {
-                    if (get_next_job_from_queue(job_index, m_pending_job_queues[i], mask))
+                    size_t i = internal::count_trailing_zeros(ready);
+
+                    if (get_next_job_from_node(job_index, node, i))
                     {
+                        // If there is still more work than idle workers, get some help.
+                        if (m_has_elastic_pools)
+                        {
+                            grow_active_workers(get_ready_priorities());
+                        }
+
                         return true;
                     }
                 }
             }
+
+            // Nothing in the shared queues, so help out workers with a backlog of jobs that prefer them.
+            if (m_local_job_count.load() > 0 && !WorkerThreadState.is_pump_thread && steal_local_job(job_index, priorities))
+            {
+                return true;
+            }
         }
 
         if (!can_block)
@@ -1119,8 +3393,25 @@ bool scheduler::get_next_job(size_t& job_index, priority priorities, bool can_bl
             break;
         }
 
-        // Wait for next job.
-        wait_for_job_available();
+        // Elastic workers that have been idle for long enough retire, otherwise wait for the next job.
+        if (m_has_elastic_pools && is_worker_elastic())
+        {
+            if (!idle_timer_started)
+            {
+                idle_timer.start();
+                idle_timer_started = true;
+            }
+            else if (idle_timer.get_elapsed_ms() >= m_worker_idle_timeout.duration && can_worker_retire() && retire_worker())
+            {
+                continue;
+            }
+
+            wait_for_job_available(m_worker_idle_timeout);
+        }
+        else
+        {
+            wait_for_job_available();
+        }
     } 
  
     return false;
@@ -1133,22 +3424,48 @@ void scheduler::complete_job(size_t job_index)
     internal::job_definition& def = get_job_definition(job_index);
 
     bool needs_to_wake_up_successors = false;
+
+    // A job we release that hasn't completed by the time we finish means the scheduler can't be idle yet.
+    size_t released_index = SIZE_MAX;
     
     assert(def.status == internal::job_status::running);
+
+    // Instancing only applies to the dispatch it was requested for. This has to be cleared before the job is 
+    // marked as completed, as a woken waiter can dispatch it again with new instances straight away.
+    def.instance_grain = 0;
+
     def.status = internal::job_status::completed;
 
+    if (!def.deadline.is_infinite())
+    {
+        record_deadline_completion(def);
+    }
+
     // For each job waiting on this one, set it back to pending and requeue it.
     {
         internal::multiple_writer_single_reader_list<internal::job_definition*>::iterator iter;
-        for (def.wait_list.iterate(iter); iter; iter++)
+        for (def.wait_list.iterate(iter); iter; )
         {
             internal::job_definition* wait_def = iter.value();
 
             internal::job_status expected = internal::job_status::waiting_on_job;
             if (wait_def->status.compare_exchange_strong(expected, internal::job_status::pending))
             {
+                // Threads waiting from outside of a job own their definition, so it needs taking off
+                // the list before they are woken up and it goes out of scope.
+                if (wait_def->wait_parking_slot != nullptr)
+                {
+                    internal::parking_slot* slot = wait_def->wait_parking_slot;
+                    iter.remove();
+                    slot->unpark();
+                    continue;
+                }
+
                 requeue_job(wait_def->index);
+                released_index = wait_def->index;
             }
+
+            iter++;
         }        
     }
 
@@ -1169,16 +3486,25 @@ void scheduler::complete_job(size_t job_index)
             }
 
             requeue_job(successor_def.index);
+            released_index = successor_def.index;
             needs_to_wake_up_successors = true;
         }
 
         dep = dep->next;
     }
 
+    // Continuations are queued directly, without waiting for anyone to dispatch them.
+    release_job_continuations(job_index);
+
+    if (m_critical_path_ordering)
+    {
+        record_job_cost(def);
+    }
+
     // Clear up the fiber now, even if our handle is going to hang around for a while.
     if (def.context.has_fiber)
     {
-        free_fiber(def.context.fiber_index, def.context.fiber_pool_index);
+        free_fiber(def.context.fiber_index, def.context.fiber_pool_index, def.context.fiber_numa_node);
         def.context.has_fiber = false;
     }
 
@@ -1191,94 +3517,212 @@ void scheduler::complete_job(size_t job_index)
         def.completion_counter.add(1);
     }
 
+    // Let the next job held back by the groups concurrency limit run.
+    if (def.context.concurrency_admitted)
+    {
+        release_concurrency_limit(def);
+    }
+
+    // Wake up anyone waiting on the group if this was its last outstanding job. Only jobs in a group 
+    // someone is waiting on pay for summing its shards. The released job check used below isn't safe here, 
+    // as the slot can be reused by a job in a different group.
+    if (def.group.is_valid())
+    {
+        internal::group_definition& group_def = get_group_definition(def.group.m_index);
+        group_def.active_jobs.finish();
+
+        if (group_def.waiter_count.load() > 0 && group_def.active_jobs.is_idle())
+        {
+            group_def.idle_event.signal();
+        }
+    }
+
     // Remove the ref count we added on dispatch.
     decrease_job_ref_count(job_index);
 
     // Keep track of number of active jobs for idle monitoring. 
-    m_active_job_count--;
-
-    // Wake up anyone waiting for tasks to complete.
+    m_active_jobs.finish();
+
+    // Threads waiting for idle only care about the transition to idle, and as counts are only summed 
+    // here the last job to finish will always see every other completion. Threads waiting on this
+    // job specifically have already been woken up above. 
+    //
+    // Summing touches every shard, so first check the job we released last. If it hasn't completed yet 
+    // it's still active, and as it's marked completed after our finish above, its own check will see 
+    // our completion. Most jobs in a dependency graph release a successor, so only the leaves pay for the sum.
+    if (m_idle_waiter_count.load() > 0 && !is_job_outstanding(released_index) && m_active_jobs.is_idle())
     {
         notify_job_complete();
     }
 }
 
-bool scheduler::execute_next_job(priority job_priorities, bool can_block)
+bool scheduler::is_job_outstanding(size_t job_index)
 {
-    auto& thread_state = WorkerThreadState;
+    if (job_index == SIZE_MAX)
+    {
+        return false;
+    }
+
+    // Even if the slot has been reused since, a job that has been dispatched but not completed will make the same 
+    // idle check when it completes.
+    internal::job_status status = get_job_definition(job_index).status.load();
+    return status != internal::job_status::initialized && status != internal::job_status::completed;
+}
 
+bool scheduler::execute_next_job(priority job_priorities, bool can_block)
+{
     // Grab next job to run.
     size_t job_index;
     if (get_next_job(job_index, job_priorities, can_block))
     {
-        internal::job_definition& def = get_job_definition(job_index);
+        execute_job(job_index);
+        return true;
+    }
+
+    return false;
+}
 
-        // If job does not have a fiber allocated, grab a fiber to run job on.
-        if (!def.context.has_fiber)
+void scheduler::execute_job(size_t job_index)
+{
+    // Children dispatched child-first, and the jobs that dispatched them, run straight after
+    // each other rather than going back through the queues.
+    do
+    {
+        execute_job_slice(job_index);
+    } 
+    while (get_next_local_job(job_index));
+}
+
+bool scheduler::get_next_local_job(size_t& job_index)
+{
+    auto& thread_state = WorkerThreadState;
+
+    if (thread_state.handoff_job_index != SIZE_MAX)
+    {
+        job_index = thread_state.handoff_job_index;
+        thread_state.handoff_job_index = SIZE_MAX;
+        return true;
+    }
+
+    while (thread_state.continuation_count > 0)
+    {
+        size_t index = thread_state.continuations[--thread_state.continuation_count];
+
+        internal::job_definition& def = get_job_definition(index);
+
+        // The continuation may have been stolen since, or even completed and its index reused, so only 
+        // take it if it's still waiting in the shared queues. Its queue entries are skipped when popped.
+        if ((def.context.queues_contained_in == 0 && !def.context.in_local_queue) || 
+            def.pending_predecessors != 0 ||
+            def.thread_affinity != any_worker || 
+            is_ordered_queued(def) ||
+            is_concurrency_limited(def))
         {
-            result res = allocate_fiber(def.stack_size, def.context.fiber_index, def.context.fiber_pool_index);
-            if (res == result::success)
-            {
-                def.context.has_fiber = true;
-            }
-            else
-            {
-                write_log(debug_log_verbosity::warning, debug_log_group::job, "requeuing job as no fibers available, index=%zi", job_index);
+            continue;
+        }
 
-                // @todo: don't requeue, this results in churn, put it in a queue to be requeued on job-completion.
+        // If the index was reused it may also hold a job this worker would never have picked up itself.
+        if (((uint64_t)m_thread_pools[thread_state.pool_index].job_priorities & def.context.queue_mask) == 0 ||
+            (def.numa_node != any_numa_node && (def.numa_node % m_numa_node_count) != get_current_numa_node()))
+        {
+            continue;
+        }
 
-                // No fiber available? Back into the queue you go.
-                requeue_job(job_index);
+        internal::job_status expected = internal::job_status::pending;
+        if (def.status.compare_exchange_strong(expected, internal::job_status::running))
+        {
+            m_available_jobs.finish();
 
-                // There is further work to do so return true here.
-                return true;
-            }
+            job_index = index;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void scheduler::execute_job_slice(size_t job_index)
+{
+    auto& thread_state = WorkerThreadState;
+
+    internal::job_definition& def = get_job_definition(job_index);
+
+    // If job does not have a fiber allocated, grab a fiber to run job on.
+    if (!def.context.has_fiber)
+    {
+        result res = allocate_fiber(def.stack_size, def.context.fiber_index, def.context.fiber_pool_index, def.context.fiber_numa_node);
+        if (res == result::success)
+        {
+            def.context.has_fiber = true;
         }
+        else
+        {
+            write_log(debug_log_verbosity::warning, debug_log_group::job, "requeuing job as no fibers available, index=%zi", job_index);
 
-        // Perform the old switcharoo to fiber land.
-        thread_state.job_index = job_index;
-        thread_state.cloned_job_index = job_index;
-        thread_state.job_completed = false;
-        thread_state.job_supress_requeue = false;
+            // @todo: don't requeue, this results in churn, put it in a queue to be requeued on job-completion.
+
+            // No fiber available? Back into the queue you go.
+            requeue_job(job_index);
+            return;
+        }
+    }
 
-        internal::fiber* job_fiber = m_fiber_pools_sorted_by_stack[def.context.fiber_pool_index]->pool.get_index(def.context.fiber_index);
+    // Perform the old switcharoo to fiber land.
+    thread_state.job_index = job_index;
+    thread_state.cloned_job_index = job_index;
+    thread_state.job_completed = false;
+    thread_state.job_supress_requeue = false;
 
 #if defined(JOBS_USE_VERBOSE_LOGGING)
-        write_log(debug_log_verbosity::verbose, debug_log_group::job, "switching state=%p job=%zi/%zi fiber=%zi:%zi", &thread_state, thread_state.job_index, thread_state.cloned_job_index.load(), def.context.fiber_pool_index, def.context.fiber_index);
+    write_log(debug_log_verbosity::verbose, debug_log_group::job, "switching state=%p job=%zi/%zi fiber=%zi:%zi:%zi", &thread_state, thread_state.job_index, thread_state.cloned_job_index.load(), def.context.fiber_pool_index, def.context.fiber_numa_node, def.context.fiber_index);
 #endif
-        switch_context(def.context);
+    thread_state.slice_start_time = m_scheduler_timer.get_elapsed_us();
+
+    // A job that waits can be woken and picked up by another worker before the worker it was running 
+    // on has finished switching off its fiber, so make sure the fiber is free before switching to it.
+    while (def.context.fiber_active.load())
+    {
+        JOBS_YIELD();
+    }
+
+    def.context.fiber_active = true;
+    def.context.last_worker = thread_state.is_pump_thread ? SIZE_MAX : thread_state.worker_index;
+
+    switch_context(def.context);
+
+    def.context.fiber_active = false;
+
+    if (m_critical_path_ordering)
+    {
+        def.context.execution_time += m_scheduler_timer.get_elapsed_us() - thread_state.slice_start_time;
+    }
+
 #if defined(JOBS_USE_VERBOSE_LOGGING)
-        write_log(debug_log_verbosity::verbose, debug_log_group::job, "returning from state=%p job=%zi/%zi fiber=%zi:%zi completed=%s", &thread_state, thread_state.job_index, thread_state.cloned_job_index.load(), def.context.fiber_pool_index, def.context.fiber_index, thread_state.job_completed ? "true" : "false");
+    write_log(debug_log_verbosity::verbose, debug_log_group::job, "returning from state=%p job=%zi/%zi fiber=%zi:%zi:%zi completed=%s", &thread_state, thread_state.job_index, thread_state.cloned_job_index.load(), def.context.fiber_pool_index, def.context.fiber_numa_node, def.context.fiber_index, thread_state.job_completed ? "true" : "false");
 #endif
 
-        // If not complete yet, requeue, we probably have some sync point/dependencies to deal with.
-        if (!thread_state.job_completed)
-        {
-            if (!thread_state.job_supress_requeue)
-            {
-                // No fiber available? Back into the queue you go.
-                requeue_job(thread_state.job_index);
-            }
-
-            // There is further work to do so return true here.
-            return true;		
-        }
-        // Else mark as completed.
-        else
+    // If not complete yet, requeue, we probably have some sync point/dependencies to deal with.
+    if (!thread_state.job_completed)
+    {
+        if (!thread_state.job_supress_requeue)
         {
-            complete_job(thread_state.job_index);
+            // No fiber available? Back into the queue you go.
+            requeue_job(thread_state.job_index);
         }
-        
-        return true;
     }
-
-    return false;
+    // Else mark as completed.
+    else
+    {
+        complete_job(thread_state.job_index);
+    }
 }
 
-result scheduler::allocate_fiber(size_t required_stack_size, size_t& fiber_index, size_t& fiber_pool_index)
+result scheduler::allocate_fiber(size_t required_stack_size, size_t& fiber_index, size_t& fiber_pool_index, size_t& fiber_numa_node)
 {
     bool any_suitable_pools = false;
 
+    size_t local_node = get_current_numa_node();
+
     for (size_t i = 0; i < m_fiber_pool_count; i++)
     {
         fiber_pool& pool = *m_fiber_pools_sorted_by_stack[i];
@@ -1286,15 +3730,27 @@ result scheduler::allocate_fiber(size_t required_stack_size, size_t& fiber_index
         {
             any_suitable_pools = true;
 
-            result res = pool.pool.alloc(fiber_index);
-            if (res == result::success)
+            // Try our local node first, then fall back to remote nodes. We don't block here if a node
+            // is empty as there may be free fibers on a different node or in a larger pool.
+            for (size_t j = 0; j < m_numa_node_count; j++)
             {
+                size_t node = (local_node + j) % m_numa_node_count;
+                if (pool.node_fiber_count[node] == 0)
+                {
+                    continue;
+                }
+
+                result res = pool.pool[node].alloc(fiber_index, false);
+                if (res == result::success)
+                {
 #if defined(JOBS_USE_VERBOSE_LOGGING)
-                write_log(debug_log_verbosity::verbose, debug_log_group::job, "fiber allocated, pool=%zi index=%zi", i, fiber_index);
+                    write_log(debug_log_verbosity::verbose, debug_log_group::job, "fiber allocated, pool=%zi node=%zi index=%zi", i, node, fiber_index);
 #endif
 
-                fiber_pool_index = i;
-                return result::success;
+                    fiber_pool_index = i;
+                    fiber_numa_node = node;
+                    return result::success;
+                }
             }
         }
     }
@@ -1310,24 +3766,50 @@ result scheduler::allocate_fiber(size_t required_stack_size, size_t& fiber_index
     }
 }
 
-result scheduler::free_fiber(size_t fiber_index, size_t fiber_pool_index)
+result scheduler::free_fiber(size_t fiber_index, size_t fiber_pool_index, size_t fiber_numa_node)
 {
     fiber_pool& pool = *m_fiber_pools_sorted_by_stack[fiber_pool_index];
 
-    pool.pool.free(fiber_index);
+    pool.pool[fiber_numa_node].free(fiber_index);
     return result::success;
 }
 
+size_t scheduler::get_current_numa_node()
+{
+    if (m_worker_thread_scheduler == this)
+    {
+        return WorkerThreadState.numa_node;
+    }
+
+    return internal::get_current_numa_node() % m_numa_node_count;
+}
+
+size_t scheduler::get_job_numa_node(const internal::job_definition& definition)
+{
+    if (definition.numa_node != any_numa_node)
+    {
+        return definition.numa_node % m_numa_node_count;
+    }
+
+    return get_current_numa_node();
+}
+
 result scheduler::wait_until_idle(timeout wait_timeout)
 {
     internal::stopwatch timer;
     timer.start();
 
+    // Register before checking for idle, completions only look for the idle transition while someone is waiting.
+    m_idle_waiter_count++;
+
+    result res = result::success;
+
     while (!is_idle() || m_destroying)
     {
         if (timer.get_elapsed_ms() > wait_timeout.duration)
         {
-            return result::timeout;
+            res = result::timeout;
+            break;
         }
 
 #if 0 // Not supported right now as helper thread must be converted to a fiber.
@@ -1358,7 +3840,98 @@ result scheduler::wait_until_idle(timeout wait_timeout)
         }
     }
 
-    return result::success;
+    m_idle_waiter_count--;
+
+    return res;
+}
+
+bool scheduler::try_execute_job_inline(internal::job_context& context, size_t job_index)
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::try_execute_job_inline", this);
+
+    internal::job_definition& def = get_job_definition(job_index);
+
+    // Only jobs that are sitting in the shared queues can be claimed, jobs that are held back or already 
+    // have a fiber, and jobs whose queues keep their own bookkeeping, are left to be picked up normally.
+    if (def.context.has_fiber ||
+        (def.context.queues_contained_in == 0 && !def.context.in_local_queue) ||
+        def.pending_predecessors != 0 ||
+        def.instance_grain > 0 ||
+        def.thread_affinity != any_worker ||
+        is_ordered_queued(def) ||
+        is_concurrency_limited(def))
+    {
+        return false;
+    }
+
+    // The job runs on top of whatever the waiter has already used of its stack, so it has to fit in the part 
+    // of the fiber the waiter didn't ask for.
+    if (context.job_def == nullptr || context.is_fiber_raw || context.inline_depth >= max_inline_wait_depth)
+    {
+        return false;
+    }
+
+    // Jobs that don't declare a stack size are budgeted the whole of the smallest fiber, so they are 
+    // only inlined onto fibers big enough to have that much spare.
+    size_t stack_size = get_job_stack_size(def);
+
+    fiber_pool& pool = *m_fiber_pools_sorted_by_stack[context.fiber_pool_index];
+    if (get_job_stack_size(*context.job_def) + context.inline_stack_size + stack_size > pool.stack_size)
+    {
+        return false;
+    }
+
+    // Claim it the same way a worker would, if a worker beats us to it we just wait as normal. Its queue entries 
+    // will be skipped when they are popped.
+    internal::job_status expected = internal::job_status::pending;
+    if (!def.status.compare_exchange_strong(expected, internal::job_status::running))
+    {
+        return false;
+    }
+
+    m_available_jobs.finish();
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+    write_log(debug_log_verbosity::verbose, debug_log_group::job, "executing job inline, index=%zi waiter=%zi", job_index, context.job_def->index);
+#endif
+
+    context.inline_depth++;
+    context.inline_stack_size += stack_size;
+
+    uint64_t start_time = m_scheduler_timer.get_elapsed_us();
+
+    context.enter_scope(profile_scope_type::fiber, true, def.tag);
+
+    if (!def.group.is_valid() || !def.group.is_cancelled())
+    {
+        def.work();
+    }
+
+    context.leave_scope();
+
+    if (m_critical_path_ordering)
+    {
+        def.context.execution_time += m_scheduler_timer.get_elapsed_us() - start_time;
+    }
+
+    context.inline_depth--;
+    context.inline_stack_size -= stack_size;
+
+    m_stat_inline_waits++;
+
+    complete_job(job_index);
+
+    return true;
+}
+
+size_t scheduler::get_job_stack_size(const internal::job_definition& definition)
+{
+    if (definition.stack_size != 0)
+    {
+        return definition.stack_size;
+    }
+
+    return m_fiber_pools_sorted_by_stack[0]->stack_size;
 }
 
 result scheduler::wait_for_job(job_handle job_handle_in, timeout wait_timeout)
@@ -1373,11 +3946,21 @@ result scheduler::wait_for_job(job_handle job_handle_in, timeout wait_timeout)
     {
         assert(worker_context != nullptr);
 
+        // If nobody has picked the job up yet, run it ourselves rather than suspending until someone has. A wait
+        // with a timeout could overrun it by running the job, so those always suspend.
+        if (m_inline_waits && wait_timeout.is_infinite() && try_execute_job_inline(*context, job_handle_in.m_index))
+        {
+            return result::success;
+        }
+
         volatile bool timeout_called = false;
 
         // Put job to sleep.
         context->job_def->status = internal::job_status::waiting_on_job;
-        context->job_def->wait_job = job_handle_in;
+        {
+            std::lock_guard<internal::spinwait_mutex> lock(context->job_def->dependency_lock);
+            context->job_def->wait_job = job_handle_in;
+        }
 
         // Queue a wakeup.
         size_t schedule_handle;
@@ -1426,79 +4009,161 @@ result scheduler::wait_for_job(job_handle job_handle_in, timeout wait_timeout)
 
         if (!is_complete)
         {
+            // Make sure the job we are waiting on isn't held up behind lower priority work.
+            if (m_priority_inheritance)
+            {
+                size_t boosted_count = inherit_priority(job_handle_in.m_index, context->job_def->context.queue_mask);
+                if (boosted_count > 0)
+                {
+                    m_stat_priority_inversions++;
+                    m_stat_priority_boosts += boosted_count;
+                }
+            }
+
             // Supress requeueing the job, we will do this when the callback returns.
             WorkerThreadState.job_supress_requeue = true;
 
-            // Switch back to worker which will requeue fiber for execution later.			
-            switch_context(*worker_context);
-        }
+            // Switch back to worker which will requeue fiber for execution later.			
+            switch_context(*worker_context);
+        }
+
+        // Cleanup
+        {
+            std::lock_guard<internal::spinwait_mutex> lock(context->job_def->dependency_lock);
+            context->job_def->wait_job = job_handle();
+        }
+
+        // If we timed out, just escape here.
+        if (timeout_called && !is_complete)
+        {
+            return result::timeout;
+        }
+
+        // Cancel callback and clear our job handle.
+        if (!wait_timeout.is_infinite())
+        {
+            m_callback_scheduler.cancel(schedule_handle);
+        }
+
+        return result::success;
+    }
+
+    // If we have no job context, we just have to do a blocking wait.
+    else
+    {
+        internal::job_definition& other_job_def = get_job_definition(job_handle_in.m_index);
+
+        // Park on our own slot via a fake job in the wait list, so only this jobs completion wakes us up.
+        internal::parking_slot slot;
+
+        internal::job_definition fake_job(UINT32_MAX);
+        fake_job.status = internal::job_status::waiting_on_job;
+        fake_job.wait_parking_slot = &slot;
+
+        {
+            internal::optional_shared_lock<internal::spinwait_mutex> lock(other_job_def.wait_list.get_mutex());
+
+            // Check it hasn't completed while acquiring lock.
+            if (other_job_def.status == internal::job_status::completed)
+            {
+                return result::success;
+            }
+
+            fake_job.wait_list_link.value = &fake_job;
+            other_job_def.wait_list.add(&fake_job.wait_list_link, false);
+        }
+
+        if (slot.park(wait_timeout))
+        {
+            return result::success;
+        }
+
+        // Take ourselves off the wait list, unless the job completed while we were timing out, in which 
+        // case it has already removed us and we need to wait for it to finish with our slot.
+        internal::job_status expected = internal::job_status::waiting_on_job;
+        if (fake_job.status.compare_exchange_strong(expected, internal::job_status::pending))
+        {
+            other_job_def.wait_list.remove(&fake_job.wait_list_link);
+            return result::timeout;
+        }
+
+        slot.park(timeout::infinite);
+    }
+
+    return result::success;
+}
+
+bool scheduler::is_idle() const
+{
+    return m_active_jobs.is_idle();
+}
+
+result scheduler::pump(timeout max_time)
+{
+    // Workers and jobs already have a fiber context of their own, we can't nest another inside them.
+    if (m_worker_thread_scheduler != nullptr)
+    {
+        write_log(debug_log_verbosity::warning, debug_log_group::scheduler, "attempt to pump jobs from a worker thread or job.");
+        return result::invalid_thread;
+    }
+
+    internal::stopwatch timer;
+    timer.start();
+
+    // Take on the pump state for the duration of the call so jobs can wait and sleep as they would on a worker.
+    worker_thread_state& thread_state = *m_pump_thread_state;
+    thread_state.numa_node = get_current_numa_node();
+
+    m_worker_thread_scheduler = this;
+    m_worker_thread_state = &thread_state;
+
+    thread_state.job_index = 0;
+    thread_state.cloned_job_index = 0;
+    thread_state.job_context.reset();
+    thread_state.job_context.scheduler = this;
+    thread_state.job_context.has_fiber = true;
+    thread_state.job_context.is_fiber_raw = true;
+    internal::fiber::convert_thread_to_fiber(thread_state.job_context.raw_fiber);
+
+    thread_state.job_context.job_def = nullptr;
+    thread_state.active_job_context = &thread_state.job_context;
+
+    thread_state.active_job_context->enter_scope(profile_scope_type::worker, true, "Pump");
 
-        // Cleanup
-        context->job_def->wait_job = job_handle();
+    result res = result::success;
 
-        // If we timed out, just escape here.
-        if (timeout_called && !is_complete)
+    while (thread_state.affine_available_jobs > 0 && !m_destroying)
+    {
+        enter_quiescent_state();
+
+        if (timer.get_elapsed_ms() >= max_time.duration)
         {
-            return result::timeout;
+            res = result::timeout;
+            break;
         }
 
-        // Cancel callback and clear our job handle.
-        if (!wait_timeout.is_infinite())
+        size_t job_index;
+        if (!get_next_job_from_queue(job_index, thread_state.affine_job_queue, 0))
         {
-            m_callback_scheduler.cancel(schedule_handle);
+            break;
         }
 
-        return result::success;
-    }
+        thread_state.affine_available_jobs--;
 
-    // If we have no job context, we just have to do a blocking wait.
-    else
-    {
-        internal::stopwatch timer;
-        timer.start();
+        execute_job(job_index);
+    }
 
-        while (!job_handle_in.is_complete())
-        {
-            if (timer.get_elapsed_ms() > wait_timeout.duration)
-            {
-                return result::timeout;
-            }
+    enter_offline_state();
 
-    #if 0 // Not supported right now as helper thread must be converted to a fiber.
-            if (!execute_next_job(assist_on_tasks, false))
-    #endif
-            {
-                std::unique_lock<std::mutex> lock(m_task_complete_mutex);
+    thread_state.active_job_context->leave_scope();
+    thread_state.job_context.has_fiber = false;
 
-                if (job_handle_in.is_complete())
-                {
-                    break;
-                }
-                else
-                {
-                    if (wait_timeout.is_infinite())
-                    {
-                        m_task_complete_cvar.wait(lock);
-                    }
-                    else
-                    {
-                        size_t ms_remaining = wait_timeout.duration - timer.get_elapsed_ms();
-                        if (ms_remaining > 0)
-                        {
-                            m_task_complete_cvar.wait_for(lock, std::chrono::milliseconds(ms_remaining));
-                        }
-                    }
-                }
-            }
-        }
-    }
+    internal::fiber::convert_fiber_to_thread();
 
-    return result::success;
-}
+    m_worker_thread_scheduler = nullptr;
+    m_worker_thread_state = nullptr;
 
-bool scheduler::is_idle() const
-{
-    return (m_active_job_count.load() == 0);
+    return res;
 }
 
 result scheduler::alloc_scope(internal::profile_scope_definition*& output)
@@ -1598,6 +4263,59 @@ result scheduler::sleep(timeout duration)
     }
 }
 
+result scheduler::yield()
+{
+    internal::job_definition* definition = get_active_job_definition();
+
+    if (definition != nullptr)
+    {
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+        definition->context.scheduler->write_log(debug_log_verbosity::verbose, debug_log_group::job, "yielding fiber=%zi:%zi", definition->context.fiber_pool_index, definition->context.fiber_index);
+#endif
+
+        // Switch back to the worker, which requeues us once we are off the fiber. A yielding job wants others 
+        // to run, so it goes back to the shared queues rather than the local queue of the worker it was on.
+        WorkerThreadState.job_supress_requeue = false;
+        definition->context.last_worker = SIZE_MAX;
+        definition->context.scheduler->switch_context(WorkerThreadState.job_context);
+    }
+    else
+    {
+        std::this_thread::yield();
+    }
+
+    return result::success;
+}
+
+result scheduler::yield_if_expired(timeout quantum)
+{
+    internal::job_definition* definition = get_active_job_definition();
+    if (definition == nullptr)
+    {
+        return result::not_in_job;
+    }
+
+    uint64_t elapsed = definition->context.scheduler->m_scheduler_timer.get_elapsed_us() - WorkerThreadState.slice_start_time;
+    if (elapsed < quantum.duration * 1000)
+    {
+        return result::success;
+    }
+
+    return yield();
+}
+
+result scheduler::get_instance_index(size_t& index)
+{
+    internal::job_definition* definition = get_active_job_definition();
+    if (definition == nullptr)
+    {
+        return result::not_in_job;
+    }
+
+    index = definition->instance_index;
+    return result::success;
+}
+
 internal::job_context* scheduler::get_active_job_context()
 {
     if (m_worker_thread_scheduler == nullptr)
@@ -1637,53 +4355,353 @@ internal::job_definition* scheduler::get_active_job_definition()
     }
 }
 
-void scheduler::notify_job_available(size_t job_count)
+void scheduler::notify_job_available(size_t job_count, uint64_t queue_mask)
 {
     jobs_profile_scope(profile_scope_type::worker, "scheduler::notify_job_available", this);
 
-    size_t result = (m_available_jobs += job_count);
-    
-    if (job_count > m_worker_count)
+    m_available_jobs.start(job_count);
+
+    if (m_has_elastic_pools)
     {
-        m_task_available_cvar.notify_all();
+        grow_active_workers(queue_mask);
     }
-    else
+
+    wake_idle_workers(job_count, queue_mask);
+}
+
+void scheduler::wake_idle_workers(size_t count, uint64_t queue_mask)
+{
+    // Workers add themselves to the idle stack before they check for work, so if it looks
+    // empty here any worker about to go idle will see the work we have just queued.
+    if (m_idle_worker_count.load() == 0)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_task_available_mutex);
+
+    // Most recently idle workers first, their caches are the warmest.
+    size_t woken = 0;
+    for (size_t i = m_idle_worker_count.load(); i > 0 && woken < count; i--)
+    {
+        worker_thread_state& state = *m_worker_thread_states[m_idle_workers[i - 1]];
+        if (((uint64_t)m_thread_pools[state.pool_index].job_priorities & queue_mask) == 0)
+        {
+            continue;
+        }
+
+        remove_idle_worker(state.worker_index);
+        state.wake_cvar.notify_one();
+        woken++;
+    }
+}
+
+void scheduler::wake_worker(size_t worker_index)
+{
+    worker_thread_state& state = *m_worker_thread_states[worker_index];
+
+    // The worker may be waiting for a job or parked, each under a different lock.
+    {
+        std::unique_lock<std::mutex> lock(m_task_available_mutex);
+        if (state.idle_slot != SIZE_MAX)
+        {
+            remove_idle_worker(worker_index);
+        }
+        state.wake_cvar.notify_one();
+    }
+    {
+        std::unique_lock<std::mutex> lock(m_worker_unparked_mutex);
+        state.wake_cvar.notify_one();
+    }
+}
+
+void scheduler::notify_parked_workers(size_t pool_index)
+{
+    if (m_worker_thread_states == nullptr)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < m_worker_count; i++)
     {
-        for (int i = 0; i < job_count; i++)
+        worker_thread_state* state = m_worker_thread_states[i];
+        if (state != nullptr && (pool_index == SIZE_MAX || state->pool_index == pool_index))
         {
-            m_task_available_cvar.notify_one();
+            state->wake_cvar.notify_one();
         }
     }
 }
 
+void scheduler::add_idle_worker(size_t worker_index)
+{
+    worker_thread_state& state = *m_worker_thread_states[worker_index];
+
+    size_t slot = m_idle_worker_count.load();
+    m_idle_workers[slot] = worker_index;
+    state.idle_slot = slot;
+    m_idle_worker_count++;
+}
+
+void scheduler::remove_idle_worker(size_t worker_index)
+{
+    worker_thread_state& state = *m_worker_thread_states[worker_index];
+
+    // Move the top of the stack into the slot being vacated.
+    size_t last_slot = m_idle_worker_count.load() - 1;
+    size_t last_worker = m_idle_workers[last_slot];
+
+    m_idle_workers[state.idle_slot] = last_worker;
+    m_worker_thread_states[last_worker]->idle_slot = state.idle_slot;
+
+    state.idle_slot = SIZE_MAX;
+    m_idle_worker_count--;
+}
+
 void scheduler::notify_job_complete()
 {
     jobs_profile_scope(profile_scope_type::worker, "scheduler::notify_job_complete", this);
 
+    // Notify under the lock so a waiter can't miss this between checking its condition and sleeping.
+    std::unique_lock<std::mutex> lock(m_task_complete_mutex);
     m_task_complete_cvar.notify_all();
 }
 
-void scheduler::wait_for_job_available()
+void scheduler::wait_for_job_available(timeout wait_timeout)
 {
     jobs_profile_scope(profile_scope_type::worker, "scheduler::wait_for_job_available", this);
 
+    worker_thread_state& state = WorkerThreadState;
+
     std::unique_lock<std::mutex> lock(m_task_available_mutex);
 
-    if (m_destroying || m_available_jobs > 0)
+    // Become visible as idle before checking for work, so anyone queueing work after the check will wake us.
+    add_idle_worker(state.worker_index);
+
+    // Summing the shards of the available count is left until last, it is only paid by workers about to block.
+    if (m_destroying || state.affine_available_jobs > 0 || m_available_jobs.get_count() > 0)
     {
+        remove_idle_worker(state.worker_index);
         return;
     }
 
-    m_task_available_cvar.wait(lock);
+    // Don't hold up reclamation while we sleep.
+    enter_offline_state();
+
+    if (wait_timeout.is_infinite())
+    {
+        state.wake_cvar.wait(lock);
+    }
+    else
+    {
+        state.wake_cvar.wait_for(lock, std::chrono::milliseconds(wait_timeout.duration));
+    }
+
+    // Whoever wakes us takes us off the stack, unless we timed out or woke spuriously.
+    if (state.idle_slot != SIZE_MAX)
+    {
+        remove_idle_worker(state.worker_index);
+    }
+
+    state.ebr_epoch.store(m_ebr_epoch.load());
 }
 
-size_t scheduler::get_logical_core_count()
+void scheduler::poll_available_cores()
 {
-#if defined(JOBS_PLATFORM_PS4)
-    return 6; // Using the 7th core for workers can cause sync problems if a mutex gets held when its timesliced back to the OS.
-#else
-    return std::thread::hardware_concurrency();
+    uint64_t now = m_available_cores_timer.get_elapsed_ms();
+    uint64_t next_poll = m_available_cores_next_poll.load();
+    if (now < next_poll)
+    {
+        return;
+    }
+
+    // Make sure only one thread queries per interval.
+    if (!m_available_cores_next_poll.compare_exchange_strong(next_poll, now + m_available_cores_poll_interval.duration))
+    {
+        return;
+    }
+
+    size_t core_count = get_logical_core_count();
+    if (m_available_core_count.exchange(core_count) != core_count)
+    {
+        write_log(debug_log_verbosity::message, debug_log_group::scheduler, "available core count changed to %zi, resizing active workers", core_count);
+        update_active_worker_limits();
+    }
+}
+
+void scheduler::update_active_worker_limits()
+{
+    std::unique_lock<std::mutex> lock(m_worker_unparked_mutex);
+
+    size_t limit = m_active_worker_limit.load();
+    if (m_track_available_cores)
+    {
+        limit = JOBS_MIN(limit, m_available_core_count.load());
+    }
+
+    // Share the limit between pools in proportion to their size, rounding up so no pool gets starved.
+    for (size_t i = 0; i < m_thread_pool_count; i++)
+    {
+        thread_pool& pool = m_thread_pools[i];
+
+        size_t active_limit = pool.thread_count;
+        if (limit < m_worker_count)
+        {
+            active_limit = ((pool.thread_count * limit) + (m_worker_count - 1)) / m_worker_count;
+            active_limit = JOBS_MAX(JOBS_MIN(active_limit, pool.thread_count), (size_t)1);
+        }
+
+        pool.active_thread_limit = active_limit;
+    }
+
+    notify_parked_workers();
+}
+
+uint64_t scheduler::get_ready_priorities()
+{
+    uint64_t ready = 0;
+    for (size_t i = 0; i < m_numa_node_count; i++)
+    {
+        ready |= m_ready_priorities[i].load();
+    }
+    return ready;
+}
+
+void scheduler::grow_active_workers(uint64_t queue_mask)
+{
+    bool checked_available_jobs = false;
+
+    for (size_t i = 0; i < m_thread_pool_count; i++)
+    {
+        thread_pool& pool = m_thread_pools[i];
+
+        // No point waking a worker that can't run the work that is waiting.
+        if (((uint64_t)pool.job_priorities & queue_mask) == 0)
+        {
+            continue;
+        }
+
+        size_t active_count = pool.active_thread_count.load();
+        if (active_count < JOBS_MIN(pool.thread_count, pool.active_thread_limit.load()))
+        {
+            // Only grow if there are more jobs waiting than there are workers idle to pick them up. This reads
+            // every shard of the available count, so it's left until we know a pool actually has room to grow.
+            if (!checked_available_jobs)
+            {
+                if (m_available_jobs.get_count() <= m_idle_worker_count.load())
+                {
+                    return;
+                }
+                checked_available_jobs = true;
+            }
+
+            if (pool.active_thread_count.compare_exchange_strong(active_count, active_count + 1))
+            {
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+                write_log(debug_log_verbosity::verbose, debug_log_group::worker, "activating worker, pool=%zi active=%zi", i, active_count + 1);
+#endif
+
+                std::unique_lock<std::mutex> lock(m_worker_unparked_mutex);
+                notify_parked_workers(i);
+                return;
+            }
+        }
+    }
+}
+
+bool scheduler::is_worker_elastic()
+{
+    if (m_worker_thread_scheduler != this)
+    {
+        return false;
+    }
+
+    thread_pool& pool = m_thread_pools[WorkerThreadState.pool_index];
+    return pool.min_thread_count < pool.thread_count;
+}
+
+bool scheduler::can_worker_retire()
+{
+    if (m_worker_thread_scheduler != this)
+    {
+        return false;
+    }
+
+    worker_thread_state& state = WorkerThreadState;
+    thread_pool& pool = m_thread_pools[state.pool_index];
+
+    // Only the highest index active worker retires, so the active workers always remain contiguous.
+    size_t active_count = pool.active_thread_count.load();
+    return active_count > pool.min_thread_count && state.pool_worker_index == active_count - 1;
+}
+
+bool scheduler::retire_worker()
+{
+    worker_thread_state& state = WorkerThreadState;
+    thread_pool& pool = m_thread_pools[state.pool_index];
+
+    size_t expected = state.pool_worker_index + 1;
+    if (expected <= pool.min_thread_count)
+    {
+        return false;
+    }
+
+    if (!pool.active_thread_count.compare_exchange_strong(expected, state.pool_worker_index))
+    {
+        return false;
+    }
+
+#if defined(JOBS_USE_VERBOSE_LOGGING)
+    write_log(debug_log_verbosity::verbose, debug_log_group::worker, "retiring idle worker, pool=%zi active=%zi", state.pool_index, state.pool_worker_index);
 #endif
+
+    return true;
+}
+
+bool scheduler::is_worker_parked()
+{
+    if (m_worker_thread_scheduler != this)
+    {
+        return false;
+    }
+
+    worker_thread_state& state = WorkerThreadState;
+    thread_pool& pool = m_thread_pools[state.pool_index];
+
+    return state.pool_worker_index >= JOBS_MIN(pool.active_thread_count.load(), pool.active_thread_limit.load());
+}
+
+void scheduler::park_worker()
+{
+    jobs_profile_scope(profile_scope_type::worker, "scheduler::park_worker", this);
+
+    // We may have consumed a wakeup meant for a worker that can actually run the job, so pass it on.
+    wake_idle_workers(1, UINT64_MAX);
+
+    // Jobs may have been queued while we were retiring, make sure someone is around to run them.
+    if (m_has_elastic_pools)
+    {
+        grow_active_workers(get_ready_priorities());
+    }
+
+    enter_offline_state();
+
+    std::unique_lock<std::mutex> lock(m_worker_unparked_mutex);
+    while (!m_destroying && is_worker_parked() && WorkerThreadState.affine_available_jobs == 0)
+    {
+        WorkerThreadState.wake_cvar.wait(lock);
+    }
+
+    WorkerThreadState.ebr_epoch.store(m_ebr_epoch.load());
+}
+
+size_t scheduler::get_numa_node_count()
+{
+    return internal::get_numa_node_count();
+}
+
+size_t scheduler::get_logical_core_count()
+{
+    return internal::get_available_processor_count();
 }
 
 }; /* namespace jobs */
\ No newline at end of file
@@ -45,7 +45,7 @@ thread::~thread()
     join();
 }
 
-result thread::init(const thread_entry_point& entry_point, const char* name, size_t core_affinity)
+result thread::init(const thread_entry_point& entry_point, const char* name, const cpu_set& core_affinity, size_t numa_node)
 {
 #if defined(JOBS_PLATFORM_WINDOWS)
 
@@ -54,42 +54,75 @@ result thread::init(const thread_entry_point& entry_point, const char* name, siz
     size_t ret_size = 0;
     mbsrtowcs_s(&ret_size, wide_name, &name, 128, &state);
 
-    std::thread new_thread([entry_point, wide_name]() {
+    // Threads can only have affinity with a single processor group, so restrict to the group of the first processor.
+    GROUP_AFFINITY group_affinity;
+    memset(&group_affinity, 0, sizeof(group_affinity));
+    if (!core_affinity.is_empty())
+    {
+        group_affinity.Group = (WORD)(core_affinity.first() / processors_per_group);
+        group_affinity.Mask = (KAFFINITY)core_affinity.get_group_mask(group_affinity.Group);
+    }
+
+    std::thread new_thread([entry_point, wide_name, numa_node, group_affinity]() {
         SetThreadDescription(GetCurrentThread(), wide_name);
+        if (group_affinity.Mask != 0)
+        {
+            SetThreadGroupAffinity(GetCurrentThread(), &group_affinity, nullptr);
+        }
+        else if (numa_node != any_numa_node)
+        {
+            bind_current_thread_to_numa_node(numa_node);
+        }
         entry_point();
     });
 
 #elif defined(JOBS_PLATFORM_PS4)
 
+    // Single numa node, nothing to bind to.
+    (void)numa_node;
+
     char name_storage[128];
     strncpy(name_storage, name, 128);
     name_storage[127] = '\0';
 
+    SceKernelCpumask affinity_mask = (SceKernelCpumask)core_affinity.get_group_mask(0);
+
     std::thread new_thread([=]() {
         scePthreadRename(scePthreadSelf(), name_storage);
-        scePthreadSetaffinity(scePthreadSelf(), (SceKernelCpumask)core_affinity);
+        if (affinity_mask != 0)
+        {
+            scePthreadSetaffinity(scePthreadSelf(), affinity_mask);
+        }
         entry_point();
     });
 
 #elif defined(JOBS_PLATFORM_SWITCH)
 
+    // Single numa node, nothing to bind to.
+    (void)numa_node;
+
     char name_storage[nn::os::ThreadNameLengthMax];
     strncpy(name_storage, name, nn::os::ThreadNameLengthMax);
     name_storage[nn::os::ThreadNameLengthMax - 1] = '\0';
 
     // Filter affinity to only valid core indices or switch will complain.
-    core_affinity = core_affinity & nn::os::GetThreadAvailableCoreMask();
+    nn::Bit64 affinity_mask = core_affinity.get_group_mask(0) & nn::os::GetThreadAvailableCoreMask();
 
-    int ideal_core = jobs::internal::get_first_set_bit_pos(core_affinity) - 1;
+    int ideal_core = jobs::internal::get_first_set_bit_pos(affinity_mask) - 1;
 
     std::thread new_thread([=]() {
         nn::os::SetThreadName(nn::os::GetCurrentThread(), name_storage);
-        nn::os::SetThreadCoreMask(nn::os::GetCurrentThread(), ideal_core, core_affinity);
+        if (affinity_mask != 0)
+        {
+            nn::os::SetThreadCoreMask(nn::os::GetCurrentThread(), ideal_core, affinity_mask);
+        }
         entry_point();
     });
 
 #else
 
+    (void)numa_node;
+
     std::thread new_thread([entry_point]() {
         entry_point();
     });
@@ -0,0 +1,540 @@
+/*
+  libjobs - Simple coroutine based job scheduling.
+  Copyright (C) 2019 Tim Leonard <me@timleonard.uk>
+
+  This software is provided 'as-is', without any express or implied
+  warranty.  In no event will the authors be held liable for any damages
+  arising from the use of this software.
+
+  Permission is granted to anyone to use this software for any purpose,
+  including commercial applications, and to alter it and redistribute it
+  freely, subject to the following restrictions:
+
+  1. The origin of this software must not be misrepresented; you must not
+     claim that you wrote the original software. If you use this software
+     in a product, an acknowledgment in the product documentation would be
+     appreciated but is not required.
+  2. Altered source versions must be plainly marked as such, and must not be
+     misrepresented as being the original software.
+  3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "jobs_topology.h"
+#include "jobs_utils.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <thread>
+
+#if defined(JOBS_PLATFORM_WINDOWS) || defined(JOBS_PLATFORM_XBOX_ONE)
+#include <malloc.h>
+#endif
+
+namespace jobs {
+namespace internal {
+
+void cpu_set::set(size_t index)
+{
+    assert(index < max_logical_processors);
+    m_masks[index / processors_per_group] |= (1ull << (index % processors_per_group));
+}
+
+bool cpu_set::test(size_t index) const
+{
+    if (index >= max_logical_processors)
+    {
+        return false;
+    }
+    return (m_masks[index / processors_per_group] & (1ull << (index % processors_per_group))) != 0;
+}
+
+bool cpu_set::is_empty() const
+{
+    for (size_t i = 0; i < max_logical_processors / processors_per_group; i++)
+    {
+        if (m_masks[i] != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t cpu_set::count() const
+{
+    size_t result = 0;
+    for (size_t i = 0; i < max_logical_processors / processors_per_group; i++)
+    {
+        for (uint64_t mask = m_masks[i]; mask != 0; mask &= (mask - 1))
+        {
+            result++;
+        }
+    }
+    return result;
+}
+
+size_t cpu_set::first() const
+{
+    for (size_t i = 0; i < max_logical_processors; i++)
+    {
+        if (test(i))
+        {
+            return i;
+        }
+    }
+    return max_logical_processors;
+}
+
+uint64_t cpu_set::get_group_mask(size_t group) const
+{
+    if (group >= max_logical_processors / processors_per_group)
+    {
+        return 0;
+    }
+    return m_masks[group];
+}
+
+size_t get_numa_node_count()
+{
+#if defined(JOBS_PLATFORM_WINDOWS)
+
+    ULONG highest_node = 0;
+    if (!GetNumaHighestNodeNumber(&highest_node))
+    {
+        return 1;
+    }
+
+    return JOBS_MIN((size_t)highest_node + 1, max_numa_nodes);
+
+#else
+
+    // Consoles are all single-socket uniform memory architectures.
+    return 1;
+
+#endif
+}
+
+size_t get_available_processor_count()
+{
+#if defined(JOBS_PLATFORM_WINDOWS)
+
+    size_t processor_count = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    size_t available_count = processor_count;
+
+    // Processes spanning multiple processor groups report an empty mask, in which case all processors are available.
+    DWORD_PTR process_mask = 0;
+    DWORD_PTR system_mask = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask) && process_mask != 0)
+    {
+        available_count = 0;
+        for (DWORD_PTR mask = process_mask; mask != 0; mask &= (mask - 1))
+        {
+            available_count++;
+        }
+    }
+
+    // Containers restrict cpu usage with a job object rate limit, which is the equivalent of a cgroup cpu quota.
+    JOBOBJECT_CPU_RATE_CONTROL_INFORMATION rate_info;
+    memset(&rate_info, 0, sizeof(rate_info));
+    if (QueryInformationJobObject(nullptr, JobObjectCpuRateControlInformation, &rate_info, sizeof(rate_info), nullptr) &&
+        (rate_info.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_ENABLE) != 0)
+    {
+        DWORD cpu_rate = 0;
+        if ((rate_info.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_HARD_CAP) != 0)
+        {
+            cpu_rate = rate_info.CpuRate;
+        }
+        else if ((rate_info.ControlFlags & JOB_OBJECT_CPU_RATE_CONTROL_MIN_MAX_RATE) != 0)
+        {
+            cpu_rate = rate_info.MaxRate;
+        }
+
+        // Rate is expressed in 1/100ths of a percent of all processors in the system.
+        if (cpu_rate > 0)
+        {
+            size_t quota_count = ((cpu_rate * processor_count) + 9999) / 10000;
+            available_count = JOBS_MIN(available_count, quota_count);
+        }
+    }
+
+    return JOBS_MAX(available_count, (size_t)1);
+
+#elif defined(JOBS_PLATFORM_PS4)
+
+    return 6; // Using the 7th core for workers can cause sync problems if a mutex gets held when its timesliced back to the OS.
+
+#else
+
+    return JOBS_MAX((size_t)std::thread::hardware_concurrency(), (size_t)1);
+
+#endif
+}
+
+size_t get_numa_node_processor_count(size_t node)
+{
+#if defined(JOBS_PLATFORM_WINDOWS)
+
+    GROUP_AFFINITY affinity;
+    if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity))
+    {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (KAFFINITY mask = affinity.Mask; mask != 0; mask &= (mask - 1))
+    {
+        count++;
+    }
+
+    return count;
+
+#else
+
+    return (node == 0) ? std::thread::hardware_concurrency() : 0;
+
+#endif
+}
+
+size_t get_current_numa_node()
+{
+#if defined(JOBS_PLATFORM_WINDOWS)
+
+    PROCESSOR_NUMBER processor;
+    GetCurrentProcessorNumberEx(&processor);
+
+    USHORT node = 0;
+    if (!GetNumaProcessorNodeEx(&processor, &node))
+    {
+        return 0;
+    }
+
+    return JOBS_MIN((size_t)node, max_numa_nodes - 1);
+
+#else
+
+    return 0;
+
+#endif
+}
+
+result bind_current_thread_to_numa_node(size_t node)
+{
+#if defined(JOBS_PLATFORM_WINDOWS)
+
+    GROUP_AFFINITY affinity;
+    if (!GetNumaNodeProcessorMaskEx((USHORT)node, &affinity) || affinity.Mask == 0)
+    {
+        return result::platform_error;
+    }
+
+    if (!SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr))
+    {
+        return result::platform_error;
+    }
+
+    return result::success;
+
+#else
+
+    // Single node, the thread is always bound to it.
+    (void)node;
+    return result::success;
+
+#endif
+}
+
+size_t get_logical_processors(const memory_functions& memory_functions, logical_processor* buffer, size_t buffer_size)
+{
+    size_t count = 0;
+
+#if defined(JOBS_PLATFORM_WINDOWS)
+
+    DWORD length = 0;
+    if (!GetLogicalProcessorInformationEx(RelationAll, nullptr, &length) && 
+        GetLastError() == ERROR_INSUFFICIENT_BUFFER)
+    {
+        char* info = (char*)memory_functions.user_alloc(length, alignof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX));
+        if (info != nullptr)
+        {
+            if (GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)info, &length))
+            {
+                // Affinity masks are only 32 bits on 32-bit Windows, so only that many bits of each group can be set.
+                const size_t affinity_mask_bits = JOBS_MIN(sizeof(KAFFINITY) * 8, processors_per_group);
+
+                // First pass creates an entry for each logical processor in each physical core.
+                size_t core_id = 0;
+                for (DWORD offset = 0; offset < length; )
+                {
+                    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX entry = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(info + offset);
+                    if (entry->Relationship == RelationProcessorCore)
+                    {
+                        size_t smt_index = 0;
+                        for (WORD group = 0; group < entry->Processor.GroupCount; group++)
+                        {
+                            const GROUP_AFFINITY& affinity = entry->Processor.GroupMask[group];
+                            for (size_t bit = 0; bit < affinity_mask_bits; bit++)
+                            {
+                                size_t index = (affinity.Group * processors_per_group) + bit;
+                                if ((affinity.Mask & ((KAFFINITY)1 << bit)) != 0 && index < max_logical_processors && count < buffer_size)
+                                {
+                                    logical_processor& processor = buffer[count++];
+                                    processor.index = index;
+                                    processor.core = core_id;
+                                    processor.smt_index = smt_index++;
+                                    processor.cache_group = 0;
+                                    processor.numa_node = 0;
+                                }
+                            }
+                        }
+                        core_id++;
+                    }
+                    offset += entry->Size;
+                }
+
+                // Second pass assigns each processor to its last level cache and numa node.
+                size_t cache_id = 0;
+                for (DWORD offset = 0; offset < length; )
+                {
+                    PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX entry = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)(info + offset);
+
+                    const GROUP_AFFINITY* affinity = nullptr;
+                    if (entry->Relationship == RelationCache && entry->Cache.Level == 3)
+                    {
+                        affinity = &entry->Cache.GroupMask;
+                    }
+                    else if (entry->Relationship == RelationNumaNode)
+                    {
+                        affinity = &entry->NumaNode.GroupMask;
+                    }
+
+                    if (affinity != nullptr)
+                    {
+                        for (size_t i = 0; i < count; i++)
+                        {
+                            logical_processor& processor = buffer[i];
+                            if (processor.index / processors_per_group == affinity->Group &&
+                                (processor.index % processors_per_group) < affinity_mask_bits &&
+                                (affinity->Mask & ((KAFFINITY)1 << (processor.index % processors_per_group))) != 0)
+                            {
+                                if (entry->Relationship == RelationCache)
+                                {
+                                    processor.cache_group = cache_id;
+                                }
+                                else
+                                {
+                                    processor.numa_node = JOBS_MIN((size_t)entry->NumaNode.NodeNumber, max_numa_nodes - 1);
+                                }
+                            }
+                        }
+
+                        if (entry->Relationship == RelationCache)
+                        {
+                            cache_id++;
+                        }
+                    }
+
+                    offset += entry->Size;
+                }
+            }
+
+            memory_functions.user_free(info);
+        }
+    }
+
+#else
+
+    (void)memory_functions;
+
+#endif
+
+    // No topology information, treat each logical processor as its own core.
+    if (count == 0)
+    {
+#if defined(JOBS_PLATFORM_PS4)
+        size_t processor_count = 6; // The 7th core is shared with the OS.
+#else
+        size_t processor_count = std::thread::hardware_concurrency();
+#endif
+
+        for (size_t i = 0; i < processor_count && i < buffer_size && i < max_logical_processors; i++)
+        {
+            logical_processor& processor = buffer[count++];
+            processor.index = i;
+            processor.core = i;
+            processor.smt_index = 0;
+            processor.cache_group = 0;
+            processor.numa_node = 0;
+        }
+    }
+
+    std::sort(buffer, buffer + count, [](const logical_processor& lhs, const logical_processor& rhs)
+    {
+        return lhs.index < rhs.index;
+    });
+
+    return count;
+}
+
+size_t get_placement_order(const logical_processor* processors, size_t processor_count, thread_placement placement, size_t numa_node, size_t* output)
+{
+    size_t count = 0;
+
+    for (size_t pass = 0; pass < 2 && count == 0; pass++)
+    {
+        for (size_t i = 0; i < processor_count; i++)
+        {
+            const logical_processor& processor = processors[i];
+
+            // First pass restricts to the requested node, if the node has no processors the second includes everything.
+            if (pass == 0 && numa_node != any_numa_node && processor.numa_node != numa_node)
+            {
+                continue;
+            }
+            if (placement == thread_placement::physical_cores && processor.smt_index != 0)
+            {
+                continue;
+            }
+
+            output[count++] = i;
+        }
+    }
+
+    // Processors are already in index order, which is all logical_cores and physical_cores require.
+    if (placement == thread_placement::smt_siblings_last)
+    {
+        std::stable_sort(output, output + count, [processors](size_t lhs, size_t rhs)
+        {
+            return processors[lhs].smt_index < processors[rhs].smt_index;
+        });
+    }
+    else if (placement == thread_placement::group_by_cache)
+    {
+        std::stable_sort(output, output + count, [processors](size_t lhs, size_t rhs)
+        {
+            if (processors[lhs].cache_group != processors[rhs].cache_group)
+            {
+                return processors[lhs].cache_group < processors[rhs].cache_group;
+            }
+            return processors[lhs].smt_index < processors[rhs].smt_index;
+        });
+    }
+
+    return count;
+}
+
+void* numa_alloc(size_t size, size_t alignment, size_t node)
+{
+#if defined(JOBS_PLATFORM_WINDOWS)
+
+    // VirtualAlloc'd blocks are page aligned, which satisfies any alignment we request internally.
+    (void)alignment;
+    return VirtualAllocExNuma(GetCurrentProcess(), nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE, (DWORD)node);
+
+#elif defined(JOBS_PLATFORM_XBOX_ONE)
+
+    (void)node;
+    return _aligned_malloc(size, alignment);
+
+#else
+
+    (void)node;
+    return memalign(alignment, size);
+
+#endif
+}
+
+void numa_free(void* ptr)
+{
+#if defined(JOBS_PLATFORM_WINDOWS)
+
+    VirtualFree(ptr, 0, MEM_RELEASE);
+
+#elif defined(JOBS_PLATFORM_XBOX_ONE)
+
+    _aligned_free(ptr);
+
+#else
+
+    free(ptr);
+
+#endif
+}
+
+numa_arena::~numa_arena()
+{
+    while (m_head != nullptr)
+    {
+        block* next = m_head->next;
+        m_free_function(m_head);
+        m_head = next;
+    }
+}
+
+void numa_arena::init(const memory_alloc_numa_function& alloc_function, const memory_free_function& free_function, size_t node)
+{
+    m_alloc_function = alloc_function;
+    m_free_function = free_function;
+    m_node = node;
+}
+
+void* numa_arena::alloc(size_t size, size_t alignment)
+{
+    assert(size <= max_alloc_size);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_head != nullptr)
+    {
+        void* ptr = carve(m_head, size, alignment);
+        if (ptr != nullptr)
+        {
+            return ptr;
+        }
+    }
+
+    // Out of space in the current block, the remainder of it is wasted.
+    block* new_block = static_cast<block*>(m_alloc_function(block_size, alignof(std::max_align_t), m_node));
+    if (new_block == nullptr)
+    {
+        return nullptr;
+    }
+
+    new_block->next = m_head;
+    new_block->used = sizeof(block);
+    m_head = new_block;
+
+    return carve(m_head, size, alignment);
+}
+
+void* numa_arena::carve(block* target, size_t size, size_t alignment)
+{
+    uintptr_t start = reinterpret_cast<uintptr_t>(target);
+    uintptr_t address = (start + target->used + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (address + size > start + block_size)
+    {
+        return nullptr;
+    }
+
+    target->used = (size_t)(address + size - start);
+    return reinterpret_cast<void*>(address);
+}
+
+bool numa_arena::owns(void* ptr)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (block* iter = m_head; iter != nullptr; iter = iter->next)
+    {
+        char* start = reinterpret_cast<char*>(iter);
+        if (static_cast<char*>(ptr) >= start && static_cast<char*>(ptr) < start + block_size)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+}; /* namespace internal */
+}; /* namespace jobs */
\ No newline at end of file
@@ -47,6 +47,44 @@ void debug_print(const char* format, ...)
 #endif
 }
 
+size_t get_thread_shard_index()
+{
+    static std::atomic<size_t> next_shard_index{ 0 };
+    static thread_local size_t shard_index = next_shard_index++ % sharded_activity_counter::shard_count;
+
+    return shard_index;
+}
+
+parking_slot::parking_slot()
+#if defined(JOBS_PLATFORM_PS4) 
+    : m_mutex(nullptr)
+    , m_cvar(nullptr)
+#endif
+{
+}
+
+bool parking_slot::park(const timeout& in_timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (in_timeout.duration == timeout::infinite.duration)
+    {
+        m_cvar.wait(lock, [this] { return m_unparked; });
+        return true;
+    }
+    else
+    {
+        return m_cvar.wait_for(lock, std::chrono::milliseconds(in_timeout.duration), [this] { return m_unparked; });
+    }
+}
+
+void parking_slot::unpark()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_unparked = true;
+    m_cvar.notify_one();
+}
+
 void stopwatch::start()
 {
     m_start_time = std::chrono::high_resolution_clock::now();
@@ -88,9 +126,8 @@ uint64_t stopwatch::get_elapsed_us()
         end_time = std::chrono::high_resolution_clock::now();
     }
 
-    float elapsed = std::chrono::duration<float, std::chrono::microseconds::period>(end_time - m_start_time).count();
-
-    return (uint64_t)elapsed;
+    // Integer duration, a float loses microsecond precision after ~16 seconds.
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(end_time - m_start_time).count();
 }
 
 }; /* namespace internal */